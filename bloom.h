@@ -0,0 +1,304 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// dual filter (Kawase) bloom and the final tonemap to the window
+// the HDR scene is downsampled into a chain of R11F_G11F_B10F targets
+// starting at half its size, each level half the one before, with a
+// 5 tap filter; the first step also keeps only what is brighter than the
+// threshold. the chain is then walked back up with an 8 tap filter, each
+// level added onto the one above it, so the half size level ends up holding
+// every blur width at once. a single fullscreen pass adds it to the scene,
+// tonemaps and writes the window. every pass is timed on the GPU. like the
+// scene's targets, the chain is allocated for the largest scene and each
+// frame uses the corner of every level its scene size covers; the shaders
+// clamp their taps to that corner.
+// ---------------------------------------------------------------------------
+class BloomChain
+{
+public:
+    static const int MAX_LEVELS = 6;
+    // passes: one down and one up per level (less the last up) and the tonemap
+    static const int MAX_PASSES = 2 * MAX_LEVELS;
+
+    BloomChain() = default;
+    BloomChain(const BloomChain &) = delete;
+    BloomChain &operator=(const BloomChain &) = delete;
+
+    // (re)allocate the chain for a scene of up to w x h; cheap when the size
+    // didn't change. levels stop before either side drops under 8 pixels
+    // ------------------------------------------------------------------------
+    void resize(int w, int h)
+    {
+        if (w == sceneWidth && h == sceneHeight)
+            return;
+        if (!emptyVAO)
+            createObjects();
+        sceneWidth = w;
+        sceneHeight = h;
+        levelCount = 0;
+        int levelWidth = std::max(w / 2, 1), levelHeight = std::max(h / 2, 1);
+        while (levelCount < MAX_LEVELS && (levelCount == 0 || std::min(levelWidth, levelHeight) >= 8))
+        {
+            sizes[levelCount][0] = levelWidth;
+            sizes[levelCount][1] = levelHeight;
+            glBindTexture(GL_TEXTURE_2D, textures[levelCount]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, levelWidth, levelHeight, 0, GL_RGB, GL_FLOAT, NULL);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[levelCount]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[levelCount], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::BLOOM::LEVEL_INCOMPLETE" << std::endl;
+            levelCount++;
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // timings of the old chain don't line up with the new passes
+        std::fill(&pending[0][0], &pending[0][0] + FRAMES * MAX_PASSES, false);
+        std::fill(passMs, passMs + MAX_PASSES, 0.0);
+        activeLevels = 0;
+        setViewport(w, h);
+    }
+    // the scene's size this frame, within the allocated one; the levels in
+    // use follow it with the same rule as the allocation
+    // ------------------------------------------------------------------------
+    void setViewport(int w, int h)
+    {
+        viewWidth = std::min(std::max(w, 1), sceneWidth);
+        viewHeight = std::min(std::max(h, 1), sceneHeight);
+        int previousLevels = activeLevels;
+        activeLevels = 0;
+        int levelWidth = std::max(viewWidth / 2, 1), levelHeight = std::max(viewHeight / 2, 1);
+        while (activeLevels < levelCount && (activeLevels == 0 || std::min(levelWidth, levelHeight) >= 8))
+        {
+            views[activeLevels][0] = levelWidth;
+            views[activeLevels][1] = levelHeight;
+            activeLevels++;
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+        // the up passes' timings move to other slots
+        if (activeLevels != previousLevels)
+        {
+            std::fill(&pending[0][0], &pending[0][0] + FRAMES * MAX_PASSES, false);
+            std::fill(passMs, passMs + MAX_PASSES, 0.0);
+        }
+    }
+
+    // blur the scene texture (linearly filtered) down and back up the chain
+    // ------------------------------------------------------------------------
+    void render(Shader &downShader, Shader &upShader, unsigned int sceneTexture, float threshold)
+    {
+        collect();
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        downShader.use();
+        downShader.setInt("source", 0);
+        unsigned int source = sceneTexture;
+        for (int i = 0; i < activeLevels; i++)
+        {
+            // the first step brings the scene down and cuts it at the threshold
+            downShader.setFloat("threshold", i == 0 ? threshold : -1.0f);
+            if (i == 0)
+                downShader.setVec2("sourceMax", uvMax(viewWidth, viewHeight, sceneWidth, sceneHeight));
+            else
+                downShader.setVec2("sourceMax", uvMax(views[i - 1][0], views[i - 1][1], sizes[i - 1][0], sizes[i - 1][1]));
+            beginPass(i);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glViewport(0, 0, views[i][0], views[i][1]);
+            glBindTexture(GL_TEXTURE_2D, source);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            endPass();
+            source = textures[i];
+        }
+
+        upShader.use();
+        upShader.setInt("source", 0);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (int i = activeLevels - 2; i >= 0; i--)
+        {
+            upShader.setVec2("sourceMax", uvMax(views[i + 1][0], views[i + 1][1], sizes[i + 1][0], sizes[i + 1][1]));
+            beginPass(activeLevels + (activeLevels - 2 - i));
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glViewport(0, 0, views[i][0], views[i][1]);
+            glBindTexture(GL_TEXTURE_2D, textures[i + 1]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            endPass();
+        }
+        glDisable(GL_BLEND);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        bloomReady = true;
+    }
+
+    // add the bloom to the scene, tonemap and write the window (or the given
+    // framebuffer); strength 0 (or no render() since the last resize) leaves
+    // the bloom out. sceneScale is the share of the scene texture the image
+    // covers, from its lower left corner
+    // ------------------------------------------------------------------------
+    void tonemap(Shader &tonemapShader, unsigned int sceneTexture, const glm::vec2 &sceneScale, int windowWidth,
+                 int windowHeight, float exposure, float strength, unsigned int targetFramebuffer = 0)
+    {
+        bool withBloom = bloomReady && strength > 0.0f;
+        if (!withBloom)
+            collect();
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glDisable(GL_DEPTH_TEST);
+        tonemapShader.use();
+        tonemapShader.setInt("scene", 0);
+        tonemapShader.setInt("bloom", 1);
+        tonemapShader.setFloat("exposure", exposure);
+        tonemapShader.setVec2("windowSize", glm::vec2(windowWidth, windowHeight));
+        tonemapShader.setVec2("sceneScale", sceneScale);
+        glm::vec2 bloomScale((float)views[0][0] / sizes[0][0], (float)views[0][1] / sizes[0][1]);
+        tonemapShader.setVec2("bloomScale", withBloom ? bloomScale : sceneScale);
+        // the half size level sums every level, keep the total about the same
+        // however long the chain is
+        tonemapShader.setFloat("bloomStrength", withBloom ? strength / activeLevels : 0.0f);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, withBloom ? textures[0] : sceneTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneTexture);
+        beginPass(MAX_PASSES - 1);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        endPass();
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEnable(GL_DEPTH_TEST);
+        bloomReady = false;
+        next = (next + 1) % FRAMES;
+    }
+
+    // last GPU time of each pass, in chain order
+    void printStats() const
+    {
+        char line[96];
+        double total = 0.0;
+        for (int i = 0; i < activeLevels; i++)
+        {
+            std::snprintf(line, sizeof(line), "bloom down %4dx%-4d %.3f ms", views[i][0], views[i][1], passMs[i]);
+            std::cout << line << std::endl;
+            total += passMs[i];
+        }
+        for (int i = activeLevels - 2; i >= 0; i--)
+        {
+            int pass = activeLevels + (activeLevels - 2 - i);
+            std::snprintf(line, sizeof(line), "bloom up   %4dx%-4d %.3f ms", views[i][0], views[i][1], passMs[pass]);
+            std::cout << line << std::endl;
+            total += passMs[pass];
+        }
+        std::snprintf(line, sizeof(line), "tonemap            %.3f ms (bloom and tonemap %.3f ms)", passMs[MAX_PASSES - 1],
+                      total + passMs[MAX_PASSES - 1]);
+        std::cout << line << std::endl;
+    }
+
+    // delete the chain; call while the context is still current
+    void release()
+    {
+        if (!emptyVAO)
+            return;
+        glDeleteTextures(MAX_LEVELS, textures);
+        glDeleteFramebuffers(MAX_LEVELS, framebuffers);
+        glDeleteQueries(FRAMES * MAX_PASSES, &queries[0][0]);
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+        sceneWidth = sceneHeight = viewWidth = viewHeight = 0;
+        levelCount = activeLevels = 0;
+    }
+
+private:
+    // queries are read back this many frames late, without waiting
+    static const int FRAMES = 4;
+    int sceneWidth = 0, sceneHeight = 0;
+    int levelCount = 0;
+    int sizes[MAX_LEVELS][2] = {};
+    // the scene and the levels as used this frame
+    int viewWidth = 0, viewHeight = 0;
+    int activeLevels = 0;
+    int views[MAX_LEVELS][2] = {};
+    unsigned int textures[MAX_LEVELS] = {}, framebuffers[MAX_LEVELS] = {};
+    unsigned int emptyVAO = 0;
+    bool bloomReady = false;
+    unsigned int queries[FRAMES][MAX_PASSES] = {};
+    bool pending[FRAMES][MAX_PASSES] = {};
+    int next = 0;
+    int activePass = -1;
+    double passMs[MAX_PASSES] = {};
+
+    void createObjects()
+    {
+        glGenTextures(MAX_LEVELS, textures);
+        for (unsigned int texture : textures)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(MAX_LEVELS, framebuffers);
+        glGenQueries(FRAMES * MAX_PASSES, &queries[0][0]);
+        // core profile draws need a vertex array even without attributes
+        glGenVertexArrays(1, &emptyVAO);
+    }
+    // the last texture coordinate a bilinear tap can take in the used w x h
+    // corner of a source allocated larger without reading past it
+    static glm::vec2 uvMax(int w, int h, int allocatedWidth, int allocatedHeight)
+    {
+        return glm::vec2((w - 0.5f) / allocatedWidth, (h - 0.5f) / allocatedHeight);
+    }
+    // a pass whose query from FRAMES frames ago hasn't come back goes untimed
+    void beginPass(int pass)
+    {
+        if (pending[next][pass])
+            return;
+        activePass = pass;
+        glBeginQuery(GL_TIME_ELAPSED, queries[next][pass]);
+    }
+    void endPass()
+    {
+        if (activePass < 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next][activePass] = true;
+        activePass = -1;
+    }
+    void collect()
+    {
+        for (int frame = 0; frame < FRAMES; frame++)
+            for (int pass = 0; pass < MAX_PASSES; pass++)
+            {
+                if (!pending[frame][pass])
+                    continue;
+                int available = 0;
+                glGetQueryObjectiv(queries[frame][pass], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    continue;
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[frame][pass], GL_QUERY_RESULT, &nanoseconds);
+                passMs[pass] = nanoseconds / 1.0e6;
+                pending[frame][pass] = false;
+            }
+    }
+};
+#endif
@@ -0,0 +1,387 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "include/glm/glm.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// bounding volume hierarchy over static triangles for CPU ray casts
+// four children per node, their boxes stored component by component
+// (minX[4], minY[4], ...) so a ray is tested against all four at once (with
+// SSE2, or a plain loop otherwise). built top-down with a binned surface
+// area heuristic: each node splits its triangles in two, then splits the
+// larger halves again until it has four children.
+// ---------------------------------------------------------------------------
+class TriangleBVH
+{
+public:
+    struct Hit
+    {
+        float t;
+        int triangle;
+        // barycentric weights of the triangle's second and third corner
+        float u, v;
+    };
+
+    // three corners per triangle; triangle indices in hits refer to this order
+    // ------------------------------------------------------------------------
+    void build(const std::vector<glm::vec3> &corners)
+    {
+        int count = (int)(corners.size() / 3);
+        nodes.clear();
+        leaves.clear();
+        triangles.clear();
+        order.resize(count);
+        bounds.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            order[i] = i;
+            bounds[i].min = glm::min(corners[i * 3], glm::min(corners[i * 3 + 1], corners[i * 3 + 2]));
+            bounds[i].max = glm::max(corners[i * 3], glm::max(corners[i * 3 + 1], corners[i * 3 + 2]));
+        }
+        if (count > 0)
+            buildNode(0, count);
+        // triangles in leaf order, as a corner and two edges
+        triangles.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec3 *c = &corners[order[i] * 3];
+            triangles[i] = {c[0], c[1] - c[0], c[2] - c[0], order[i]};
+        }
+        bounds.clear();
+        bounds.shrink_to_fit();
+    }
+    size_t nodeCount() const
+    {
+        return nodes.size();
+    }
+    size_t triangleCount() const
+    {
+        return triangles.size();
+    }
+
+    // nearest hit along origin + t * direction for t in (0, tMax)
+    // ------------------------------------------------------------------------
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, Hit &hit) const
+    {
+        hit.t = tMax;
+        hit.triangle = -1;
+        traverse<false>(origin, direction, hit);
+        return hit.triangle >= 0;
+    }
+    // whether anything lies along origin + t * direction for t in (0, tMax)
+    bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+    {
+        Hit hit = {tMax, -1, 0.0f, 0.0f};
+        return traverse<true>(origin, direction, hit);
+    }
+
+private:
+    static const int LEAF_SIZE = 4;
+    static const int BINS = 12;
+    struct Box
+    {
+        glm::vec3 min, max;
+    };
+    struct Node
+    {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        // >= 0: child node; -1: empty; otherwise leaf -(child + 2)
+        int child[4];
+    };
+    struct Leaf
+    {
+        int first, count;
+    };
+    struct Triangle
+    {
+        glm::vec3 corner, edge1, edge2;
+        int index;
+    };
+    std::vector<Node> nodes;
+    std::vector<Leaf> leaves;
+    std::vector<Triangle> triangles;
+    // build state
+    std::vector<int> order;
+    std::vector<Box> bounds;
+
+    static float area(const Box &b)
+    {
+        glm::vec3 d = b.max - b.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    Box rangeBounds(int begin, int end) const
+    {
+        Box b = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (int i = begin; i < end; i++)
+        {
+            b.min = glm::min(b.min, bounds[order[i]].min);
+            b.max = glm::max(b.max, bounds[order[i]].max);
+        }
+        return b;
+    }
+    // binned SAH split of [begin, end); returns the first index of the right half
+    int split(int begin, int end)
+    {
+        Box centroids = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (int i = begin; i < end; i++)
+        {
+            glm::vec3 c = (bounds[order[i]].min + bounds[order[i]].max) * 0.5f;
+            centroids.min = glm::min(centroids.min, c);
+            centroids.max = glm::max(centroids.max, c);
+        }
+        float bestCost = FLT_MAX;
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroids.max[axis] - centroids.min[axis];
+            if (extent <= 0.0f)
+                continue;
+            Box binBounds[BINS];
+            int binCounts[BINS] = {};
+            for (Box &b : binBounds)
+                b = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+            for (int i = begin; i < end; i++)
+            {
+                const Box &tb = bounds[order[i]];
+                float c = (tb.min[axis] + tb.max[axis]) * 0.5f;
+                int bin = std::min(BINS - 1, (int)((c - centroids.min[axis]) / extent * BINS));
+                binCounts[bin]++;
+                binBounds[bin].min = glm::min(binBounds[bin].min, tb.min);
+                binBounds[bin].max = glm::max(binBounds[bin].max, tb.max);
+            }
+            // sweep from the right, then from the left evaluating each plane
+            float rightAreas[BINS];
+            int rightCounts[BINS];
+            Box sweep = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+            int countSum = 0;
+            for (int bin = BINS - 1; bin > 0; bin--)
+            {
+                sweep.min = glm::min(sweep.min, binBounds[bin].min);
+                sweep.max = glm::max(sweep.max, binBounds[bin].max);
+                countSum += binCounts[bin];
+                rightAreas[bin] = countSum ? area(sweep) : 0.0f;
+                rightCounts[bin] = countSum;
+            }
+            sweep = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+            countSum = 0;
+            for (int bin = 0; bin < BINS - 1; bin++)
+            {
+                sweep.min = glm::min(sweep.min, binBounds[bin].min);
+                sweep.max = glm::max(sweep.max, binBounds[bin].max);
+                countSum += binCounts[bin];
+                if (countSum == 0 || rightCounts[bin + 1] == 0)
+                    continue;
+                float cost = area(sweep) * countSum + rightAreas[bin + 1] * rightCounts[bin + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+        int middle;
+        if (bestAxis >= 0)
+        {
+            float extent = centroids.max[bestAxis] - centroids.min[bestAxis];
+            middle = (int)(std::partition(order.begin() + begin, order.begin() + end, [&](int t) {
+                               float c = (bounds[t].min[bestAxis] + bounds[t].max[bestAxis]) * 0.5f;
+                               return std::min(BINS - 1, (int)((c - centroids.min[bestAxis]) / extent * BINS)) <= bestBin;
+                           }) -
+                           order.begin());
+        }
+        else
+            middle = (begin + end) / 2; // every centroid in one spot
+        if (middle == begin || middle == end)
+            middle = (begin + end) / 2;
+        return middle;
+    }
+    int buildNode(int begin, int end)
+    {
+        // split the largest range in two until there are four
+        int ranges[4][2] = {{begin, end}};
+        int rangeCount = 1;
+        while (rangeCount < 4)
+        {
+            int largest = -1;
+            for (int i = 0; i < rangeCount; i++)
+                if (ranges[i][1] - ranges[i][0] > LEAF_SIZE && (largest < 0 || ranges[i][1] - ranges[i][0] > ranges[largest][1] - ranges[largest][0]))
+                    largest = i;
+            if (largest < 0)
+                break;
+            int middle = split(ranges[largest][0], ranges[largest][1]);
+            ranges[rangeCount][0] = middle;
+            ranges[rangeCount][1] = ranges[largest][1];
+            ranges[largest][1] = middle;
+            rangeCount++;
+        }
+        int index = (int)nodes.size();
+        nodes.emplace_back();
+        for (int i = 0; i < 4; i++)
+        {
+            Node &node = nodes[index];
+            if (i >= rangeCount)
+            {
+                node.minX[i] = node.minY[i] = node.minZ[i] = FLT_MAX;
+                node.maxX[i] = node.maxY[i] = node.maxZ[i] = -FLT_MAX;
+                node.child[i] = -1;
+                continue;
+            }
+            Box b = rangeBounds(ranges[i][0], ranges[i][1]);
+            node.minX[i] = b.min.x;
+            node.minY[i] = b.min.y;
+            node.minZ[i] = b.min.z;
+            node.maxX[i] = b.max.x;
+            node.maxY[i] = b.max.y;
+            node.maxZ[i] = b.max.z;
+            int child;
+            if (ranges[i][1] - ranges[i][0] <= LEAF_SIZE)
+            {
+                child = -((int)leaves.size() + 2);
+                leaves.push_back({ranges[i][0], ranges[i][1] - ranges[i][0]});
+            }
+            else
+                child = buildNode(ranges[i][0], ranges[i][1]);
+            // nodes may have grown, so index again
+            nodes[index].child[i] = child;
+        }
+        return index;
+    }
+
+    // Moller-Trumbore; updates hit when closer than hit.t
+    static bool intersectTriangle(const Triangle &tri, const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit, int index)
+    {
+        glm::vec3 p = glm::cross(direction, tri.edge2);
+        float det = glm::dot(tri.edge1, p);
+        if (std::fabs(det) < 1e-12f)
+            return false;
+        float inverse = 1.0f / det;
+        glm::vec3 s = origin - tri.corner;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, tri.edge1);
+        float v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(tri.edge2, q) * inverse;
+        if (t <= 1e-5f || t >= hit.t)
+            return false;
+        hit = {t, index, u, v};
+        return true;
+    }
+    template <bool ANY_HIT>
+    bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverse = 1.0f / direction;
+#ifdef __SSE2__
+        __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+        __m128 inverseX = _mm_set1_ps(inverse.x), inverseY = _mm_set1_ps(inverse.y), inverseZ = _mm_set1_ps(inverse.z);
+#endif
+        int stack[64];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0)
+        {
+            const Node &node = nodes[stack[--depth]];
+            // slab test against all four boxes; infinities from axis aligned
+            // rays fall out of the min/max correctly
+            alignas(16) float tNear[4];
+            bool hits[4];
+#ifdef __SSE2__
+            __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+            __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+            __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+            __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+            __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+            __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+            __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+                                      _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+            __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+                                     _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(hit.t)));
+            _mm_store_ps(tNear, enter);
+            int mask = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+            for (int i = 0; i < 4; i++)
+                hits[i] = (mask >> i) & 1;
+#else
+            for (int i = 0; i < 4; i++)
+            {
+                float x0 = (node.minX[i] - origin.x) * inverse.x, x1 = (node.maxX[i] - origin.x) * inverse.x;
+                float y0 = (node.minY[i] - origin.y) * inverse.y, y1 = (node.maxY[i] - origin.y) * inverse.y;
+                float z0 = (node.minZ[i] - origin.z) * inverse.z, z1 = (node.maxZ[i] - origin.z) * inverse.z;
+                float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+                float exit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), hit.t));
+                tNear[i] = enter;
+                hits[i] = enter <= exit;
+            }
+#endif
+            // visit near children first: push them last
+            int visit[4], visitCount = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                if (!hits[i] || node.child[i] == -1)
+                    continue;
+                int at = visitCount++;
+                while (at > 0 && tNear[visit[at - 1]] < tNear[i])
+                {
+                    visit[at] = visit[at - 1];
+                    at--;
+                }
+                visit[at] = i;
+            }
+            for (int k = 0; k < visitCount; k++)
+            {
+                int child = node.child[visit[k]];
+                if (child >= 0)
+                {
+                    stack[depth++] = child;
+                    continue;
+                }
+                const Leaf &leaf = leaves[-child - 2];
+                for (int t = leaf.first; t < leaf.first + leaf.count; t++)
+                    if (intersectTriangle(triangles[t], origin, direction, hit, triangles[t].index) && ANY_HIT)
+                        return true;
+            }
+        }
+        return hit.triangle >= 0;
+    }
+};
+
+// world space triangles of the meshes that never move, for casting rays
+// against the whole static scene
+// ---------------------------------------------------------------------------
+struct StaticScene
+{
+    std::vector<glm::vec3> corners;
+    // one per triangle
+    std::vector<glm::vec3> normals;
+    TriangleBVH bvh;
+
+    // a non-indexed mesh placed by model, which only rotates and translates
+    void add(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &meshNormals, const glm::mat4 &model)
+    {
+        for (size_t v = 0; v + 2 < positions.size(); v += 3)
+        {
+            for (int i = 0; i < 3; i++)
+                corners.push_back(glm::vec3(model * glm::vec4(positions[v + i], 1.0f)));
+            normals.push_back(glm::normalize(glm::mat3(model) * meshNormals[v]));
+        }
+    }
+    void build()
+    {
+        bvh.build(corners);
+    }
+};
+#endif
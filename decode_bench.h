@@ -0,0 +1,164 @@
+#ifndef DECODE_BENCH_H
+#define DECODE_BENCH_H
+
+#include "stb_image.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// lets stb_image split JPEG restart intervals across a ThreadPool
+// register with stbi_set_jpeg_parallel_for(threadPoolParallelFor, &pool, jobs)
+inline void threadPoolParallelFor(stbi_parallel_job *job, void *jobUser, int count, void *user)
+{
+    static_cast<ThreadPool *>(user)->parallelFor(count, [&](int i) { job(jobUser, i); });
+}
+
+// decode throughput benchmark
+// times stbi_load_from_memory over a corpus of image files so file IO stays out
+// of the numbers. run from the build directory:
+//   ./app --bench-decode [-n iterations] [-t threads] [-s log2scale] [files...]
+// with no files the repo's own textures are used. with more than one thread
+// every file is decoded serially and then with the restart-interval parallel
+// JPEG path; SSE2 vs AVX2 kernels are compared by building with and without
+// the ENABLE_AVX2 CMake option. -s 1..3 decodes JPEGs at 1/2, 1/4 or 1/8 size.
+// ---------------------------------------------------------------------------
+struct DecodeBenchResult
+{
+    std::string path;
+    size_t fileBytes = 0;
+    size_t decodedBytes = 0;
+    int iterations = 0;
+    double seconds = 0.0;
+};
+
+inline bool readFileBytes(const std::string &path, std::vector<unsigned char> &out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+inline bool benchmarkDecode(const std::string &path, int iterations, DecodeBenchResult &result)
+{
+    std::vector<unsigned char> file;
+    if (!readFileBytes(path, file))
+    {
+        std::cout << "ERROR::DECODE_BENCH::FILE_NOT_READ: " << path << std::endl;
+        return false;
+    }
+    result.path = path;
+    result.fileBytes = file.size();
+    result.iterations = iterations;
+
+    // one untimed decode to warm caches and validate the file
+    int width, height, nrComponents;
+    unsigned char *data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &nrComponents, 0);
+    if (!data)
+    {
+        std::cout << "ERROR::DECODE_BENCH::DECODE_FAILED: " << path << " (" << stbi_failure_reason() << ")" << std::endl;
+        return false;
+    }
+    stbi_image_free(data);
+    result.decodedBytes = (size_t)width * height * nrComponents;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &nrComponents, 0);
+        stbi_image_free(data);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+inline void printDecodeResult(const char *label, const DecodeBenchResult &r)
+{
+    double perDecodeMs = r.seconds * 1000.0 / r.iterations;
+    double outMBs = (double)r.decodedBytes * r.iterations / r.seconds / (1024.0 * 1024.0);
+    double inMBs = (double)r.fileBytes * r.iterations / r.seconds / (1024.0 * 1024.0);
+    std::cout << "  " << r.path << label << ": " << perDecodeMs << " ms/decode, "
+              << outMBs << " MB/s decoded, " << inMBs << " MB/s compressed" << std::endl;
+}
+
+inline int runDecodeBenchmark(int argc, char **argv)
+{
+    int iterations = 50;
+    int threads = 1;
+    int scale = 0;
+    std::vector<std::string> paths;
+    for (int i = 0; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            iterations = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            scale = std::min(3, std::max(0, std::atoi(argv[++i])));
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.empty())
+        paths = {"../assets/steelbox.png", "../assets/steelbox_specular.png", "../assets/demon_emmision.png"};
+
+    std::cout << "decode benchmark (" << iterations << " iterations, " << threads << " threads, 1/" << (1 << scale) << " scale)"
+#ifdef __SSE2__
+              << " sse2"
+#endif
+#ifdef __AVX2__
+              << " avx2"
+#endif
+#ifdef STBI_ZLIB_FAST
+              << " zlib-fast"
+#endif
+              << std::endl;
+
+    // the calling thread takes part in parallelFor, so it counts as one of the threads
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1)
+        pool.reset(new ThreadPool(threads - 1));
+
+    stbi_set_jpeg_scale_on_load(scale);
+    double totalSeconds = 0.0, totalParallelSeconds = 0.0;
+    size_t totalDecoded = 0, totalFile = 0;
+    for (const std::string &path : paths)
+    {
+        DecodeBenchResult r;
+        stbi_set_jpeg_parallel_for(NULL, NULL, 0);
+        if (!benchmarkDecode(path, iterations, r))
+            return 1;
+        printDecodeResult("", r);
+        totalSeconds += r.seconds;
+        totalDecoded += r.decodedBytes * r.iterations;
+        totalFile += r.fileBytes * r.iterations;
+
+        if (pool)
+        {
+            DecodeBenchResult p;
+            stbi_set_jpeg_parallel_for(threadPoolParallelFor, pool.get(), threads * 4);
+            if (!benchmarkDecode(path, iterations, p))
+                return 1;
+            printDecodeResult(" (parallel)", p);
+            std::cout << "    speedup: " << r.seconds / p.seconds << "x" << std::endl;
+            totalParallelSeconds += p.seconds;
+        }
+    }
+    stbi_set_jpeg_parallel_for(NULL, NULL, 0);
+    stbi_set_jpeg_scale_on_load(0);
+    std::cout << "  total: " << totalDecoded / totalSeconds / (1024.0 * 1024.0) << " MB/s decoded, "
+              << totalFile / totalSeconds / (1024.0 * 1024.0) << " MB/s compressed" << std::endl;
+    if (pool)
+        std::cout << "  total (parallel): " << totalDecoded / totalParallelSeconds / (1024.0 * 1024.0) << " MB/s decoded" << std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,449 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "light_clusters.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// light volumes read ClusteredLight arrays as instance attributes as they are
+static_assert(offsetof(ClusteredLight, radius) == 3 * sizeof(float) && offsetof(ClusteredLight, color) == 4 * sizeof(float),
+              "ClusteredLight must be tightly packed");
+
+// offscreen scene targets and the deferred shading passes
+// the scene is drawn at its own size into an HDR light buffer (R11F_G11F_B10F
+// with a depth stencil texture) that bloom.h tonemaps to the window. the
+// forward path draws straight into it; the deferred path first fills the
+// G-buffer (see shaders/gbuffer.glsl for the layout), then adds the
+// directional and unranged point lights with one fullscreen pass and every
+// ranged light as an instanced bounding volume. volumes draw their back faces
+// with the depth test reversed, so only pixels whose surface lies in front of
+// the volume's far side are shaded; pixels in front of the volume are thrown
+// out by the shader's range check. the forward path can also draw into
+// multisampled buffers that are averaged into the light buffer afterwards.
+// the targets are allocated for the largest scene the window can ask for and
+// every pass draws into the corner the current scene size covers, so dynamic
+// resolution steps don't reallocate anything.
+// ---------------------------------------------------------------------------
+class DeferredRenderer
+{
+public:
+    DeferredRenderer() = default;
+    DeferredRenderer(const DeferredRenderer &) = delete;
+    DeferredRenderer &operator=(const DeferredRenderer &) = delete;
+
+    // (re)allocate the targets; cheap when the size didn't change. the scene
+    // drawn into them starts out covering all of them
+    // ------------------------------------------------------------------------
+    void resize(int w, int h)
+    {
+        if (w == targetWidth && h == targetHeight)
+            return;
+        if (!gbufferFBO)
+            createObjects();
+        targetWidth = viewWidth = w;
+        targetHeight = viewHeight = h;
+        allocate(albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(specular, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        allocate(normal, GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        allocate(light, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT);
+        allocate(depth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        allocate(depthCopy, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, specular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, light, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        const GLenum buffers[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+        glDrawBuffers(4, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::GBUFFER_INCOMPLETE" << std::endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, light, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::LIGHT_BUFFER_INCOMPLETE" << std::endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, depthCopyFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthCopy, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::DEPTH_COPY_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        allocateSamples();
+    }
+    // multisampling for the forward path; 1 turns it off
+    // ------------------------------------------------------------------------
+    void setSamples(int count)
+    {
+        if (count == samples)
+            return;
+        samples = count;
+        allocateSamples();
+    }
+    // the scene's size this frame, drawn into the targets' lower left corner;
+    // clamped to the allocated size
+    void setViewport(int w, int h)
+    {
+        viewWidth = std::min(std::max(w, 1), targetWidth);
+        viewHeight = std::min(std::max(h, 1), targetHeight);
+    }
+    int sampleCount() const
+    {
+        return samples;
+    }
+    int width() const
+    {
+        return viewWidth;
+    }
+    int height() const
+    {
+        return viewHeight;
+    }
+    // the share of the targets the scene covers, for passes that read them
+    // with texture coordinates
+    glm::vec2 uvScale() const
+    {
+        return glm::vec2((float)viewWidth / targetWidth, (float)viewHeight / targetHeight);
+    }
+    // the lit scene, filtered linearly for the bloom and tonemap passes
+    unsigned int lightTexture() const
+    {
+        return light;
+    }
+    // the scene's depth, as left by the geometry or forward pass
+    unsigned int depthTexture() const
+    {
+        return depth;
+    }
+
+    // forward shading: bind and clear the light buffer to draw the lit scene into
+    void beginForward(const glm::vec3 &clearColor)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, samples > 1 ? msaaFBO : lightFBO);
+        glViewport(0, 0, viewWidth, viewHeight);
+        glClearColor(clearColor.r, clearColor.g, clearColor.b, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    // back to the forward target after an offscreen pass, keeping what's drawn
+    void resumeForward()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, samples > 1 ? msaaFBO : lightFBO);
+        glViewport(0, 0, viewWidth, viewHeight);
+    }
+    // deferred shading: bind and clear the G-buffer for the geometry pass;
+    // clearColor fills the light buffer where nothing is drawn
+    // ------------------------------------------------------------------------
+    void beginGeometry(const glm::vec3 &clearColor)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+        glViewport(0, 0, viewWidth, viewHeight);
+        const float zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        const float background[4] = {clearColor.r, clearColor.g, clearColor.b, 1.0f};
+        for (int i = 0; i < 3; i++)
+            glClearBufferfv(GL_COLOR, i, zero);
+        glClearBufferfv(GL_COLOR, 3, background);
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+    }
+    // switch to the light buffer with additive blending and depth writes off.
+    // the G-buffer's depth stays attached for the light volumes' depth test,
+    // so the shaders read a copy of it: sampling a texture that is attached
+    // to the bound framebuffer is a feedback loop, undefined even when
+    // nothing writes to it
+    // ------------------------------------------------------------------------
+    void beginLighting()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gbufferFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthCopyFBO);
+        glBlitFramebuffer(0, 0, viewWidth, viewHeight, 0, 0, viewWidth, viewHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        unsigned int textures[4] = {albedo, specular, normal, depthCopy};
+        for (int i = 0; i < 4; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+    // point a light pass shader at the G-buffer (units 0 to 3)
+    void bindGBuffer(const Shader &shader, const glm::mat4 &viewProjection) const
+    {
+        shader.setInt("gbufferAlbedo", 0);
+        shader.setInt("gbufferSpecular", 1);
+        shader.setInt("gbufferNormal", 2);
+        shader.setInt("gbufferDepth", 3);
+        shader.setVec2("gbufferSize", glm::vec2(viewWidth, viewHeight));
+        shader.setMat4("inverseViewProjection", glm::inverse(viewProjection));
+    }
+    // shade every pixel with the bound program
+    void drawFullscreen()
+    {
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glEnable(GL_DEPTH_TEST);
+    }
+    // one instance of the volume mesh per light, with the bound program
+    // ------------------------------------------------------------------------
+    void drawLightVolumes(const std::vector<ClusteredLight> &lights)
+    {
+        if (lights.empty())
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, lights.size() * sizeof(ClusteredLight), lights.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_FRONT);
+        glDepthFunc(GL_GEQUAL);
+        glBindVertexArray(volumeVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, VOLUME_INDICES, GL_UNSIGNED_BYTE, 0, (GLsizei)lights.size());
+        glDepthFunc(GL_LESS);
+        glCullFace(GL_BACK);
+        glDisable(GL_CULL_FACE);
+    }
+    // back to normal state; the light buffer stays bound for forward drawn
+    // extras like the light cube
+    // ------------------------------------------------------------------------
+    void endLighting()
+    {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        for (int i = 0; i < 4; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+    // average the multisampled forward pass into the light buffer and depth
+    // texture, once everything is drawn; nothing to do without multisampling
+    // ------------------------------------------------------------------------
+    void resolveSamples()
+    {
+        if (samples <= 1)
+            return;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lightFBO);
+        glBlitFramebuffer(0, 0, viewWidth, viewHeight, 0, 0, viewWidth, viewHeight, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                          GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+    }
+    // delete the targets; call while the context is still current
+    void release()
+    {
+        if (!gbufferFBO)
+            return;
+        if (msaaFBO)
+        {
+            glDeleteFramebuffers(1, &msaaFBO);
+            unsigned int renderbuffers[2] = {msaaColor, msaaDepth};
+            glDeleteRenderbuffers(2, renderbuffers);
+            msaaFBO = msaaColor = msaaDepth = 0;
+        }
+        unsigned int textures[6] = {albedo, specular, normal, light, depth, depthCopy};
+        glDeleteTextures(6, textures);
+        unsigned int framebuffers[3] = {gbufferFBO, lightFBO, depthCopyFBO};
+        glDeleteFramebuffers(3, framebuffers);
+        unsigned int buffers[3] = {volumeVBO, volumeEBO, instanceVBO};
+        glDeleteBuffers(3, buffers);
+        unsigned int arrays[2] = {volumeVAO, emptyVAO};
+        glDeleteVertexArrays(2, arrays);
+        gbufferFBO = lightFBO = depthCopyFBO = 0;
+        targetWidth = targetHeight = viewWidth = viewHeight = 0;
+    }
+
+private:
+    static const int VOLUME_INDICES = 60;
+    int targetWidth = 0, targetHeight = 0;
+    int viewWidth = 0, viewHeight = 0;
+    unsigned int gbufferFBO = 0, lightFBO = 0, depthCopyFBO = 0;
+    unsigned int albedo = 0, specular = 0, normal = 0, light = 0, depth = 0;
+    // what the lighting passes sample in place of the attached depth
+    unsigned int depthCopy = 0;
+    unsigned int volumeVAO = 0, volumeVBO = 0, volumeEBO = 0, instanceVBO = 0;
+    unsigned int emptyVAO = 0;
+    int samples = 1;
+    unsigned int msaaFBO = 0, msaaColor = 0, msaaDepth = 0;
+
+    void createObjects()
+    {
+        glGenFramebuffers(1, &gbufferFBO);
+        glGenFramebuffers(1, &lightFBO);
+        glGenFramebuffers(1, &depthCopyFBO);
+        unsigned int *textures[6] = {&albedo, &specular, &normal, &light, &depth, &depthCopy};
+        for (unsigned int *texture : textures)
+        {
+            glGenTextures(1, texture);
+            glBindTexture(GL_TEXTURE_2D, *texture);
+            GLint filter = texture == &light ? GL_LINEAR : GL_NEAREST;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // icosahedron pushed out so its faces, not just its corners, enclose
+        // the unit sphere (its inradius is 0.7947 of the circumradius)
+        const float t = 1.618034f;
+        float corners[12][3] = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t},
+                                {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+        float scale = 1.0f / (0.7947f * std::sqrt(1.0f + t * t));
+        float vertices[12 * 3];
+        for (int i = 0; i < 12; i++)
+            for (int j = 0; j < 3; j++)
+                vertices[i * 3 + j] = corners[i][j] * scale;
+        // counter-clockwise seen from outside
+        const unsigned char indices[VOLUME_INDICES] = {0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                                                       3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+        glGenVertexArrays(1, &volumeVAO);
+        glGenBuffers(1, &volumeVBO);
+        glGenBuffers(1, &volumeEBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(volumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        // position and radius, then color, straight from the light array
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ClusteredLight), (void *)offsetof(ClusteredLight, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ClusteredLight), (void *)offsetof(ClusteredLight, color));
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // core profile draws need a vertex array even without attributes
+        glGenVertexArrays(1, &emptyVAO);
+    }
+    // multisampled color and depth at the target size, when asked for
+    void allocateSamples()
+    {
+        if (samples <= 1 || targetWidth == 0)
+            return;
+        if (!msaaFBO)
+        {
+            glGenFramebuffers(1, &msaaFBO);
+            glGenRenderbuffers(1, &msaaColor);
+            glGenRenderbuffers(1, &msaaDepth);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, msaaColor);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_R11F_G11F_B10F, targetWidth, targetHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, msaaDepth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, targetWidth, targetHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaaColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, msaaDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::DEFERRED::MULTISAMPLE_BUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    void allocate(unsigned int texture, GLenum internalFormat, GLenum format, GLenum type)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, targetWidth, targetHeight, 0, format, type, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+// forward vs deferred shading benchmark, run inside the normal render loop:
+//   ./app --bench-shading [-f frames]
+// steps through both paths at each light count and resolution, times frames
+// rendered to completion (glFinish) and prints one line per configuration
+// ---------------------------------------------------------------------------
+class ShadingBenchmark
+{
+public:
+    struct Config
+    {
+        bool deferred;
+        int lights;
+        int width, height;
+    };
+
+    // looks for --bench-shading in the command line; inactive without it
+    ShadingBenchmark(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--bench-shading")
+                enabled = true;
+            else if (arg == "-f" && i + 1 < argc)
+                frames = std::max(1, std::atoi(argv[++i]));
+        }
+        if (!enabled)
+            return;
+        const int lightCounts[] = {0, 256, 1024, 4096};
+        const int sizes[][2] = {{640, 360}, {1280, 720}, {1920, 1080}};
+        for (const int *size : sizes)
+            for (int lights : lightCounts)
+                for (bool deferred : {false, true})
+                    configs.push_back({deferred, lights, size[0], size[1]});
+        std::cout << "shading benchmark: " << frames << " frames per configuration" << std::endl;
+    }
+
+    bool running() const
+    {
+        return enabled && current < configs.size();
+    }
+    const Config &config() const
+    {
+        return configs[current];
+    }
+    // call once the frame has finished on the GPU; returns false after the
+    // last configuration
+    // ------------------------------------------------------------------------
+    bool frameDone()
+    {
+        auto now = std::chrono::steady_clock::now();
+        // the first frames of each configuration allocate targets and upload
+        if (++frame == WARMUP_FRAMES)
+            start = now;
+        if (frame < WARMUP_FRAMES + frames)
+            return true;
+        std::chrono::duration<double, std::milli> elapsed = now - start;
+        const Config &c = configs[current];
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-8s %4d lights %4dx%-4d  %8.3f ms/frame", c.deferred ? "deferred" : "forward",
+                      c.lights, c.width, c.height, elapsed.count() / frames);
+        std::cout << line << std::endl;
+        frame = 0;
+        current++;
+        return running();
+    }
+
+private:
+    static const int WARMUP_FRAMES = 3;
+    bool enabled = false;
+    int frames = 20;
+    std::vector<Config> configs;
+    size_t current = 0;
+    int frame = 0;
+    std::chrono::steady_clock::time_point start;
+};
+#endif
@@ -0,0 +1,189 @@
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "shader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+// depth-only pre-pass
+// lays down the scene's depth with color writes off, from a VAO holding only
+// positions and the per-instance model matrices, so the expensive color pass
+// that follows (tested GL_EQUAL, depth writes off) shades each pixel once no
+// matter what order things are drawn in
+// ---------------------------------------------------------------------------
+class DepthPrepass
+{
+public:
+    // mesh is the vertex buffer, positions first in each vertex
+    DepthPrepass(unsigned int meshVBO, int stride, int vertexCount) : vertexCount(vertexCount)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int i = 0; i < 4; i++)
+        {
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(i * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    DepthPrepass(const DepthPrepass &) = delete;
+    DepthPrepass &operator=(const DepthPrepass &) = delete;
+
+    // draw the depth of every instance into the bound framebuffer (already
+    // cleared), then set up depth state for the color pass
+    // ------------------------------------------------------------------------
+    void draw(Shader &depthShader, const glm::mat4 &projection, const glm::mat4 &view, const std::vector<glm::mat4> &models)
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        if (!models.empty())
+        {
+            depthShader.use();
+            depthShader.setMat4("projection", projection);
+            depthShader.setMat4("view", view);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(VAO);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, (int)models.size());
+            glBindVertexArray(0);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    // back to the usual depth state once the color pass is drawn
+    void finish()
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    // delete the buffers; call while the context is still current
+    void release()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+        VAO = instanceVBO = 0;
+    }
+
+private:
+    int vertexCount;
+    unsigned int VAO = 0, instanceVBO = 0;
+};
+
+// how many fragments the scene's color pass shades, and what the scene's
+// passes cost on the GPU, from occlusion and timer queries. results are
+// picked up a few frames late instead of waiting for them
+// ---------------------------------------------------------------------------
+class OverdrawCounter
+{
+public:
+    OverdrawCounter()
+    {
+        glGenQueries(FRAMES, sampleQueries);
+        glGenQueries(FRAMES, timeQueries);
+    }
+    OverdrawCounter(const OverdrawCounter &) = delete;
+    OverdrawCounter &operator=(const OverdrawCounter &) = delete;
+
+    // around everything that draws the scene, pre-pass included
+    void beginPass(int pixels)
+    {
+        collect();
+        measuring = !pending[next];
+        if (!measuring)
+            return;
+        framePixels[next] = pixels;
+        glBeginQuery(GL_TIME_ELAPSED, timeQueries[next]);
+    }
+    void endPass()
+    {
+        if (!measuring)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % FRAMES;
+    }
+    // around the draws whose fragments run the lighting shader
+    void beginShading()
+    {
+        if (measuring)
+            glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[next]);
+    }
+    void endShading()
+    {
+        if (measuring)
+            glEndQuery(GL_SAMPLES_PASSED);
+    }
+
+    uint64_t shadedFragments() const
+    {
+        return fragments;
+    }
+    // shaded fragments per pixel of the target
+    double fragmentsPerPixel() const
+    {
+        return pixels > 0 ? (double)fragments / pixels : 0.0;
+    }
+    double gpuMs() const
+    {
+        return milliseconds;
+    }
+    void printStats(const char *mode) const
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "scene pass (%s): %llu fragments shaded, %.2f per pixel, %.3f ms gpu", mode,
+                      (unsigned long long)fragments, fragmentsPerPixel(), milliseconds);
+        std::cout << line << std::endl;
+    }
+    // delete the queries; call while the context is still current
+    void release()
+    {
+        glDeleteQueries(FRAMES, sampleQueries);
+        glDeleteQueries(FRAMES, timeQueries);
+    }
+
+private:
+    static const int FRAMES = 4;
+    unsigned int sampleQueries[FRAMES], timeQueries[FRAMES];
+    bool pending[FRAMES] = {};
+    int framePixels[FRAMES] = {};
+    int next = 0;
+    bool measuring = false;
+    uint64_t fragments = 0;
+    int pixels = 0;
+    double milliseconds = 0.0;
+
+    void collect()
+    {
+        for (int i = 0; i < FRAMES; i++)
+        {
+            if (!pending[i])
+                continue;
+            int available = 0;
+            glGetQueryObjectiv(timeQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 samples = 0, nanoseconds = 0;
+            glGetQueryObjectui64v(sampleQueries[i], GL_QUERY_RESULT, &samples);
+            glGetQueryObjectui64v(timeQueries[i], GL_QUERY_RESULT, &nanoseconds);
+            fragments = samples;
+            pixels = framePixels[i];
+            milliseconds = nanoseconds / 1.0e6;
+            pending[i] = false;
+        }
+    }
+};
+#endif
@@ -0,0 +1,162 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include "include/glad/glad.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// dynamic resolution: picks the scale the scene is rendered at from measured
+// GPU frame times. each frame's GPU work is bracketed by two timestamp
+// queries (timestamps, unlike GL_TIME_ELAPSED, don't clash with the passes'
+// own timers) read back a few frames late. every ADJUST_FRAMES measured
+// frames the average is compared against the target: cost follows pixel
+// count, so the scale moves by the square root of the ratio. it only grows
+// back once there is clear headroom, and is rounded to whole steps. the
+// targets are allocated once for the largest scale (maxSceneSize) and the
+// scene only draws into the part of them the current scale covers, so a
+// step never reallocates anything.
+// ---------------------------------------------------------------------------
+class DynamicResolution
+{
+public:
+    DynamicResolution(float targetMs, float minScale, float maxScale)
+        : targetMs(targetMs), minScale(minScale), maxScale(maxScale), currentScale(maxScale)
+    {
+        glGenQueries(FRAMES, startQueries);
+        glGenQueries(FRAMES, endQueries);
+    }
+    DynamicResolution(const DynamicResolution &) = delete;
+    DynamicResolution &operator=(const DynamicResolution &) = delete;
+
+    // off renders at the full window size and stops adjusting
+    void setEnabled(bool on)
+    {
+        enabled = on;
+        sumMs = 0.0;
+        samples = 0;
+        stale = FRAMES;
+        if (!enabled)
+            currentScale = maxScale;
+    }
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    // the scene size for a window of w x h at the current scale
+    void sceneSize(int w, int h, int &sceneWidth, int &sceneHeight) const
+    {
+        sceneWidth = std::max(1, (int)std::lround(w * currentScale));
+        sceneHeight = std::max(1, (int)std::lround(h * currentScale));
+    }
+    // the largest scene size for a window of w x h, which the targets are
+    // allocated at
+    void maxSceneSize(int w, int h, int &sceneWidth, int &sceneHeight) const
+    {
+        sceneWidth = std::max(1, (int)std::lround(w * maxScale));
+        sceneHeight = std::max(1, (int)std::lround(h * maxScale));
+    }
+    float scale() const
+    {
+        return currentScale;
+    }
+
+    // around all of a frame's GPU work; picks up finished frames and adjusts
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        collect();
+        measuring = !pending[next];
+        if (measuring)
+            glQueryCounter(startQueries[next], GL_TIMESTAMP);
+    }
+    void endFrame()
+    {
+        if (!measuring)
+            return;
+        glQueryCounter(endQueries[next], GL_TIMESTAMP);
+        pending[next] = true;
+        next = (next + 1) % FRAMES;
+    }
+
+    void printStats() const
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "dynamic resolution %s: scale %.2f, gpu frame %.3f ms (target %.1f ms)",
+                      enabled ? "on" : "off", currentScale, lastMs, targetMs);
+        std::cout << line << std::endl;
+    }
+    // delete the queries; call while the context is still current
+    void release()
+    {
+        glDeleteQueries(FRAMES, startQueries);
+        glDeleteQueries(FRAMES, endQueries);
+    }
+
+private:
+    static const int FRAMES = 4;
+    static const int ADJUST_FRAMES = 8;
+    // scales are multiples of this, and growing needs this much spare time
+    static constexpr float STEP = 0.05f;
+    static constexpr float HEADROOM = 0.85f;
+    float targetMs, minScale, maxScale;
+    float currentScale;
+    bool enabled = true;
+    unsigned int startQueries[FRAMES], endQueries[FRAMES];
+    bool pending[FRAMES] = {};
+    int next = 0;
+    bool measuring = false;
+    double sumMs = 0.0, lastMs = 0.0;
+    int samples = 0;
+    int stale = 0;
+
+    void collect()
+    {
+        for (int i = 0; i < FRAMES; i++)
+        {
+            if (!pending[i])
+                continue;
+            int available = 0;
+            glGetQueryObjectiv(endQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(startQueries[i], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(endQueries[i], GL_QUERY_RESULT, &end);
+            pending[i] = false;
+            lastMs = (end - start) / 1.0e6;
+            // frames already queued at the old scale say nothing about the new one
+            if (stale > 0)
+            {
+                stale--;
+                continue;
+            }
+            sumMs += lastMs;
+            samples++;
+        }
+        if (samples >= ADJUST_FRAMES)
+        {
+            adjust(sumMs / samples);
+            sumMs = 0.0;
+            samples = 0;
+        }
+    }
+    void adjust(double averageMs)
+    {
+        if (!enabled || averageMs <= 0.0)
+            return;
+        if (averageMs < targetMs && averageMs > targetMs * HEADROOM)
+            return;
+        // aim a little under the target so the next spike has room
+        float wanted = currentScale * (float)std::sqrt(targetMs * HEADROOM / averageMs);
+        wanted = std::floor(wanted / STEP + 0.5f) * STEP;
+        wanted = std::min(maxScale, std::max(minScale, wanted));
+        if (wanted != currentScale)
+            stale = FRAMES;
+        currentScale = wanted;
+    }
+};
+#endif
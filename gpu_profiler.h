@@ -0,0 +1,291 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "include/glad/glad.h"
+
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// GPU time of each render pass, without stalling
+// begin(name) and end() bracket a pass with two GL_TIMESTAMP queries, so
+// passes can nest (a GL_TIME_ELAPSED query can't be opened inside another
+// one). each frame uses its own set of queries out of a ring of FRAMES; a
+// frame's results are read once its last query reports
+// GL_QUERY_RESULT_AVAILABLE, usually two or three frames later, and a frame
+// whose queries are all still in flight simply isn't timed. passes() holds
+// the latest and the rolling average time of every pass seen so far, along
+// with the CPU time spent between its begin() and end() calls. with
+// ENABLE_PROFILER the passes also go into the CPU trace as a "GPU" track,
+// placed on the CPU clock by pairing the GPU's time with the CPU's at the
+// start of every frame. the total time of each frame read back is also kept
+// for takeFrameTimes(), so a benchmark can pair it with the frame it timed.
+// ---------------------------------------------------------------------------
+class GpuProfiler
+{
+public:
+    struct Pass
+    {
+        const char *name;
+        // how many passes enclose it
+        int depth;
+        double gpuMs;
+        double gpuAverageMs;
+        // time spent issuing it, measured right away
+        double cpuMs;
+        double cpuAverageMs;
+    };
+    struct FrameTime
+    {
+        // which beginFrame() call, counting from 0
+        unsigned long long frame;
+        double gpuMs;
+    };
+
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    // collect finished frames and start timing this one; needs a current context
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        if (!created)
+            createObjects();
+        collect();
+        unsigned long long number = frameNumber++;
+        Frame &frame = frames[next];
+        recording = !frame.pending;
+        depth = 0;
+        if (!recording)
+            return;
+        frame.number = number;
+        frame.count = 0;
+        frame.lastQuery = -1;
+#ifdef ENABLE_PROFILER
+        glGetInteger64v(GL_TIMESTAMP, &frame.anchorGpu);
+        frame.anchorTicks = Profiler::now();
+#endif
+    }
+    // name must be a string literal; passes past MAX_PASSES in a frame aren't timed
+    void begin(const char *name)
+    {
+        int index = -1;
+        Frame &frame = frames[next];
+        if (recording && frame.count < MAX_PASSES)
+        {
+            index = frame.count++;
+            frame.names[index] = name;
+            frame.depths[index] = depth;
+            glQueryCounter(frame.queries[2 * index], GL_TIMESTAMP);
+            frame.lastQuery = 2 * index;
+        }
+        // listed in the order they begin, so nested passes follow their parent
+        find(name, depth);
+        if (depth < MAX_DEPTH)
+        {
+            open[depth] = index;
+            openNames[depth] = name;
+            openTimes[depth] = std::chrono::steady_clock::now();
+        }
+        depth++;
+    }
+    void end()
+    {
+        if (depth == 0)
+        {
+            std::cout << "ERROR::GPU_PROFILER::END_WITHOUT_BEGIN" << std::endl;
+            return;
+        }
+        depth--;
+        if (depth >= MAX_DEPTH)
+            return;
+        std::chrono::duration<double, std::milli> cpu = std::chrono::steady_clock::now() - openTimes[depth];
+        Pass &pass = find(openNames[depth], depth);
+        pass.cpuAverageMs = pass.cpuMs == 0.0 ? cpu.count() : pass.cpuAverageMs + (cpu.count() - pass.cpuAverageMs) * AVERAGE_WEIGHT;
+        pass.cpuMs = cpu.count();
+        int index = open[depth];
+        if (index < 0)
+            return;
+        Frame &frame = frames[next];
+        glQueryCounter(frame.queries[2 * index + 1], GL_TIMESTAMP);
+        frame.lastQuery = 2 * index + 1;
+    }
+    void endFrame()
+    {
+        if (depth != 0)
+            std::cout << "ERROR::GPU_PROFILER::UNBALANCED_PASSES" << std::endl;
+        if (!recording)
+            return;
+        Frame &frame = frames[next];
+        frame.pending = frame.count > 0;
+        next = (next + 1) % FRAMES;
+        recording = false;
+    }
+
+    // wait for every frame still in flight and read it
+    void finish()
+    {
+        if (!created)
+            return;
+        glFinish();
+        collect();
+    }
+    // frames begun so far
+    unsigned long long frameCount() const
+    {
+        return frameNumber;
+    }
+    // the frames read back since the last call, oldest first; only the
+    // latest MAX_FRAME_TIMES are kept in between
+    std::vector<FrameTime> takeFrameTimes()
+    {
+        std::vector<FrameTime> taken;
+        taken.swap(frameTimes);
+        return taken;
+    }
+
+    // every pass timed so far, each followed by the passes nested in it
+    const std::vector<Pass> &passes() const
+    {
+        return results;
+    }
+    void printStats() const
+    {
+        char line[160];
+        for (const Pass &p : results)
+        {
+            std::snprintf(line, sizeof(line), "pass %*s%-*s %8.3f ms gpu (average %.3f), %.3f ms cpu (average %.3f)",
+                          2 * p.depth, "", 20 - 2 * p.depth, p.name, p.gpuMs, p.gpuAverageMs, p.cpuMs, p.cpuAverageMs);
+            std::cout << line << std::endl;
+        }
+    }
+    // delete the queries; call while the context is still current
+    void release()
+    {
+        if (!created)
+            return;
+        for (Frame &frame : frames)
+            glDeleteQueries(2 * MAX_PASSES, frame.queries);
+        created = false;
+    }
+
+private:
+    static const int FRAMES = 4;
+    static const int MAX_PASSES = 32;
+    static const int MAX_DEPTH = 8;
+    static const size_t MAX_FRAME_TIMES = 1024;
+    // share of each new time in the rolling average
+    static constexpr double AVERAGE_WEIGHT = 0.1;
+    struct Frame
+    {
+        unsigned int queries[2 * MAX_PASSES] = {};
+        const char *names[MAX_PASSES] = {};
+        int depths[MAX_PASSES] = {};
+        int count = 0;
+        int lastQuery = -1;
+        bool pending = false;
+        unsigned long long number = 0;
+        GLint64 anchorGpu = 0;
+        uint64_t anchorTicks = 0;
+    };
+    Frame frames[FRAMES];
+    int next = 0;
+    bool recording = false;
+    bool created = false;
+    int depth = 0;
+    int open[MAX_DEPTH] = {};
+    const char *openNames[MAX_DEPTH] = {};
+    std::chrono::steady_clock::time_point openTimes[MAX_DEPTH];
+    unsigned long long frameNumber = 0;
+    std::vector<Pass> results;
+    std::vector<FrameTime> frameTimes;
+#ifdef ENABLE_PROFILER
+    Profiler::Buffer *track = nullptr;
+#endif
+
+    Pass &find(const char *name, int passDepth)
+    {
+        for (Pass &p : results)
+            if (std::strcmp(p.name, name) == 0)
+            {
+                p.depth = passDepth;
+                return p;
+            }
+        // new passes go after their parent and whatever is already nested in it
+        size_t at = results.size();
+        if (passDepth > 0 && passDepth <= MAX_DEPTH)
+            for (size_t i = 0; i < results.size(); i++)
+                if (std::strcmp(results[i].name, openNames[passDepth - 1]) == 0)
+                {
+                    at = i + 1;
+                    while (at < results.size() && results[at].depth > results[i].depth)
+                        at++;
+                    break;
+                }
+        results.insert(results.begin() + at, {name, passDepth, 0.0, 0.0, 0.0, 0.0});
+        return results[at];
+    }
+    void createObjects()
+    {
+        for (Frame &frame : frames)
+            glGenQueries(2 * MAX_PASSES, frame.queries);
+#ifdef ENABLE_PROFILER
+        track = &Profiler::shared().track("GPU");
+#endif
+        created = true;
+    }
+    // reads every frame whose queries have landed, oldest first, without waiting
+    void collect()
+    {
+        for (;;)
+        {
+            Frame *oldest = nullptr;
+            for (Frame &frame : frames)
+                if (frame.pending && (!oldest || frame.number < oldest->number))
+                    oldest = &frame;
+            if (!oldest)
+                return;
+            // queries finish in order, so the last one issued landing means all did
+            int available = 0;
+            glGetQueryObjectiv(oldest->queries[oldest->lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            read(*oldest);
+            oldest->pending = false;
+        }
+    }
+    void read(const Frame &frame)
+    {
+#ifdef ENABLE_PROFILER
+        double ticksPerNs = Profiler::shared().ticksPerMicrosecond() / 1000.0;
+#endif
+        double frameMs = 0.0;
+        for (int i = 0; i < frame.count; i++)
+        {
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+            Pass &pass = find(frame.names[i], frame.depths[i]);
+            double ms = (end - start) / 1.0e6;
+            // the first time seeds the average
+            pass.gpuAverageMs = pass.gpuMs == 0.0 ? ms : pass.gpuAverageMs + (ms - pass.gpuAverageMs) * AVERAGE_WEIGHT;
+            pass.gpuMs = ms;
+            if (frame.depths[i] == 0)
+                frameMs += ms;
+#ifdef ENABLE_PROFILER
+            uint64_t startTicks = frame.anchorTicks + (int64_t)(((GLint64)start - frame.anchorGpu) * ticksPerNs);
+            uint64_t endTicks = startTicks + (uint64_t)((end - start) * ticksPerNs);
+            track->record(frame.names[i], startTicks, endTicks);
+#endif
+        }
+        if (frameTimes.size() == MAX_FRAME_TIMES)
+            frameTimes.erase(frameTimes.begin());
+        frameTimes.push_back({frame.number, frameMs});
+    }
+};
+#endif
@@ -0,0 +1,431 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "camera.h"
+#include "gpu_profiler.h"
+#include "mapped_file.h"
+#include "material_packer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef ENABLE_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// an OpenGL context with no window and no surface, from EGL
+// Mesa's surfaceless platform needs no display server and falls back to
+// llvmpipe without a GPU; other drivers get the default display. the context
+// is made current without a surface (EGL_KHR_surfaceless_context), so there
+// is no default framebuffer and everything renders into framebuffer objects.
+// built without the ENABLE_HEADLESS option create() only says so.
+// ---------------------------------------------------------------------------
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    // a core profile context of at least major.minor, made current on this thread
+    // ------------------------------------------------------------------------
+    bool create(int major, int minor)
+    {
+#ifndef ENABLE_HEADLESS
+        (void)major;
+        (void)minor;
+        std::cout << "ERROR::HEADLESS::NOT_BUILT: configure with -DENABLE_HEADLESS=ON" << std::endl;
+        return false;
+#else
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        else
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "ERROR::HEADLESS::NO_DISPLAY" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            std::cout << "ERROR::HEADLESS::NO_SURFACELESS_CONTEXT" << std::endl;
+            release();
+            return false;
+        }
+        // no surface is ever made from the config, pbuffer is just what every
+        // surfaceless driver offers
+        const EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0 ||
+            !eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS::NO_CONFIG" << std::endl;
+            release();
+            return false;
+        }
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS::NO_CONTEXT: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            release();
+            return false;
+        }
+        return true;
+#endif
+    }
+    // for gladLoadGLLoader; EGL 1.5 hands out core functions as well
+    static void *getProcAddress(const char *name)
+    {
+#ifdef ENABLE_HEADLESS
+        return (void *)eglGetProcAddress(name);
+#else
+        (void)name;
+        return nullptr;
+#endif
+    }
+    void release()
+    {
+#ifdef ENABLE_HEADLESS
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        context = EGL_NO_CONTEXT;
+        display = EGL_NO_DISPLAY;
+#endif
+    }
+
+private:
+#ifdef ENABLE_HEADLESS
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+
+// a fixed camera path rendered without a window, run inside the normal
+// render loop like the other benchmarks:
+//   ./app --headless [-f frames] [-s WxH] [-i interval] [-o results.json]
+// once the shaders, textures and probes are ready, frames follow one loop
+// around the cubes at a fixed time step and are tonemapped into a framebuffer
+// object instead of a window. dynamic resolution and the overlay stay off and
+// every frame waits for texture streaming, so a run always renders the same
+// images. each frame records its CPU time, its GPU time from the GPU
+// profiler, and the cube draw calls and state changes. every interval frames
+// and after the last one the image is read back and hashed; the results are
+// written as JSON once the run ends.
+// ---------------------------------------------------------------------------
+class HeadlessBenchmark
+{
+public:
+    // looks for --headless in the command line; inactive without it. the
+    // window benchmarks can't run alongside: they have no window to close
+    // when they end, share -f and change the render size, so the hashes would
+    // no longer match other runs
+    // ------------------------------------------------------------------------
+    HeadlessBenchmark(int argc, char **argv)
+    {
+        bool windowBenchmark = false;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--headless")
+                enabled = true;
+            else if (arg == "--bench-shading" || arg == "--bench-aa")
+                windowBenchmark = true;
+            else if (arg == "-f" && i + 1 < argc)
+                frames = std::max(1, std::atoi(argv[++i]));
+            else if (arg == "-s" && i + 1 < argc)
+            {
+                int w = 0, h = 0;
+                if (std::sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+                {
+                    targetWidth = w;
+                    targetHeight = h;
+                }
+            }
+            else if (arg == "-i" && i + 1 < argc)
+                hashInterval = std::max(0, std::atoi(argv[++i]));
+            else if (arg == "-o" && i + 1 < argc)
+                outputPath = argv[++i];
+        }
+        if (!enabled)
+            return;
+        if (windowBenchmark)
+        {
+            std::cout << "ERROR::HEADLESS::BENCHMARK_CONFLICT: --bench-shading and --bench-aa need a window" << std::endl;
+            enabled = false;
+            conflict = true;
+            return;
+        }
+        records.reserve(frames);
+        std::cout << "headless: " << frames << " frames at " << targetWidth << "x" << targetHeight << " into "
+                  << outputPath << std::endl;
+    }
+    HeadlessBenchmark(const HeadlessBenchmark &) = delete;
+    HeadlessBenchmark &operator=(const HeadlessBenchmark &) = delete;
+
+    bool running() const
+    {
+        return enabled && !finished;
+    }
+    // --headless was asked for together with a window benchmark
+    bool rejected() const
+    {
+        return conflict;
+    }
+    int width() const
+    {
+        return targetWidth;
+    }
+    int height() const
+    {
+        return targetHeight;
+    }
+    // simulated seconds since the first measured frame, and the step between frames
+    float time() const
+    {
+        return (float)records.size() * FRAME_STEP;
+    }
+    float frameStep() const
+    {
+        return FRAME_STEP;
+    }
+    // the next frame is the first one measured
+    bool firstFrame() const
+    {
+        return records.empty();
+    }
+
+    // where the finished image goes instead of the window; 0 unless running
+    unsigned int framebuffer()
+    {
+        if (!running())
+            return 0;
+        if (!target)
+            createTarget();
+        return target;
+    }
+
+    // one loop around the middle of the scene over the run, always facing it,
+    // rising and falling twice; starts where the camera starts in a window
+    // ------------------------------------------------------------------------
+    void placeCamera(Camera &camera) const
+    {
+        float turn = 2.0f * 3.14159265f * (float)records.size() / (float)frames;
+        glm::vec3 position = PATH_CENTER + glm::vec3(PATH_RADIUS * std::sin(turn), PATH_RISE * std::sin(2.0f * turn),
+                                                     PATH_RADIUS * std::cos(turn));
+        glm::vec3 toCenter = glm::normalize(PATH_CENTER - position);
+        camera = Camera(position, glm::vec3(0.0f, 1.0f, 0.0f), glm::degrees(std::atan2(toCenter.z, toCenter.x)),
+                        glm::degrees(std::asin(toCenter.y)));
+    }
+
+    // bracket a measured frame; frameDone() follows the GPU profiler's
+    // endFrame() and writes the results after the last frame
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        start = std::chrono::steady_clock::now();
+    }
+    void frameDone(const MaterialInstances::Stats &stats, GpuProfiler &gpuProfiler)
+    {
+        std::chrono::duration<double, std::milli> cpu = std::chrono::steady_clock::now() - start;
+        Record record;
+        record.cpuMs = cpu.count();
+        record.draws = stats.draws;
+        record.stateChanges = stats.stateChanges;
+        record.gpuFrame = gpuProfiler.frameCount() - 1;
+        records.push_back(record);
+
+        bool last = (int)records.size() == frames;
+        if (last)
+            gpuProfiler.finish();
+        for (const GpuProfiler::FrameTime &t : gpuProfiler.takeFrameTimes())
+        {
+            // measured frames are consecutive, so their profiler frames are too
+            if (t.frame < records.front().gpuFrame || t.frame - records.front().gpuFrame >= records.size())
+                continue;
+            records[(size_t)(t.frame - records.front().gpuFrame)].gpuMs = t.gpuMs;
+        }
+        if (last || (hashInterval > 0 && records.size() % hashInterval == 0))
+            hashImage();
+        if (!last)
+            return;
+        finished = true;
+        writeResults();
+    }
+
+    // delete the target; call while the context is still current
+    void release()
+    {
+        if (!target)
+            return;
+        glDeleteFramebuffers(1, &target);
+        glDeleteTextures(1, &colorTexture);
+        target = 0;
+    }
+
+private:
+    // a 60 Hz display's frame
+    static constexpr float FRAME_STEP = 1.0f / 60.0f;
+    static inline const glm::vec3 PATH_CENTER = glm::vec3(0.0f, 0.0f, -6.0f);
+    static constexpr float PATH_RADIUS = 9.0f;
+    static constexpr float PATH_RISE = 1.5f;
+    struct Record
+    {
+        double cpuMs = 0.0;
+        // negative until the GPU profiler reports the frame; frames it had
+        // no queries left for stay that way
+        double gpuMs = -1.0;
+        int draws = 0;
+        int stateChanges = 0;
+        unsigned long long gpuFrame = 0;
+    };
+    struct ImageHash
+    {
+        int frame;
+        uint64_t hash;
+    };
+    bool enabled = false;
+    bool conflict = false;
+    bool finished = false;
+    int frames = 300;
+    int targetWidth = 800, targetHeight = 600;
+    int hashInterval = 60;
+    std::string outputPath = "headless.json";
+    std::vector<Record> records;
+    std::vector<ImageHash> hashes;
+    std::chrono::steady_clock::time_point start;
+    unsigned int target = 0, colorTexture = 0;
+
+    void createTarget()
+    {
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, targetWidth, targetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &target);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::HEADLESS::TARGET_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    // waits for the frame; only done every hashInterval frames
+    void hashImage()
+    {
+        std::vector<unsigned char> pixels((size_t)targetWidth * targetHeight * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        glReadPixels(0, 0, targetWidth, targetHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        hashes.push_back({(int)records.size() - 1, hashBytes(pixels.data(), pixels.size())});
+    }
+
+    void writeResults()
+    {
+        double cpuTotal = 0.0, cpuMax = 0.0, gpuTotal = 0.0, gpuMax = 0.0;
+        int gpuFrames = 0;
+        for (const Record &r : records)
+        {
+            cpuTotal += r.cpuMs;
+            cpuMax = std::max(cpuMax, r.cpuMs);
+            if (r.gpuMs < 0.0)
+                continue;
+            gpuTotal += r.gpuMs;
+            gpuMax = std::max(gpuMax, r.gpuMs);
+            gpuFrames++;
+        }
+        double cpuMean = cpuTotal / records.size();
+        double gpuMean = gpuFrames > 0 ? gpuTotal / gpuFrames : 0.0;
+
+        std::string json = "{\n";
+        char line[256];
+        std::snprintf(line, sizeof(line), "\"renderer\":\"%s\",\n\"version\":\"%s\",\n", jsonText(GL_RENDERER).c_str(),
+                      jsonText(GL_VERSION).c_str());
+        json += line;
+        std::snprintf(line, sizeof(line), "\"width\":%d,\n\"height\":%d,\n\"frames\":%d,\n\"frameStep\":%.6f,\n",
+                      targetWidth, targetHeight, frames, FRAME_STEP);
+        json += line;
+        std::snprintf(line, sizeof(line),
+                      "\"cpuMs\":{\"mean\":%.4f,\"max\":%.4f},\n\"gpuMs\":{\"mean\":%.4f,\"max\":%.4f,\"timedFrames\":%d},\n",
+                      cpuMean, cpuMax, gpuMean, gpuMax, gpuFrames);
+        json += line;
+        json += "\"perFrame\":[\n";
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const Record &r = records[i];
+            char gpu[32] = "null";
+            if (r.gpuMs >= 0.0)
+                std::snprintf(gpu, sizeof(gpu), "%.4f", r.gpuMs);
+            std::snprintf(line, sizeof(line), "{\"frame\":%d,\"cpuMs\":%.4f,\"gpuMs\":%s,\"draws\":%d,\"stateChanges\":%d}%s\n",
+                          (int)i, r.cpuMs, gpu, r.draws, r.stateChanges, i + 1 < records.size() ? "," : "");
+            json += line;
+        }
+        json += "],\n\"images\":[\n";
+        for (size_t i = 0; i < hashes.size(); i++)
+        {
+            std::snprintf(line, sizeof(line), "{\"frame\":%d,\"hash\":\"%016llx\"}%s\n", hashes[i].frame,
+                          (unsigned long long)hashes[i].hash, i + 1 < hashes.size() ? "," : "");
+            json += line;
+        }
+        json += "]\n}\n";
+
+        std::snprintf(line, sizeof(line), "headless: %d frames, %.3f ms cpu (max %.3f), %.3f ms gpu over %d timed frames (max %.3f)",
+                      frames, cpuMean, cpuMax, gpuMean, gpuFrames, gpuMax);
+        std::cout << line << std::endl;
+        std::snprintf(line, sizeof(line), "final image %016llx", (unsigned long long)hashes.back().hash);
+        std::cout << line << std::endl;
+
+        std::string temporary = outputPath + ".tmp";
+        FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::HEADLESS::FILE_NOT_WRITTEN: " << outputPath << std::endl;
+            return;
+        }
+        bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+        written = std::fclose(file) == 0 && written;
+        std::remove(outputPath.c_str());
+        if (!written || std::rename(temporary.c_str(), outputPath.c_str()) != 0)
+        {
+            std::cout << "ERROR::HEADLESS::FILE_NOT_WRITTEN: " << outputPath << std::endl;
+            std::remove(temporary.c_str());
+            return;
+        }
+        std::cout << "headless: results written to " << outputPath << std::endl;
+    }
+    // a driver string, without anything that would need escaping
+    static std::string jsonText(GLenum name)
+    {
+        const char *text = (const char *)glGetString(name);
+        std::string s = text ? text : "";
+        for (char &c : s)
+            if (c == '"' || c == '\\' || (unsigned char)c < 0x20)
+                c = ' ';
+        return s.substr(0, 96);
+    }
+};
+#endif
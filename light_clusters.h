@@ -0,0 +1,459 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "shader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// a point light with a hard range, as binned into clusters
+struct ClusteredLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+// clustered forward shading: CPU light binning into a froxel grid
+// the view frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles and
+// CLUSTER_Z depth slices spaced exponentially between the near and far planes.
+// every frame each light's bounding sphere is tested against the view space
+// box of every cluster (four lights at a time with SSE2, one depth slice per
+// worker job), and the shader loops over only the lights listed for the
+// cluster a fragment falls in. the grid ((offset, count) per cluster), the
+// light index lists and the light data go to the GPU as texture buffers.
+// ---------------------------------------------------------------------------
+class LightClusters
+{
+public:
+    static const int CLUSTER_X = 16;
+    static const int CLUSTER_Y = 9;
+    static const int CLUSTER_Z = 24;
+    static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+    struct Stats
+    {
+        int lights = 0;
+        size_t indices = 0;    // light references over all clusters
+        int maxPerCluster = 0;
+        bool overflowed = false; // more references than the index buffer holds
+        double binMs = 0.0;
+    };
+
+    LightClusters() : slices(CLUSTER_Z)
+    {
+        grid.assign(CLUSTER_COUNT * 2, 0);
+    }
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    // the frustum the grid is cut from; only rebuilds the cluster boxes when it
+    // changed. pass what the projection matrix is built from
+    // ------------------------------------------------------------------------
+    void setProjection(float fovY, float aspect, float nearPlane, float farPlane)
+    {
+        if (fovY == projFov && aspect == projAspect && nearPlane == zNear && farPlane == zFar)
+            return;
+        projFov = fovY;
+        projAspect = aspect;
+        zNear = nearPlane;
+        zFar = farPlane;
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+        boxes.resize(CLUSTER_COUNT);
+        for (int z = 0; z < CLUSTER_Z; z++)
+        {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (int y = 0; y < CLUSTER_Y; y++)
+            {
+                float y0 = -1.0f + 2.0f * y / CLUSTER_Y, y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_Y;
+                for (int x = 0; x < CLUSTER_X; x++)
+                {
+                    float x0 = -1.0f + 2.0f * x / CLUSTER_X, x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_X;
+                    // the tile's side planes spread out with depth, so the box
+                    // holds its corners at both ends of the slice (view looks down -z)
+                    Box &b = boxes[clusterIndex(x, y, z)];
+                    b.min[0] = std::min(x0 * tanX * d0, x0 * tanX * d1);
+                    b.max[0] = std::max(x1 * tanX * d0, x1 * tanX * d1);
+                    b.min[1] = std::min(y0 * tanY * d0, y0 * tanY * d1);
+                    b.max[1] = std::max(y1 * tanY * d0, y1 * tanY * d1);
+                    b.min[2] = -d1;
+                    b.max[2] = -d0;
+                }
+            }
+        }
+    }
+    // assign lights to clusters for this view; pool may be null
+    // ------------------------------------------------------------------------
+    void build(const glm::mat4 &view, const std::vector<ClusteredLight> &lights, ThreadPool *pool)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lightCount = (int)lights.size();
+        // view space positions, structure of arrays padded to a multiple of 4
+        // with lights that can't touch anything
+        size_t padded = (lights.size() + 3) & ~(size_t)3;
+        for (std::vector<float> *v : {&lightX, &lightY, &lightZ, &lightR})
+            v->assign(padded, 0.0f);
+        for (size_t i = lights.size(); i < padded; i++)
+            lightZ[i] = 1e30f;
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            glm::vec4 p = view * glm::vec4(lights[i].position, 1.0f);
+            lightX[i] = p.x;
+            lightY[i] = p.y;
+            lightZ[i] = p.z;
+            lightR[i] = lights[i].radius;
+        }
+
+        if (pool)
+            pool->parallelFor(CLUSTER_Z, [this](int z) { binSlice(z); });
+        else
+            for (int z = 0; z < CLUSTER_Z; z++)
+                binSlice(z);
+
+        // slices filled their own lists; lay them out back to back
+        indices.clear();
+        stats = Stats();
+        stats.lights = lightCount;
+        for (int z = 0; z < CLUSTER_Z; z++)
+        {
+            const Slice &s = slices[z];
+            uint32_t base = (uint32_t)indices.size();
+            size_t room = indexCapacity - std::min(indexCapacity, indices.size());
+            size_t take = std::min(room, s.indices.size());
+            stats.overflowed = stats.overflowed || take < s.indices.size();
+            indices.insert(indices.end(), s.indices.begin(), s.indices.begin() + take);
+            for (int c = 0; c < CLUSTER_X * CLUSTER_Y; c++)
+            {
+                int cluster = z * CLUSTER_X * CLUSTER_Y + c;
+                uint32_t offset = s.offsets[c], count = s.counts[c];
+                // clusters that didn't fit lose their lights rather than read garbage
+                if (offset + count > take)
+                    count = offset >= take ? 0 : (uint32_t)take - offset;
+                grid[cluster * 2] = base + offset;
+                grid[cluster * 2 + 1] = count;
+                stats.maxPerCluster = std::max(stats.maxPerCluster, (int)count);
+            }
+        }
+        stats.indices = indices.size();
+        stats.binMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    // upload the grid, index lists and light data; creates the buffers the
+    // first time, so call with the context current
+    // ------------------------------------------------------------------------
+    void upload(const std::vector<ClusteredLight> &lights)
+    {
+        if (!gridBuffer)
+            createBuffers();
+        std::vector<float> data(lights.size() * 8);
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            float *texel = &data[i * 8];
+            texel[0] = lights[i].position.x;
+            texel[1] = lights[i].position.y;
+            texel[2] = lights[i].position.z;
+            texel[3] = lights[i].radius;
+            texel[4] = lights[i].color.r;
+            texel[5] = lights[i].color.g;
+            texel[6] = lights[i].color.b;
+            texel[7] = 0.0f;
+        }
+        // orphan and refill; nothing reads last frame's lists any more
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(uint32_t), grid.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, indices.size()) * sizeof(uint32_t),
+                     indices.empty() ? NULL : indices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, data.size()) * sizeof(float), data.empty() ? NULL : data.data(),
+                     GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+    // bind the buffers to three texture units starting at firstUnit and point
+    // the shader's clusterGrid, clusterIndices and clusterLights at them
+    // ------------------------------------------------------------------------
+    void bind(const Shader &shader, int firstUnit, int viewportWidth, int viewportHeight) const
+    {
+        unsigned int textures[3] = {gridTexture, indexTexture, lightTexture};
+        const char *names[3] = {"clusterGrid", "clusterIndices", "clusterLights"};
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            shader.setInt(names[i], firstUnit + i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        // tiles per pixel, slices per log depth unit, near plane
+        shader.setVec4("clusterParams", (float)CLUSTER_X / viewportWidth, (float)CLUSTER_Y / viewportHeight,
+                       CLUSTER_Z / std::log(zFar / zNear), zNear);
+        glUniform3i(glGetUniformLocation(shader.ID, "clusterDims"), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    }
+    const Stats &lastStats() const
+    {
+        return stats;
+    }
+    // delete the buffers; call while the context is still current
+    void release()
+    {
+        unsigned int buffers[3] = {gridBuffer, indexBuffer, lightBuffer};
+        unsigned int textures[3] = {gridTexture, indexTexture, lightTexture};
+        glDeleteBuffers(3, buffers);
+        glDeleteTextures(3, textures);
+        gridBuffer = indexBuffer = lightBuffer = 0;
+        gridTexture = indexTexture = lightTexture = 0;
+    }
+
+private:
+    struct Box
+    {
+        float min[3], max[3];
+    };
+    // lights that passed a coarser test, r holding the squared radius and the
+    // arrays padded to a multiple of 4 with lights that can't touch anything
+    struct Candidates
+    {
+        std::vector<float> x, y, z, r;
+        std::vector<uint32_t> id;
+
+        void clear()
+        {
+            x.clear();
+            y.clear();
+            z.clear();
+            r.clear();
+            id.clear();
+        }
+        void push(float px, float py, float pz, float r2, uint32_t light)
+        {
+            x.push_back(px);
+            y.push_back(py);
+            z.push_back(pz);
+            r.push_back(r2);
+            id.push_back(light);
+        }
+        void pad()
+        {
+            while (x.size() & 3)
+                push(0.0f, 0.0f, 1e30f, 0.0f, 0);
+        }
+    };
+    // one depth slice's output, written by a single job
+    struct Slice
+    {
+        Candidates slice; // lights that reach the slice's depth range
+        Candidates row;   // of those, the ones that reach the current row of tiles
+        std::vector<uint32_t> indices;
+        uint32_t offsets[CLUSTER_X * CLUSTER_Y];
+        uint32_t counts[CLUSTER_X * CLUSTER_Y];
+    };
+
+    float projFov = 0.0f, projAspect = 0.0f, zNear = 0.1f, zFar = 100.0f;
+    std::vector<Box> boxes;
+    std::vector<float> lightX, lightY, lightZ, lightR;
+    int lightCount = 0;
+    std::vector<Slice> slices;
+    std::vector<uint32_t> grid;
+    std::vector<uint32_t> indices;
+    // texels the index buffer texture may hold, set from the driver's limit
+    // once the buffers exist (GL 3.3 only promises 65536)
+    size_t indexCapacity = SIZE_MAX;
+    Stats stats;
+    unsigned int gridBuffer = 0, indexBuffer = 0, lightBuffer = 0;
+    unsigned int gridTexture = 0, indexTexture = 0, lightTexture = 0;
+
+    static int clusterIndex(int x, int y, int z)
+    {
+        return (z * CLUSTER_Y + y) * CLUSTER_X + x;
+    }
+    float sliceDepth(int z) const
+    {
+        return zNear * std::pow(zFar / zNear, (float)z / CLUSTER_Z);
+    }
+    void createBuffers()
+    {
+        int maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        indexCapacity = (size_t)std::max(maxTexels, 65536);
+        unsigned int buffers[3], textures[3];
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        GLenum formats[3] = {GL_RG32UI, GL_R32UI, GL_RGBA32F};
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        gridBuffer = buffers[0];
+        indexBuffer = buffers[1];
+        lightBuffer = buffers[2];
+        gridTexture = textures[0];
+        indexTexture = textures[1];
+        lightTexture = textures[2];
+    }
+    // cull lights to the slice's depth range, then to each row of tiles, and
+    // test the survivors against every cluster box in the row
+    // ------------------------------------------------------------------------
+    void binSlice(int z)
+    {
+        Slice &s = slices[z];
+        float nearZ = -sliceDepth(z + 1), farZ = -sliceDepth(z); // view space, nearZ < farZ
+        s.slice.clear();
+        s.indices.clear();
+        for (size_t i = 0; i < lightX.size(); i++)
+        {
+            if (lightZ[i] + lightR[i] < nearZ || lightZ[i] - lightR[i] > farZ)
+                continue;
+            s.slice.push(lightX[i], lightY[i], lightZ[i], lightR[i] * lightR[i], (uint32_t)i);
+        }
+        s.slice.pad();
+        for (int y = 0; y < CLUSTER_Y; y++)
+        {
+            const Box *tiles = &boxes[(z * CLUSTER_Y + y) * CLUSTER_X];
+            Box row = tiles[0];
+            for (int x = 1; x < CLUSTER_X; x++)
+            {
+                row.min[0] = std::min(row.min[0], tiles[x].min[0]);
+                row.max[0] = std::max(row.max[0], tiles[x].max[0]);
+            }
+            s.row.clear();
+            testBox(row, s.slice, [&](size_t k) { s.row.push(s.slice.x[k], s.slice.y[k], s.slice.z[k], s.slice.r[k], s.slice.id[k]); });
+            s.row.pad();
+            for (int x = 0; x < CLUSTER_X; x++)
+            {
+                int tile = y * CLUSTER_X + x;
+                s.offsets[tile] = (uint32_t)s.indices.size();
+                testBox(tiles[x], s.row, [&](size_t k) { s.indices.push_back(s.row.id[k]); });
+                s.counts[tile] = (uint32_t)s.indices.size() - s.offsets[tile];
+            }
+        }
+    }
+    // calls hit(k) for every candidate whose sphere touches the box
+    template <typename Hit>
+    static void testBox(const Box &b, const Candidates &c, Hit hit)
+    {
+        size_t count = c.x.size();
+#ifdef __SSE2__
+        __m128 zero = _mm_setzero_ps();
+        __m128 minX = _mm_set1_ps(b.min[0]), maxX = _mm_set1_ps(b.max[0]);
+        __m128 minY = _mm_set1_ps(b.min[1]), maxY = _mm_set1_ps(b.max[1]);
+        __m128 minZ = _mm_set1_ps(b.min[2]), maxZ = _mm_set1_ps(b.max[2]);
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&c.x[i]), y = _mm_loadu_ps(&c.y[i]), z = _mm_loadu_ps(&c.z[i]);
+            // distance from the center to the box along each axis, 0 inside
+            __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minX, x), _mm_sub_ps(x, maxX)));
+            __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minY, y), _mm_sub_ps(y, maxY)));
+            __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minZ, z), _mm_sub_ps(z, maxZ)));
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            int hits = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&c.r[i])));
+            for (int lane = 0; lane < 4; lane++)
+                if (hits & (1 << lane))
+                    hit(i + lane);
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            float dx = std::max(0.0f, std::max(b.min[0] - c.x[i], c.x[i] - b.max[0]));
+            float dy = std::max(0.0f, std::max(b.min[1] - c.y[i], c.y[i] - b.max[1]));
+            float dz = std::max(0.0f, std::max(b.min[2] - c.z[i], c.z[i] - b.max[2]));
+            if (dx * dx + dy * dy + dz * dz <= c.r[i])
+                hit(i);
+        }
+#endif
+    }
+};
+
+// count lights scattered over a box, the same on every run for a given seed
+inline std::vector<ClusteredLight> randomClusteredLights(int count, unsigned int seed, const glm::vec3 &boundsMin,
+                                                         const glm::vec3 &boundsMax, float minRadius, float maxRadius)
+{
+    std::vector<ClusteredLight> lights(count);
+    // small LCG so every platform gets the same field
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / 16777216.0f;
+    };
+    for (ClusteredLight &l : lights)
+    {
+        l.position = boundsMin + (boundsMax - boundsMin) * glm::vec3(next(), next(), next());
+        l.radius = minRadius + (maxRadius - minRadius) * next();
+        l.color = glm::vec3(next(), next(), next());
+    }
+    return lights;
+}
+
+// light binning benchmark, runs without a window:
+//   ./app --bench-lights [-n lights] [-i iterations] [-t threads]
+// times LightClusters::build for a field of random lights in front of a camera
+// at the origin, serially and (with -t above 1) across a thread pool
+// ---------------------------------------------------------------------------
+inline int runLightBenchmark(int argc, char **argv)
+{
+    int lightCount = 4096;
+    int iterations = 100;
+    int threads = 1;
+    for (int i = 0; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            lightCount = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+            iterations = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+    }
+    std::cout << "light binning benchmark (" << lightCount << " lights, " << iterations << " iterations, " << threads
+              << " threads, " << LightClusters::CLUSTER_X << "x" << LightClusters::CLUSTER_Y << "x" << LightClusters::CLUSTER_Z
+              << " clusters)"
+#ifdef __SSE2__
+              << " sse2"
+#endif
+              << std::endl;
+
+    std::vector<ClusteredLight> lights =
+        randomClusteredLights(lightCount, 1u, glm::vec3(-20.0f, -10.0f, -60.0f), glm::vec3(20.0f, 10.0f, 0.0f), 0.5f, 3.0f);
+    LightClusters clusters;
+    clusters.setProjection(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view(1.0f);
+
+    // the calling thread takes part in parallelFor, so it counts as one of the threads
+    std::unique_ptr<ThreadPool> pool;
+    if (threads > 1)
+        pool.reset(new ThreadPool(threads - 1));
+    for (ThreadPool *p : {(ThreadPool *)nullptr, pool.get()})
+    {
+        clusters.build(view, lights, p);
+        double total = 0.0;
+        for (int i = 0; i < iterations; i++)
+        {
+            clusters.build(view, lights, p);
+            total += clusters.lastStats().binMs;
+        }
+        const LightClusters::Stats &s = clusters.lastStats();
+        std::cout << "  " << (p ? "parallel" : "serial") << ": " << total / iterations << " ms/build, "
+                  << (double)s.indices / LightClusters::CLUSTER_COUNT << " lights/cluster average, " << s.maxPerCluster
+                  << " max" << (s.overflowed ? ", index buffer overflowed" : "") << std::endl;
+        if (!pool)
+            break;
+    }
+    return 0;
+}
+#endif
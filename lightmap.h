@@ -0,0 +1,668 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "bvh.h"
+#include "mapped_file.h"
+#include "shader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// the static light baked into the lightmap: the first directional light and
+// the sky it's ambient term stands for
+struct LightmapSettings
+{
+    glm::vec3 lightDirection;
+    glm::vec3 lightColor;
+    glm::vec3 skyColor;
+    // reflectance of every bounce surface (the maps aren't loaded when baking)
+    float albedo = 0.5f;
+    int texelsPerUnit = 32;
+    // paths per texel and surfaces each path may bounce off
+    int samples = 128;
+    int bounces = 2;
+};
+
+// lightmap layout for many instances of one static mesh
+// the mesh is unwrapped once: triangles that share an edge and face the same
+// way form a chart, each chart is projected onto its plane at texelsPerUnit
+// and the charts are shelf packed, a texel apart, into a square tile. every
+// instance then gets its own tile of the atlas, and the shader maps the
+// mesh's lightmap UVs into it with a per-instance scale and offset.
+// ---------------------------------------------------------------------------
+class LightmapAtlas
+{
+public:
+    // vertices: vertexCount non-indexed vertices of stride floats, position
+    // then normal first; models as drawn, rotation and translation only
+    // ------------------------------------------------------------------------
+    void build(const float *vertices, int stride, int vertexCount, const std::vector<glm::mat4> &models, int texelsPerUnit)
+    {
+        positions.resize(vertexCount);
+        normals.resize(vertexCount);
+        for (int i = 0; i < vertexCount; i++)
+        {
+            const float *v = vertices + i * stride;
+            positions[i] = glm::vec3(v[0], v[1], v[2]);
+            normals[i] = glm::vec3(v[3], v[4], v[5]);
+        }
+        instanceModels = models;
+        unwrap(texelsPerUnit);
+        columns = std::max(1, (int)std::ceil(std::sqrt((double)models.size())));
+        rows = std::max(1, ((int)models.size() + columns - 1) / columns);
+    }
+
+    int width() const
+    {
+        return columns * tile;
+    }
+    int height() const
+    {
+        return rows * tile;
+    }
+    int tileSize() const
+    {
+        return tile;
+    }
+    int instanceCount() const
+    {
+        return (int)instanceModels.size();
+    }
+    const std::vector<glm::vec2> &meshUVs() const
+    {
+        return uvs;
+    }
+    const std::vector<glm::vec3> &meshPositions() const
+    {
+        return positions;
+    }
+    const std::vector<glm::vec3> &meshNormals() const
+    {
+        return normals;
+    }
+    const glm::mat4 &model(int instance) const
+    {
+        return instanceModels[instance];
+    }
+    // first texel of an instance's tile
+    glm::ivec2 tileOrigin(int instance) const
+    {
+        return glm::ivec2(instance % columns, instance / columns) * tile;
+    }
+    // maps the mesh's lightmap UVs into the instance's tile of the atlas
+    glm::vec4 scaleOffset(int instance) const
+    {
+        glm::ivec2 origin = tileOrigin(instance);
+        return glm::vec4((float)tile / width(), (float)tile / height(), (float)origin.x / width(), (float)origin.y / height());
+    }
+    // identifies the scene a lightmap was baked for: geometry, layout and light
+    uint64_t sceneHash(const LightmapSettings &settings) const
+    {
+        uint64_t h = hashBytes(positions.data(), positions.size() * sizeof(glm::vec3));
+        h = hashBytes(normals.data(), normals.size() * sizeof(glm::vec3), h);
+        h = hashBytes(instanceModels.data(), instanceModels.size() * sizeof(glm::mat4), h);
+        h = hashBytes(uvs.data(), uvs.size() * sizeof(glm::vec2), h);
+        const float light[10] = {settings.lightDirection.x, settings.lightDirection.y, settings.lightDirection.z,
+                                 settings.lightColor.x,     settings.lightColor.y,     settings.lightColor.z,
+                                 settings.skyColor.x,       settings.skyColor.y,       settings.skyColor.z,
+                                 settings.albedo};
+        return hashBytes(light, sizeof(light), h);
+    }
+
+private:
+    static const int PADDING = 1;
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::mat4> instanceModels;
+    int tile = 0, columns = 1, rows = 1;
+
+    struct Chart
+    {
+        std::vector<int> triangles;
+        glm::vec3 axisU, axisV;
+        glm::vec2 min, max;
+        glm::ivec2 size, slot;
+    };
+
+    void unwrap(int texelsPerUnit)
+    {
+        // faces are flat, so a triangle's first vertex normal is its plane's
+        // (the winding isn't consistent enough to derive it)
+        int triangleCount = (int)positions.size() / 3;
+        std::vector<glm::vec3> faceNormals(triangleCount);
+        for (int t = 0; t < triangleCount; t++)
+            faceNormals[t] = glm::normalize(normals[t * 3]);
+        // join triangles that share an edge and a plane
+        std::vector<int> parent(triangleCount);
+        std::iota(parent.begin(), parent.end(), 0);
+        auto find = [&](int t) {
+            while (parent[t] != t)
+                t = parent[t] = parent[parent[t]];
+            return t;
+        };
+        for (int a = 0; a < triangleCount; a++)
+            for (int b = a + 1; b < triangleCount; b++)
+            {
+                if (glm::dot(faceNormals[a], faceNormals[b]) < 0.999f)
+                    continue;
+                int shared = 0;
+                for (int i = 0; i < 3; i++)
+                    for (int j = 0; j < 3; j++)
+                        shared += glm::all(glm::lessThan(glm::abs(positions[a * 3 + i] - positions[b * 3 + j]), glm::vec3(1e-5f)));
+                if (shared >= 2)
+                    parent[find(a)] = find(b);
+            }
+        std::vector<Chart> charts;
+        std::vector<int> chartOf(triangleCount, -1);
+        for (int t = 0; t < triangleCount; t++)
+        {
+            int root = find(t);
+            if (chartOf[root] < 0)
+            {
+                chartOf[root] = (int)charts.size();
+                charts.emplace_back();
+            }
+            charts[chartOf[root]].triangles.push_back(t);
+        }
+
+        // project each chart onto its plane
+        for (Chart &chart : charts)
+        {
+            glm::vec3 n = faceNormals[chart.triangles[0]];
+            glm::vec3 helper = std::fabs(n.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            chart.axisU = glm::normalize(glm::cross(helper, n));
+            chart.axisV = glm::cross(n, chart.axisU);
+            chart.min = glm::vec2(1e30f);
+            chart.max = glm::vec2(-1e30f);
+            for (int t : chart.triangles)
+                for (int i = 0; i < 3; i++)
+                {
+                    glm::vec2 p(glm::dot(positions[t * 3 + i], chart.axisU), glm::dot(positions[t * 3 + i], chart.axisV));
+                    chart.min = glm::min(chart.min, p);
+                    chart.max = glm::max(chart.max, p);
+                }
+            chart.size = glm::max(glm::ivec2(1), glm::ivec2(glm::ceil((chart.max - chart.min) * (float)texelsPerUnit)));
+        }
+
+        // shelf pack, tallest first, into the smallest square that fits
+        std::vector<int> byHeight(charts.size());
+        std::iota(byHeight.begin(), byHeight.end(), 0);
+        std::sort(byHeight.begin(), byHeight.end(), [&](int a, int b) { return charts[a].size.y > charts[b].size.y; });
+        long long area = 0;
+        for (const Chart &chart : charts)
+            area += (long long)(chart.size.x + 2 * PADDING) * (chart.size.y + 2 * PADDING);
+        for (tile = std::max(4, (int)std::ceil(std::sqrt((double)area))); ; tile += 4)
+        {
+            int x = 0, y = 0, shelfHeight = 0;
+            bool fits = true;
+            for (int c : byHeight)
+            {
+                glm::ivec2 slot = charts[c].size + 2 * PADDING;
+                if (x + slot.x > tile)
+                {
+                    x = 0;
+                    y += shelfHeight;
+                    shelfHeight = 0;
+                }
+                if (slot.x > tile || y + slot.y > tile)
+                {
+                    fits = false;
+                    break;
+                }
+                charts[c].slot = glm::ivec2(x, y);
+                x += slot.x;
+                shelfHeight = std::max(shelfHeight, slot.y);
+            }
+            if (fits)
+                break;
+        }
+
+        uvs.resize(positions.size());
+        for (const Chart &chart : charts)
+            for (int t : chart.triangles)
+                for (int i = 0; i < 3; i++)
+                {
+                    const glm::vec3 &p = positions[t * 3 + i];
+                    glm::vec2 projected(glm::dot(p, chart.axisU), glm::dot(p, chart.axisV));
+                    glm::vec2 texel = glm::vec2(chart.slot + PADDING) + (projected - chart.min) * (float)texelsPerUnit;
+                    uvs[t * 3 + i] = texel / (float)tile;
+                }
+    }
+};
+
+// CPU path tracer filling a LightmapAtlas
+// every texel a chart covers gets its world position and normal; then, on all
+// cores, each texel averages paths started from random points inside it:
+// the directional light (with a shadow ray) plus light arriving over cosine
+// weighted bounces, up to settings.bounces surfaces deep, with the sky
+// wherever a path escapes. texels round the charts are filled from their
+// neighbors so filtering at chart edges doesn't pull in black.
+// ---------------------------------------------------------------------------
+class LightmapBaker
+{
+public:
+    struct Stats
+    {
+        int texels = 0;
+        uint64_t rays = 0;
+        double seconds = 0.0;
+        int threads = 1;
+    };
+
+    // texels of the atlas, bottom row first
+    // ------------------------------------------------------------------------
+    static std::vector<glm::vec3> bake(const LightmapAtlas &atlas, const LightmapSettings &settings, ThreadPool *pool, Stats &stats)
+    {
+        auto start = std::chrono::steady_clock::now();
+        // the static scene in world space
+        StaticScene scene;
+        for (int instance = 0; instance < atlas.instanceCount(); instance++)
+            scene.add(atlas.meshPositions(), atlas.meshNormals(), atlas.model(instance));
+        scene.build();
+        const TriangleBVH &bvh = scene.bvh;
+        const std::vector<glm::vec3> &normals = scene.normals;
+
+        std::vector<Texel> texels = rasterize(atlas, scene.corners, normals);
+        int width = atlas.width(), height = atlas.height();
+        std::vector<glm::vec3> result(width * height, glm::vec3(0.0f));
+        std::vector<bool> covered(width * height, false);
+        glm::vec3 toLight = -glm::normalize(settings.lightDirection);
+        std::atomic<uint64_t> rays{0};
+        const int CHUNK = 256;
+        int chunks = ((int)texels.size() + CHUNK - 1) / CHUNK;
+        auto bakeChunk = [&](int chunk) {
+            uint64_t chunkRays = 0;
+            int end = std::min((int)texels.size(), (chunk + 1) * CHUNK);
+            for (int k = chunk * CHUNK; k < end; k++)
+            {
+                const Texel &texel = texels[k];
+                uint32_t seed = (uint32_t)texel.index * 9781u + 6271u;
+                glm::vec3 sum(0.0f);
+                for (int s = 0; s < settings.samples; s++)
+                {
+                    glm::vec3 position = texel.position + texel.dPdx * (random(seed) - 0.5f) + texel.dPdy * (random(seed) - 0.5f);
+                    glm::vec3 normal = texel.normal;
+                    glm::vec3 origin = position + normal * RAY_OFFSET;
+                    sum += direct(bvh, origin, normal, toLight, settings.lightColor, chunkRays);
+                    // indirect: follow one path off the surface
+                    glm::vec3 throughput(1.0f);
+                    for (int bounce = 0; bounce < settings.bounces; bounce++)
+                    {
+                        glm::vec3 direction = cosineSample(normal, seed);
+                        TriangleBVH::Hit hit;
+                        chunkRays++;
+                        if (!bvh.intersect(origin, direction, 1e30f, hit))
+                        {
+                            sum += throughput * settings.skyColor;
+                            break;
+                        }
+                        normal = normals[hit.triangle];
+                        // the inside of a closed mesh sees no light
+                        if (glm::dot(normal, direction) > 0.0f)
+                            break;
+                        throughput *= settings.albedo;
+                        origin = origin + direction * hit.t + normal * RAY_OFFSET;
+                        sum += throughput * direct(bvh, origin, normal, toLight, settings.lightColor, chunkRays);
+                    }
+                }
+                result[texel.index] = sum / (float)settings.samples;
+                covered[texel.index] = true;
+            }
+            rays += chunkRays;
+        };
+        if (pool)
+            pool->parallelFor(chunks, bakeChunk);
+        else
+            for (int chunk = 0; chunk < chunks; chunk++)
+                bakeChunk(chunk);
+        dilate(result, covered, width, height);
+
+        stats.texels = (int)texels.size();
+        stats.rays = rays.load();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.threads = pool ? (int)pool->size() + 1 : 1;
+        return result;
+    }
+
+private:
+    static constexpr float RAY_OFFSET = 1e-3f;
+    struct Texel
+    {
+        int index;
+        glm::vec3 position, normal;
+        // world distance covered by one texel along x and y
+        glm::vec3 dPdx, dPdy;
+    };
+
+    // xorshift, one state per texel so results don't depend on the threads
+    static float random(uint32_t &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) / 16777216.0f;
+    }
+    static glm::vec3 cosineSample(const glm::vec3 &normal, uint32_t &seed)
+    {
+        float r1 = random(seed), r2 = random(seed);
+        float radius = std::sqrt(r1), angle = 6.2831853f * r2;
+        glm::vec3 helper = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        return tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * std::sqrt(1.0f - r1);
+    }
+    // the directional light's diffuse term at a point, shadowed
+    static glm::vec3 direct(const TriangleBVH &bvh, const glm::vec3 &origin, const glm::vec3 &normal, const glm::vec3 &toLight,
+                            const glm::vec3 &color, uint64_t &rays)
+    {
+        float cosine = glm::dot(normal, toLight);
+        if (cosine <= 0.0f)
+            return glm::vec3(0.0f);
+        rays++;
+        return bvh.occluded(origin, toLight, 1e30f) ? glm::vec3(0.0f) : color * cosine;
+    }
+
+    // the texels whose centers each instance's triangles cover
+    static std::vector<Texel> rasterize(const LightmapAtlas &atlas, const std::vector<glm::vec3> &corners,
+                                        const std::vector<glm::vec3> &normals)
+    {
+        std::vector<Texel> texels;
+        std::vector<bool> claimed(atlas.width() * atlas.height(), false);
+        const std::vector<glm::vec2> &uvs = atlas.meshUVs();
+        int meshTriangles = (int)uvs.size() / 3;
+        for (int instance = 0; instance < atlas.instanceCount(); instance++)
+        {
+            glm::vec2 origin = glm::vec2(atlas.tileOrigin(instance));
+            for (int t = 0; t < meshTriangles; t++)
+            {
+                int triangle = instance * meshTriangles + t;
+                glm::vec2 a = origin + uvs[t * 3] * (float)atlas.tileSize();
+                glm::vec2 b = origin + uvs[t * 3 + 1] * (float)atlas.tileSize();
+                glm::vec2 c = origin + uvs[t * 3 + 2] * (float)atlas.tileSize();
+                float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+                if (std::fabs(area) < 1e-8f)
+                    continue;
+                const glm::vec3 *p = &corners[triangle * 3];
+                // world position is affine in texel space over the triangle
+                glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+                glm::vec2 d1 = b - a, d2 = c - a;
+                glm::vec3 dPdx = (e1 * d2.y - e2 * d1.y) / area;
+                glm::vec3 dPdy = (e2 * d1.x - e1 * d2.x) / area;
+                glm::ivec2 low = glm::max(glm::ivec2(glm::floor(glm::min(a, glm::min(b, c)))), glm::ivec2(0));
+                glm::ivec2 high = glm::min(glm::ivec2(glm::ceil(glm::max(a, glm::max(b, c)))),
+                                           glm::ivec2(atlas.width() - 1, atlas.height() - 1));
+                for (int y = low.y; y <= high.y; y++)
+                    for (int x = low.x; x <= high.x; x++)
+                    {
+                        glm::vec2 center(x + 0.5f, y + 0.5f);
+                        float w1 = ((center.x - a.x) * d2.y - (center.y - a.y) * d2.x) / area;
+                        float w2 = ((center.y - a.y) * d1.x - (center.x - a.x) * d1.y) / area;
+                        if (w1 < -1e-4f || w2 < -1e-4f || w1 + w2 > 1.0001f)
+                            continue;
+                        int index = y * atlas.width() + x;
+                        if (claimed[index])
+                            continue;
+                        claimed[index] = true;
+                        texels.push_back({index, p[0] + e1 * w1 + e2 * w2, normals[triangle], dPdx, dPdy});
+                    }
+            }
+        }
+        return texels;
+    }
+    // spread covered texels into their uncovered neighbors, a ring per pass
+    static void dilate(std::vector<glm::vec3> &texels, std::vector<bool> &covered, int width, int height)
+    {
+        for (int pass = 0; pass < 2; pass++)
+        {
+            std::vector<bool> next = covered;
+            for (int y = 0; y < height; y++)
+                for (int x = 0; x < width; x++)
+                {
+                    if (covered[y * width + x])
+                        continue;
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[ny * width + nx])
+                                continue;
+                            sum += texels[ny * width + nx];
+                            count++;
+                        }
+                    if (count == 0)
+                        continue;
+                    texels[y * width + x] = sum / (float)count;
+                    next[y * width + x] = true;
+                }
+            covered = next;
+        }
+    }
+};
+
+// lightmaps are Radiance HDR (RGBE) files; a header line records the scene
+// hash so a stale bake is never applied to a changed scene. scanlines are
+// written flat, top row first, and only flat files are read back
+// ---------------------------------------------------------------------------
+inline bool writeLightmap(const std::string &path, int width, int height, const std::vector<glm::vec3> &texels, uint64_t sceneHash)
+{
+    std::vector<unsigned char> pixels(width * height * 4);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            const glm::vec3 &c = texels[(height - 1 - y) * width + x];
+            unsigned char *rgbe = &pixels[(y * width + x) * 4];
+            float brightest = std::max(c.r, std::max(c.g, c.b));
+            if (brightest < 1e-32f)
+            {
+                rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+                continue;
+            }
+            int exponent;
+            float scale = std::frexp(brightest, &exponent) * 256.0f / brightest;
+            rgbe[0] = (unsigned char)(c.r * scale);
+            rgbe[1] = (unsigned char)(c.g * scale);
+            rgbe[2] = (unsigned char)(c.b * scale);
+            rgbe[3] = (unsigned char)(exponent + 128);
+        }
+    char header[160];
+    std::snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\nLIGHTMAP_SCENE=%016llx\n\n-Y %d +X %d\n",
+                  (unsigned long long)sceneHash, height, width);
+    // write next to the file and rename, so the app never loads half a bake
+    {
+        std::ofstream out(path + ".tmp", std::ios::binary | std::ios::trunc);
+        out.write(header, std::strlen(header));
+        out.write((const char *)pixels.data(), pixels.size());
+        if (!out)
+        {
+            std::cout << "ERROR::LIGHTMAP::WRITE_FAILED " << path << std::endl;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(path + ".tmp", path, ec);
+    return !ec;
+}
+// false if the file is missing, unreadable or baked for another scene
+inline bool readLightmap(const std::string &path, uint64_t sceneHash, int &width, int &height, std::vector<glm::vec3> &texels)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const char *data = (const char *)file.data();
+    size_t size = file.size(), at = 0;
+    uint64_t bakedHash = 0;
+    bool hashFound = false;
+    // header lines up to the blank one, then the resolution line
+    for (;;)
+    {
+        const char *end = (const char *)std::memchr(data + at, '\n', size - at);
+        if (!end)
+        {
+            std::cout << "ERROR::LIGHTMAP::BAD_HEADER " << path << std::endl;
+            return false;
+        }
+        std::string line(data + at, end);
+        at = end - data + 1;
+        unsigned long long value;
+        if (std::sscanf(line.c_str(), "LIGHTMAP_SCENE=%llx", &value) == 1)
+        {
+            bakedHash = value;
+            hashFound = true;
+        }
+        if (line.empty())
+            break;
+    }
+    const char *end = (const char *)std::memchr(data + at, '\n', size - at);
+    if (!end || std::sscanf(std::string(data + at, end).c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0)
+    {
+        std::cout << "ERROR::LIGHTMAP::BAD_HEADER " << path << std::endl;
+        return false;
+    }
+    at = end - data + 1;
+    if (!hashFound || bakedHash != sceneHash)
+    {
+        std::cout << "lightmap " << path << " was baked for a different scene, run with --bake-lightmap" << std::endl;
+        return false;
+    }
+    if (size - at != (size_t)width * height * 4)
+    {
+        std::cout << "ERROR::LIGHTMAP::UNSUPPORTED_ENCODING " << path << std::endl;
+        return false;
+    }
+    texels.resize(width * height);
+    const unsigned char *pixels = (const unsigned char *)data + at;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *rgbe = &pixels[(y * width + x) * 4];
+            float scale = rgbe[3] ? std::ldexp(1.0f, rgbe[3] - (128 + 8)) : 0.0f;
+            texels[(height - 1 - y) * width + x] = glm::vec3(rgbe[0] + 0.5f, rgbe[1] + 0.5f, rgbe[2] + 0.5f) * scale;
+        }
+    return true;
+}
+
+// the baked lightmap on the GPU, with the mesh's lightmap UVs
+// ---------------------------------------------------------------------------
+class Lightmap
+{
+public:
+    Lightmap() = default;
+    Lightmap(const Lightmap &) = delete;
+    Lightmap &operator=(const Lightmap &) = delete;
+
+    // uploads the lightmap at path if it was baked for this atlas and light
+    // ------------------------------------------------------------------------
+    bool load(const std::string &path, const LightmapAtlas &atlas, const LightmapSettings &settings)
+    {
+        int width, height;
+        std::vector<glm::vec3> texels;
+        if (!readLightmap(path, atlas.sceneHash(settings), width, height, texels))
+            return false;
+        if (width != atlas.width() || height != atlas.height())
+        {
+            std::cout << "ERROR::LIGHTMAP::SIZE_MISMATCH " << path << std::endl;
+            return false;
+        }
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, width, height, 0, GL_RGB, GL_FLOAT, texels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        std::cout << "lightmap: " << width << "x" << height << " from " << path << std::endl;
+        return true;
+    }
+    bool loaded() const
+    {
+        return texture != 0;
+    }
+    // the mesh's lightmap UVs as attribute 8 of vao (which draws that mesh)
+    void attach(unsigned int vao, const LightmapAtlas &atlas)
+    {
+        if (!uvVBO)
+            glGenBuffers(1, &uvVBO);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, uvVBO);
+        glBufferData(GL_ARRAY_BUFFER, atlas.meshUVs().size() * sizeof(glm::vec2), atlas.meshUVs().data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+        glEnableVertexAttribArray(8);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    void bind(const Shader &shader, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("lightmap", unit);
+    }
+    // delete the texture and buffer; call while the context is still current
+    void release()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &uvVBO);
+        texture = uvVBO = 0;
+    }
+
+private:
+    unsigned int texture = 0;
+    unsigned int uvVBO = 0;
+};
+
+// lightmap bake, runs without a window:
+//   ./app --bake-lightmap [-s samples] [-b bounces] [-t threads] [-o path]
+// path traces the static scene into path and prints the bake's throughput
+// ---------------------------------------------------------------------------
+inline int runLightmapBake(int argc, char **argv, const LightmapAtlas &atlas, LightmapSettings settings, std::string path)
+{
+    int threads = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            settings.samples = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            settings.bounces = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            path = argv[++i];
+    }
+    // the calling thread takes part in parallelFor, so it counts as one of the threads
+    std::unique_ptr<ThreadPool> pool;
+    if (threads != 1)
+        pool.reset(new ThreadPool(threads > 1 ? threads - 1 : 0));
+    std::cout << "baking " << atlas.width() << "x" << atlas.height() << " lightmap (" << settings.samples << " paths per texel, "
+              << settings.bounces << " bounces)" << std::endl;
+    LightmapBaker::Stats stats;
+    std::vector<glm::vec3> texels = LightmapBaker::bake(atlas, settings, pool.get(), stats);
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %d texels, %.1f M rays in %.2f s on %d threads: %.2f M rays/s", stats.texels,
+                  stats.rays / 1.0e6, stats.seconds, stats.threads, stats.rays / 1.0e6 / std::max(stats.seconds, 1e-9));
+    std::cout << line << std::endl;
+    if (!writeLightmap(path, atlas.width(), atlas.height(), texels, atlas.sceneHash(settings)))
+        return 1;
+    std::cout << "  written to " << path << std::endl;
+    return 0;
+}
+#endif
@@ -4,6 +4,8 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// later headers include stb_image.h for the declarations only
+#undef STB_IMAGE_IMPLEMENTATION
 
 #include "include/glm/ext/matrix_transform.hpp"
 #include "include/glm/glm.hpp"
@@ -11,19 +13,83 @@
 #include "include/glm/gtc/type_ptr.hpp"
 
 #include "camera.h"
+#include "decode_bench.h"
+#include "deferred_renderer.h"
+#include "depth_prepass.h"
+#include "bloom.h"
+#include "dynamic_resolution.h"
+#include "gpu_profiler.h"
+#include "headless.h"
+#include "temporal_resolve.h"
+#include "light_clusters.h"
+#include "lightmap.h"
+#include "material_packer.h"
+// nuklear's code goes here, the overlay's header sets its options
+#define NK_IMPLEMENTATION
+#include "perf_overlay.h"
+#undef NK_IMPLEMENTATION
+#include "point_shadows.h"
+#include "probe_grid.h"
+#include "profiler.h"
+#include "program_cache.h"
 #include "shader.h"
+#include "shader_sources.h"
+#include "shader_variants.h"
+#include "shadow_cascades.h"
+#include "ssao.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void processInput(GLFWwindow *window);
+bool keyPressed(GLFWwindow *window, int key);
 void mouse_callback(GLFWwindow *window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffest);
-unsigned int loadTexture(char const *path);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// gpu memory the streamed texture mips may use
+const size_t TEXTURE_BUDGET = 8 * 1024 * 1024;
+// decoded mip chains are kept here so later runs skip decoding
+const char *TEXTURE_CACHE_DIR = "texture_cache";
+// linked program binaries, so later runs skip shader compilation
+const char *PROGRAM_CACHE_DIR = "program_cache";
+// seconds between checks for edited shader sources
+const float SHADER_RELOAD_INTERVAL = 0.5f;
+// small ranged lights scattered through the scene, toggled with L
+const int CLUSTERED_LIGHT_COUNT = 4096;
+// the directional light, which casts cascaded shadows
+const glm::vec3 DIR_LIGHT_DIRECTION(-0.2f, -1.0f, -0.3f);
+// how far the point light's shadows reach
+const float POINT_SHADOW_RANGE = 25.0f;
+// background where nothing is drawn
+const glm::vec3 CLEAR_COLOR(0.1f, 0.1f, 0.1f);
+// scene brightness before tonemapping, where bloom starts, and how much of it is added
+const float EXPOSURE = 1.0f;
+const float BLOOM_THRESHOLD = 0.8f;
+const float BLOOM_STRENGTH = 0.5f;
+// GPU time per frame the scene resolution is scaled to meet, and how far it may drop
+const float FRAME_TIME_TARGET_MS = 14.0f;
+const float MIN_RESOLUTION_SCALE = 0.5f;
+// the directional light's ambient and diffuse, also what the lightmap bakes
+const glm::vec3 DIR_LIGHT_AMBIENT(0.05f, 0.05f, 0.05f);
+const glm::vec3 DIR_LIGHT_DIFFUSE(0.4f, 0.4f, 0.4f);
+// baked lighting of the static cubes, written by --bake-lightmap
+const char *LIGHTMAP_PATH = "lightmap.hdr";
+// irradiance probes over the scene's bounds, used when there's no lightmap,
+// and the worker time per frame they may take to re-bake
+const glm::vec3 PROBE_GRID_MIN(-5.0f, -4.0f, -17.0f);
+const glm::vec3 PROBE_GRID_MAX(4.0f, 6.0f, 3.0f);
+const glm::ivec3 PROBE_GRID_DIMS(8, 8, 16);
+const float PROBE_BAKE_BUDGET_MS = 1.0f;
+// Chrome trace of the CPU scopes, written on exit and when C is pressed
+const char *PROFILE_TRACE_PATH = "profile.json";
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -39,53 +105,10 @@ float lastFrame = 0.0f;
 // light pos
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+int main(int argc, char **argv)
 {
-    // camera.setFPSCam();
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow *window =
-        glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    // capture mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
-    }
-    glEnable(GL_DEPTH_TEST);
-    // build and compile our shader program
-    // ------------------------------------
-    Shader lightingShader(
-        "../shaders/vertShader.vs",
-        "../shaders/fragShader.fs"); // you can name your shader files however you like
-    Shader lightCubeShader("../shaders/vertShader.vs", "../shaders/light_cube.fs");
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
+    // the static scene: one cube mesh drawn at fixed places
+    // ------------------------------------------------------
     float vertices[] = {
         // positions          // normals           // texture coords
         -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,
@@ -135,7 +158,175 @@ int main()
         glm::vec3(2.4f, -0.4f, -3.5f), glm::vec3(-1.7f, 3.0f, -7.5f),
         glm::vec3(1.3f, -2.0f, -2.5f), glm::vec3(1.5f, 2.0f, -2.5f),
         glm::vec3(1.5f, 0.2f, -1.5f), glm::vec3(-1.3f, 1.0f, -1.5f)};
+    std::vector<glm::mat4> cubeModels;
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, cubePositions[i]);
+        float angle = 20.0f * i;
+        model = glm::rotate(model, glm::radians(angle),
+                            glm::vec3(1.0f, 0.3f, 0.5f));
+        cubeModels.push_back(model);
+    }
+    // every cube gets its own tile of the lightmap
+    LightmapSettings lightmapSettings;
+    lightmapSettings.lightDirection = DIR_LIGHT_DIRECTION;
+    lightmapSettings.lightColor = DIR_LIGHT_DIFFUSE;
+    lightmapSettings.skyColor = DIR_LIGHT_AMBIENT;
+    LightmapAtlas lightmapAtlas;
+    lightmapAtlas.build(vertices, 8, 36, cubeModels, lightmapSettings.texelsPerUnit);
+
+    // image decode benchmark, runs without a window
+    if (argc > 1 && std::string(argv[1]) == "--bench-decode")
+        return runDecodeBenchmark(argc - 2, argv + 2);
+    // clustered light binning benchmark, also without a window
+    if (argc > 1 && std::string(argv[1]) == "--bench-lights")
+        return runLightBenchmark(argc - 2, argv + 2);
+    // PROFILE_SCOPE cost, also without a window
+    if (argc > 1 && std::string(argv[1]) == "--bench-profiler")
+        return runProfilerBenchmark(argc - 2, argv + 2);
+    // lightmap bake, on all cores and without a window
+    if (argc > 1 && std::string(argv[1]) == "--bake-lightmap")
+        return runLightmapBake(argc - 2, argv + 2, lightmapAtlas, lightmapSettings, LIGHTMAP_PATH);
+
+    PROFILE_THREAD("main");
+    // the fixed camera path without a window renders through the render
+    // loop, on a surfaceless context instead of glfw's
+    HeadlessBenchmark headless(argc, argv);
+    if (headless.rejected())
+        return -1;
+    // forward vs deferred timing needs the window, so it runs in the render loop
+    ShadingBenchmark shadingBenchmark(argc, argv);
+    // and so does temporal anti-aliasing vs MSAA
+    AntialiasingBenchmark antialiasingBenchmark(argc, argv);
+    HeadlessContext headlessContext;
+    GLFWwindow *window = NULL;
+    GLADloadproc loadProc = (GLADloadproc)glfwGetProcAddress;
+
+    if (headless.running())
+    {
+        if (!headlessContext.create(3, 3))
+            return -1;
+        loadProc = (GLADloadproc)HeadlessContext::getProcAddress;
+    }
+    else
+    {
+        // camera.setFPSCam();
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        // capture mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader(loadProc))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    glEnable(GL_DEPTH_TEST);
+    // build and compile our shader program
+    // ------------------------------------
+    // both programs are only submitted here; they compile while the textures
+    // start loading and the render loop picks them up once they're linked
+    auto shaderStart = std::chrono::steady_clock::now();
+    Shader::enableParallelCompile(loadProc);
+    ProgramCache programCache(PROGRAM_CACHE_DIR);
+    // with a current bake the first directional light's diffuse light comes
+    // from the lightmap instead of being evaluated per fragment
+    Lightmap lightmap;
+    bool lightmapOn = lightmap.load(LIGHTMAP_PATH, lightmapAtlas, lightmapSettings);
+    // without one, the probe grid brings in the bounced light instead of the
+    // lights' constant ambient terms
+    bool probesOn = !lightmapOn;
+    // the lighting shader is compiled per light count and feature set
+    ShaderVariants lightingVariants(
+        "../shaders/materialVertShader.vs",
+        "../shaders/fragShader.fs", &programCache); // you can name your shader files however you like
+    int emmisionFeature = lightingVariants.addFeature("HAS_EMMISION");
+    int dirLightCount = lightingVariants.addCount("NR_DIR_LIGHTS");
+    int pointLightCount = lightingVariants.addCount("NR_POINT_LIGHTS");
+    ShaderVariants::Key sceneVariant = ShaderVariants::set(0, emmisionFeature);
+    sceneVariant = ShaderVariants::setCount(sceneVariant, dirLightCount, 1);
+    sceneVariant = ShaderVariants::setCount(sceneVariant, pointLightCount, 1);
+    int clusteredFeature = lightingVariants.addFeature("CLUSTERED_LIGHTS");
+    int dirShadowFeature = lightingVariants.addFeature("DIR_SHADOWS");
+    sceneVariant = ShaderVariants::set(sceneVariant, dirShadowFeature);
+    int pointShadowFeature = lightingVariants.addFeature("POINT_SHADOWS");
+    sceneVariant = ShaderVariants::set(sceneVariant, pointShadowFeature);
+    int lightmapFeature = lightingVariants.addFeature("LIGHTMAP");
+    sceneVariant = ShaderVariants::set(sceneVariant, lightmapFeature, lightmapOn);
+    int probeFeature = lightingVariants.addFeature("PROBE_GRID");
+    sceneVariant = ShaderVariants::set(sceneVariant, probeFeature, probesOn);
+    // K turns ambient occlusion off by binding a white texture, so it needs no variant
+    int ssaoFeature = lightingVariants.addFeature("SSAO");
+    sceneVariant = ShaderVariants::set(sceneVariant, ssaoFeature);
+    lightingVariants.prewarm(sceneVariant);
+    lightingVariants.prewarm(ShaderVariants::set(sceneVariant, clusteredFeature));
+    Shader lightCubeShader("../shaders/vertShader.vs", "../shaders/light_cube.fs", &programCache, false);
+    // deferred path: G-buffer fill, fullscreen lights and light volumes
+    Shader gbufferShader("../shaders/materialVertShader.vs", "../shaders/gbuffer.fs", &programCache, false,
+                         std::string("#define HAS_EMMISION\n") + (lightmapOn ? "#define LIGHTMAP\n" : ""));
+    Shader deferredLightShader("../shaders/fullscreen.vs", "../shaders/deferred_lights.fs", &programCache, false,
+                               std::string("#define DIR_SHADOWS\n#define POINT_SHADOWS\n#define SSAO\n") +
+                                   (lightmapOn ? "#define LIGHTMAP\n" : "#define PROBE_GRID\n"));
+    Shader lightVolumeShader("../shaders/light_volume.vs", "../shaders/light_volume.fs", &programCache, false);
+    Shader shadowDepthShader("../shaders/shadow_depth.vs", "../shaders/shadow_depth.fs", &programCache, false);
+    Shader pointShadowDepthShader("../shaders/point_shadow_depth.vs", "../shaders/shadow_depth.fs", &programCache, false, "",
+                                  "../shaders/point_shadow_depth.gs");
+    // depth pre-pass and the overdraw view
+    Shader depthPrepassShader("../shaders/depth_prepass.vs", "../shaders/shadow_depth.fs", &programCache, false);
+    Shader overdrawShader("../shaders/materialVertShader.vs", "../shaders/overdraw.fs", &programCache, false);
+    // bloom chain and the final tonemap
+    Shader bloomDownShader("../shaders/fullscreen.vs", "../shaders/bloom_down.fs", &programCache, false);
+    Shader bloomUpShader("../shaders/fullscreen.vs", "../shaders/bloom_up.fs", &programCache, false);
+    Shader tonemapShader("../shaders/fullscreen.vs", "../shaders/tonemap.fs", &programCache, false);
+    Shader temporalResolveShader("../shaders/fullscreen.vs", "../shaders/temporal_resolve.fs", &programCache, false);
+    // half resolution ambient occlusion: depth, occlusion, blur and upsample
+    Shader ssaoDepthShader("../shaders/fullscreen.vs", "../shaders/ssao_depth.fs", &programCache, false);
+    Shader ssaoShader("../shaders/fullscreen.vs", "../shaders/ssao.fs", &programCache, false);
+    Shader ssaoBlurShader("../shaders/fullscreen.vs", "../shaders/ssao_blur.fs", &programCache, false);
+    Shader ssaoUpsampleShader("../shaders/fullscreen.vs", "../shaders/ssao_upsample.fs", &programCache, false);
+    // the performance overlay
+    Shader overlayShader("../shaders/overlay.vs", "../shaders/overlay.fs", &programCache, false);
+    Shader *reloadableShaders[] = {&lightCubeShader, &gbufferShader, &deferredLightShader, &lightVolumeShader, &shadowDepthShader,
+                                   &pointShadowDepthShader, &depthPrepassShader, &overdrawShader, &bloomDownShader,
+                                   &bloomUpShader, &tonemapShader, &temporalResolveShader, &ssaoDepthShader, &ssaoShader,
+                                   &ssaoBlurShader, &ssaoUpsampleShader, &overlayShader};
+    ShaderBatch shaders;
+    for (Shader *shader : reloadableShaders)
+        shaders.add(*shader);
+    bool shadersReady = false;
+    unsigned int lightingUniformsProgram = 0;
+    unsigned int gbufferUniformsProgram = 0;
+    float lastSourceCheck = 0.0f;
+    // set up vertex data (and buffer(s)) and configure vertex attributes
+    // ------------------------------------------------------------------
     glm::vec3 pointLightPosition(0.7f, 0.2f, 2.0f);
+    ProbePointLight pointLight = {pointLightPosition, glm::vec3(0.8f), 1.0f, 0.09f, 0.032f};
     // no indicies so no use for EBO
     unsigned int VBO, VAO;
     glGenVertexArrays(1, &VAO);
@@ -154,6 +345,10 @@ int main()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
+    // per-instance model matrix, material index and lightmap tile
+    MaterialInstances cubeInstances(VAO);
+    // and the lightmap UVs of the mesh
+    lightmap.attach(VAO, lightmapAtlas);
     // glVertexAttribPointer(locationNumber, how_many_values, normalised_bool,
     // how_many_in_each_stride, (void*)how_many_into_stride);
 
@@ -177,83 +372,549 @@ int main()
     glEnableVertexAttribArray(0);
 
     // textures would go here
-    unsigned int diffuseMap = loadTexture("../assets/steelbox.png");
-    unsigned int specularMap = loadTexture("../assets/steelbox_specular.png");
-    unsigned int emmisionMap = loadTexture("../assets/demon_emmision.png");
-
-    lightingShader.use();
-    lightingShader.setInt("material.diffuse", 0);
-    lightingShader.setInt("material.specular", 1);
-    lightingShader.setInt("material.emmision", 2);
+    // workers read the cache, so it has to outlive the pool
+    auto textureStart = std::chrono::steady_clock::now();
+    TextureCache textureCache(TEXTURE_CACHE_DIR);
+    // large JPEGs with restart markers decode their intervals on the worker pool
+    ThreadPool workers;
+    stbi_set_jpeg_parallel_for(threadPoolParallelFor, &workers, (int)(workers.size() + 1) * 4);
+    // mips stream in as the camera gets close enough to need them
+    TextureStreamer textureStreamer(workers, TEXTURE_BUDGET, &textureCache);
+    // maps of the same size share texture arrays, so both materials draw together
+    MaterialPacker materials;
+    int demonMaterial = materials.addMaterial({"../assets/steelbox.png", "../assets/steelbox_specular.png", "../assets/demon_emmision.png"});
+    int steelMaterial = materials.addMaterial({"../assets/steelbox.png", "../assets/steelbox_specular.png", ""});
+    materials.build(textureStreamer);
+    bool statsKeyDown = false;
+    // probes bake in the background on the same workers
+    ProbeGrid probeGrid(workers, PROBE_GRID_MIN, PROBE_GRID_MAX, PROBE_GRID_DIMS);
+    if (probesOn)
+    {
+        auto staticScene = std::make_shared<StaticScene>();
+        for (const glm::mat4 &model : cubeModels)
+            staticScene->add(lightmapAtlas.meshPositions(), lightmapAtlas.meshNormals(), model);
+        staticScene->build();
+        probeGrid.setScene(staticScene);
+    }
+    // lights binned into a froxel grid every frame, so the shader only loops
+    // over the few that reach each fragment
+    LightClusters lightClusters;
+    std::vector<ClusteredLight> clusteredLightBase = randomClusteredLights(
+        CLUSTERED_LIGHT_COUNT, 1u, glm::vec3(-6.0f, -4.0f, -14.0f), glm::vec3(6.0f, 4.0f, 2.0f), 0.3f, 1.0f);
+    std::vector<ClusteredLight> clusteredLights = clusteredLightBase;
+    bool clusteredLightsOn = false;
+    bool clusterKeyDown = false;
+    // the scene renders offscreen and is tonemapped to the window; G switches
+    // between forward and deferred shading
+    DeferredRenderer sceneRenderer;
+    bool deferredOn = false;
+    bool deferredKeyDown = false;
+    bool texturesSettled = false;
+    // the cubes shadow each other from the directional light
+    ShadowCascades shadowCascades(VBO, 8 * sizeof(float), 36);
+    std::vector<ShadowCaster> shadowCasters;
+    // and from the point light, redrawn only when something in range moves
+    PointShadows pointShadows(VBO, 8 * sizeof(float), 36);
+    std::vector<PointShadowLight> shadowedPointLights = {{pointLightPosition, POINT_SHADOW_RANGE}};
+    // P lays down depth before the color pass, O shows how often each pixel
+    // is shaded; T prints the shaded fragment count either way
+    DepthPrepass depthPrepass(VBO, 8 * sizeof(float), 36);
+    OverdrawCounter overdrawCounter;
+    bool depthPrepassOn = false;
+    bool prepassKeyDown = false;
+    bool overdrawViewOn = false;
+    bool overdrawKeyDown = false;
+    // B toggles bloom; T prints the cost of each bloom and tonemap pass
+    BloomChain bloom;
+    bool bloomOn = true;
+    bool bloomKeyDown = false;
+    // the scene renders at a scale of the window picked from GPU frame times
+    // and is upscaled by the tonemap pass; R turns the scaling off and on
+    DynamicResolution dynamicResolution(FRAME_TIME_TARGET_MS, MIN_RESOLUTION_SCALE, 1.0f);
+    bool resolutionKeyDown = false;
+    // jittered frames accumulated at the window's resolution, J toggles
+    TemporalResolve temporalResolve;
+    bool temporalOn = true;
+    bool temporalKeyDown = false;
+    // ambient occlusion from the depth buffer; K steps through its presets and off
+    ScreenSpaceAO ssao;
+    bool ssaoOn = true;
+    bool ssaoKeyDown = false;
+    bool traceKeyDown = false;
+    // GPU time per pass, read back a few frames late; T prints it and the
+    // passes go into the trace too
+    GpuProfiler gpuProfiler;
+    // H hides and shows the performance overlay
+    PerfOverlay overlay;
+    bool overlayOn = true;
+    bool overlayKeyDown = false;
+    // headless frames must come out the same on every run: no resolution
+    // picked from frame times, and no overlay showing them
+    if (headless.running())
+    {
+        dynamicResolution.setEnabled(false);
+        overlayOn = false;
+    }
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    while (window ? !glfwWindowShouldClose(window) : headless.running())
     {
-        // delta time
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
+        PROFILE_SCOPE("frame");
+        // delta time; headless runs step a fixed time per frame
+        float currentFrame = window ? (float)glfwGetTime() : headless.time();
+        deltaTime = window ? currentFrame - lastFrame : headless.frameStep();
         lastFrame = currentFrame;
         // input
         // -----
-        processInput(window);
+        if (window)
+            processInput(window);
+        else
+            headless.placeCamera(camera);
+        // T prints texture residency
+        bool statsKey = keyPressed(window, GLFW_KEY_T);
+        if (statsKey && !statsKeyDown)
+        {
+            textureStreamer.printStats();
+            shadowCascades.printStats();
+            pointShadows.printStats();
+            overdrawCounter.printStats(depthPrepassOn ? "depth pre-pass" : "no pre-pass");
+            bloom.printStats();
+            dynamicResolution.printStats();
+            if (probesOn)
+                probeGrid.printStats();
+            if (temporalOn)
+                temporalResolve.printStats();
+            if (ssaoOn)
+                ssao.printStats();
+            gpuProfiler.printStats();
+            if (overlayOn)
+                overlay.printStats();
+            // deferred shading draws volumes instead of binning
+            if (clusteredLightsOn && !deferredOn)
+            {
+                const LightClusters::Stats &s = lightClusters.lastStats();
+                std::cout << "clustered lights: " << s.lights << " lights, " << (double)s.indices / LightClusters::CLUSTER_COUNT
+                          << " per cluster on average, " << s.maxPerCluster << " max, binned in " << s.binMs << " ms"
+                          << (s.overflowed ? " (index buffer full)" : "") << std::endl;
+            }
+        }
+        statsKeyDown = statsKey;
+        // L toggles the clustered lights
+        bool clusterKey = keyPressed(window, GLFW_KEY_L);
+        if (clusterKey && !clusterKeyDown)
+            clusteredLightsOn = !clusteredLightsOn;
+        clusterKeyDown = clusterKey;
+        // G toggles deferred shading
+        bool deferredKey = keyPressed(window, GLFW_KEY_G);
+        if (deferredKey && !deferredKeyDown)
+        {
+            deferredOn = !deferredOn;
+            std::cout << (deferredOn ? "deferred" : "forward") << " shading" << std::endl;
+        }
+        deferredKeyDown = deferredKey;
+        // P toggles the depth pre-pass, O the overdraw view
+        bool prepassKey = keyPressed(window, GLFW_KEY_P);
+        if (prepassKey && !prepassKeyDown)
+        {
+            depthPrepassOn = !depthPrepassOn;
+            std::cout << "depth pre-pass " << (depthPrepassOn ? "on" : "off") << std::endl;
+        }
+        prepassKeyDown = prepassKey;
+        bool overdrawKey = keyPressed(window, GLFW_KEY_O);
+        if (overdrawKey && !overdrawKeyDown)
+            overdrawViewOn = !overdrawViewOn;
+        overdrawKeyDown = overdrawKey;
+        bool bloomKey = keyPressed(window, GLFW_KEY_B);
+        if (bloomKey && !bloomKeyDown)
+        {
+            bloomOn = !bloomOn;
+            std::cout << "bloom " << (bloomOn ? "on" : "off") << std::endl;
+        }
+        bloomKeyDown = bloomKey;
+        bool resolutionKey = keyPressed(window, GLFW_KEY_R);
+        if (resolutionKey && !resolutionKeyDown)
+        {
+            dynamicResolution.setEnabled(!dynamicResolution.isEnabled());
+            std::cout << "dynamic resolution " << (dynamicResolution.isEnabled() ? "on" : "off") << std::endl;
+        }
+        resolutionKeyDown = resolutionKey;
+        bool temporalKey = keyPressed(window, GLFW_KEY_J);
+        if (temporalKey && !temporalKeyDown)
+        {
+            temporalOn = !temporalOn;
+            temporalResolve.reset();
+            std::cout << "temporal anti-aliasing " << (temporalOn ? "on" : "off") << std::endl;
+        }
+        temporalKeyDown = temporalKey;
+        bool ssaoKey = keyPressed(window, GLFW_KEY_K);
+        if (ssaoKey && !ssaoKeyDown)
+        {
+            // off, then each preset from the cheapest up
+            if (!ssaoOn)
+            {
+                ssaoOn = true;
+                ssao.setPreset(0);
+            }
+            else if (ssao.presetIndex() + 1 < ScreenSpaceAO::PRESET_COUNT)
+                ssao.setPreset(ssao.presetIndex() + 1);
+            else
+                ssaoOn = false;
+            std::cout << "ambient occlusion " << (ssaoOn ? ssao.currentPreset().name : "off") << std::endl;
+        }
+        ssaoKeyDown = ssaoKey;
+        // C writes the profile recorded so far
+        bool traceKey = keyPressed(window, GLFW_KEY_C);
+        if (traceKey && !traceKeyDown)
+            writeProfileTrace(PROFILE_TRACE_PATH);
+        traceKeyDown = traceKey;
+        bool overlayKey = keyPressed(window, GLFW_KEY_H);
+        if (overlayKey && !overlayKeyDown)
+            overlayOn = !overlayOn;
+        overlayKeyDown = overlayKey;
+
+        // what to draw at what size: the scaled window, or the benchmark's next configuration
+        int framebufferWidth, framebufferHeight;
+        if (window)
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        else
+        {
+            framebufferWidth = headless.width();
+            framebufferHeight = headless.height();
+        }
+        int renderWidth, renderHeight;
+        dynamicResolution.sceneSize(framebufferWidth, framebufferHeight, renderWidth, renderHeight);
+        // the overdraw view replaces the forward lighting shader
+        bool deferredFrame = deferredOn && !overdrawViewOn;
+        size_t lightCount = clusteredLightsOn ? clusteredLightBase.size() : 0;
+        bool temporalFrame = temporalOn;
+        int sceneSamples = 1;
+        bool benchmarkFrame = (shadingBenchmark.running() || antialiasingBenchmark.running()) && texturesSettled;
+        bool shadingBenchmarkFrame = benchmarkFrame && shadingBenchmark.running();
+        if (shadingBenchmarkFrame)
+        {
+            const ShadingBenchmark::Config &config = shadingBenchmark.config();
+            renderWidth = config.width;
+            renderHeight = config.height;
+            deferredFrame = config.deferred;
+            lightCount = std::min<size_t>(config.lights, clusteredLightBase.size());
+            temporalFrame = false;
+        }
+        else if (benchmarkFrame)
+        {
+            // multisampling only works on the forward path
+            const AntialiasingBenchmark::Config &config = antialiasingBenchmark.config();
+            renderWidth = std::max(1, (int)(framebufferWidth * config.scale + 0.5f));
+            renderHeight = std::max(1, (int)(framebufferHeight * config.scale + 0.5f));
+            deferredFrame = false;
+            temporalFrame = config.temporal;
+            sceneSamples = config.samples;
+        }
+
+        // texture streaming: every cube asks for its material's maps, at the
+        // detail of the scene's pixels, or the window's when the temporal
+        // resolve brings the scene up to it
+        textureStreamer.beginFrame(camera, temporalFrame ? framebufferHeight : renderHeight);
+        for (unsigned int i = 0; i < 10; i++)
+            materials.request(textureStreamer, i % 2 ? steelMaterial : demonMaterial, cubePositions[i], 0.87f);
+        // headless frames start once nothing is left loading, then wait for
+        // what the camera's move asks for before the fade steps, so every
+        // image is the same on every run
+        bool headlessFrame = headless.running() && shadersReady && texturesSettled && (!probesOn || probeGrid.settled());
+        if (headlessFrame)
+        {
+            textureStreamer.update(0.0f);
+            while (!textureStreamer.settled())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                textureStreamer.update(0.0f);
+            }
+            if (headless.firstFrame())
+                temporalResolve.reset();
+            headless.beginFrame();
+        }
+        textureStreamer.update(deltaTime);
+        // time to the first frame with every texture at its wanted detail; a
+        // warm cache should make this mostly upload time
+        if (!texturesSettled && textureStreamer.settled())
+        {
+            texturesSettled = true;
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - textureStart;
+            std::cout << "textures ready in " << elapsed.count() << " ms (cache: " << textureCache.hitCount()
+                      << " hits, " << textureCache.missCount() << " misses)" << std::endl;
+        }
 
         // render
         // ------
-        glClearColor(0.1f, 0.10f, 0.10f, 1.0f);
+        glBindFramebuffer(GL_FRAMEBUFFER, headless.framebuffer());
+        glClearColor(CLEAR_COLOR.r, CLEAR_COLOR.g, CLEAR_COLOR.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // be sure to activate shader when setting uniforms/drawing objects
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        // light properties
-        // directional light
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        // point light 1
-        lightingShader.setVec3("pointLight.position", pointLightPosition);
-        lightingShader.setVec3("pointLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("pointLight.diffuse", 0.8f, 0.8f, 0.8f);
-        lightingShader.setVec3("pointLight.specular", 1.0f, 1.0f, 1.0f);
-        lightingShader.setFloat("pointLight.constant", 1.0f);
-        lightingShader.setFloat("pointLight.linear", 0.09f);
-        lightingShader.setFloat("pointLight.quadratic", 0.032f);
-        // material properties
-        lightingShader.setFloat("material.shininess", 64.0f);
+        // nothing to draw with until the programs have linked
+        if (!shadersReady)
+        {
+            bool variantsReady = lightingVariants.poll();
+            shadersReady = shaders.poll() && variantsReady;
+            if (!shadersReady)
+            {
+                if (window)
+                {
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                }
+                continue;
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - shaderStart;
+            std::cout << "shaders ready in " << elapsed.count() << " ms";
+            if (programCache.supported())
+                std::cout << " (cache: " << programCache.hitCount() << " hits, " << programCache.missCount() << " misses, "
+                          << programCache.rejectedCount() << " rejected)";
+            std::cout << std::endl;
+        }
+        // rebuild the programs whose sources were edited
+        if (currentFrame - lastSourceCheck > SHADER_RELOAD_INTERVAL)
+        {
+            lastSourceCheck = currentFrame;
+            std::vector<std::string> changed = ShaderSources::shared().poll();
+            if (lightingVariants.reloadChanged(changed) > 0)
+                lightingUniformsProgram = 0;
+            for (Shader *shader : reloadableShaders)
+                if (shader->dependsOn(changed) && shader->reload() && shader == &gbufferShader)
+                    gbufferUniformsProgram = 0;
+        }
+
+        gpuProfiler.beginFrame();
+        gpuProfiler.begin("frame");
+
+        // the targets fit the largest scene the window can ask for (or a
+        // larger benchmark size) and are only reallocated when that changes;
+        // each frame draws into the corner its own size covers
+        int targetWidth, targetHeight;
+        dynamicResolution.maxSceneSize(framebufferWidth, framebufferHeight, targetWidth, targetHeight);
+        targetWidth = std::max(targetWidth, renderWidth);
+        targetHeight = std::max(targetHeight, renderHeight);
+        sceneRenderer.resize(targetWidth, targetHeight);
+        sceneRenderer.setViewport(renderWidth, renderHeight);
+        sceneRenderer.setSamples(sceneSamples);
+        temporalResolve.resize(framebufferWidth, framebufferHeight);
+        bloom.resize(targetWidth, targetHeight);
+        bloom.setViewport(renderWidth, renderHeight);
+        ssao.resize(targetWidth, targetHeight);
+        ssao.setViewport(renderWidth, renderHeight);
+        // the occlusion reads a single sampled depth buffer, which the forward
+        // path only has ahead of shading with the pre-pass
+        bool ssaoFrame = ssaoOn && sceneSamples == 1 && !overdrawViewOn;
+        bool prepassFrame = depthPrepassOn || (ssaoFrame && !deferredFrame);
+        // benchmark frames have their own sizes and would skew the controller
+        if (!benchmarkFrame)
+            dynamicResolution.beginFrame();
 
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        float aspect = (float)renderWidth / (float)renderHeight;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+        // the temporal resolve wants each frame to sample a different point of every pixel
+        glm::mat4 unjitteredProjection = projection;
+        if (temporalFrame)
+            projection = temporalResolve.jitter(projection, renderWidth, renderHeight);
         glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
+        float materialLodBias = temporalFrame ? std::log2((float)renderWidth / (float)framebufferWidth) : 0.0f;
+        // bob the lights so the bins really change every frame
+        clusteredLights.resize(lightCount);
+        for (size_t i = 0; i < lightCount; i++)
+        {
+            clusteredLights[i] = clusteredLightBase[i];
+            clusteredLights[i].position.y += 0.3f * std::sin(currentFrame + (float)i);
+        }
+
+        // sets the directional and point light uniforms on the forward and
+        // the deferred fullscreen shaders alike
+        auto setSceneLights = [&](const Shader &shader)
+        {
+            shader.setVec3("viewPos", camera.Position);
+            // directional light
+            shader.setVec3("dirLights[0].direction", DIR_LIGHT_DIRECTION);
+            shader.setVec3("dirLights[0].ambient", DIR_LIGHT_AMBIENT);
+            shader.setVec3("dirLights[0].diffuse", DIR_LIGHT_DIFFUSE);
+            shader.setVec3("dirLights[0].specular", 0.5f, 0.5f, 0.5f);
+            // point light 1
+            shader.setVec3("pointLights[0].position", pointLight.position);
+            shader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
+            shader.setVec3("pointLights[0].diffuse", pointLight.color);
+            shader.setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
+            shader.setFloat("pointLights[0].constant", pointLight.constant);
+            shader.setFloat("pointLights[0].linear", pointLight.linear);
+            shader.setFloat("pointLights[0].quadratic", pointLight.quadratic);
+        };
+
+        // the cubes, as drawn and as shadow casters
+        cubeInstances.clear();
+        shadowCasters.clear();
+        for (unsigned int i = 0; i < 10; i++)
+        {
+            cubeInstances.add(cubeModels[i], i % 2 ? steelMaterial : demonMaterial, lightmapAtlas.scaleOffset(i));
+            shadowCasters.push_back({cubeModels[i], cubePositions[i], 0.87f, true});
+        }
+        // re-bakes only what the lights changed, a budget's worth per frame
+        if (probesOn)
+        {
+            ProbeLighting probeLighting;
+            probeLighting.dirDirection = DIR_LIGHT_DIRECTION;
+            probeLighting.dirColor = DIR_LIGHT_DIFFUSE;
+            probeLighting.skyColor = DIR_LIGHT_AMBIENT;
+            probeLighting.pointLights = {pointLight};
+            probeGrid.setLighting(probeLighting);
+            probeGrid.update(PROBE_BAKE_BUDGET_MS);
+        }
+        gpuProfiler.begin("shadows");
+        shadowCascades.update(shadowDepthShader, view, glm::radians(camera.Zoom), aspect, 0.1f, DIR_LIGHT_DIRECTION, shadowCasters);
+        pointShadows.update(pointShadowDepthShader, camera.Position, shadowedPointLights, shadowCasters);
+        gpuProfiler.end();
+
+        gpuProfiler.begin("scene");
+        if (deferredFrame)
+        {
+            // geometry pass: material maps and normals into the G-buffer
+            sceneRenderer.beginGeometry(CLEAR_COLOR);
+            overdrawCounter.beginPass(renderWidth * renderHeight);
+            if (prepassFrame)
+            {
+                PROFILE_SCOPE("depth prepass");
+                depthPrepass.draw(depthPrepassShader, projection, view, cubeModels);
+            }
+            PROFILE_SCOPE("uniform setup");
+            gbufferShader.use();
+            if (gbufferUniformsProgram != gbufferShader.ID)
+            {
+                gbufferUniformsProgram = gbufferShader.ID;
+                gbufferShader.setInt("material.diffuse", 0);
+                gbufferShader.setInt("material.specular", 1);
+                gbufferShader.setInt("material.emmision", 2);
+                materials.setLayers(gbufferShader);
+            }
+            if (lightmapOn)
+                lightmap.bind(gbufferShader, 8);
+            gbufferShader.setFloat("material.shininess", 64.0f);
+            gbufferShader.setFloat("materialLodBias", materialLodBias);
+            gbufferShader.setMat4("projection", projection);
+            gbufferShader.setMat4("view", view);
+        }
+        else
+        {
+            sceneRenderer.beginForward(CLEAR_COLOR);
+            overdrawCounter.beginPass(renderWidth * renderHeight);
+            if (prepassFrame)
+            {
+                PROFILE_SCOPE("depth prepass");
+                depthPrepass.draw(depthPrepassShader, projection, view, cubeModels);
+            }
+            if (ssaoFrame)
+            {
+                gpuProfiler.begin("ssao");
+                ssao.compute(ssaoDepthShader, ssaoShader, ssaoBlurShader, ssaoUpsampleShader, sceneRenderer.depthTexture(),
+                             projection);
+                gpuProfiler.end();
+                sceneRenderer.resumeForward();
+            }
+        }
+        if (overdrawViewOn)
+        {
+            // add up every fragment that would have been lit
+            overdrawShader.use();
+            overdrawShader.setMat4("projection", projection);
+            overdrawShader.setMat4("view", view);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        else if (!deferredFrame)
+        {
+            // be sure to activate shader when setting uniforms/drawing objects
+            Shader &lightingShader = lightingVariants.get(ShaderVariants::set(sceneVariant, clusteredFeature, lightCount > 0));
+            {
+                PROFILE_SCOPE("uniform setup");
+                lightingShader.use();
+                // samplers and material layers only change with the program
+                if (lightingUniformsProgram != lightingShader.ID)
+                {
+                    lightingUniformsProgram = lightingShader.ID;
+                    lightingShader.setInt("material.diffuse", 0);
+                    lightingShader.setInt("material.specular", 1);
+                    lightingShader.setInt("material.emmision", 2);
+                    materials.setLayers(lightingShader);
+                }
+                setSceneLights(lightingShader);
+                shadowCascades.bind(lightingShader, 6);
+                pointShadows.bind(lightingShader, 7, (int)shadowedPointLights.size());
+                if (lightmapOn)
+                    lightmap.bind(lightingShader, 8);
+                if (probesOn)
+                    probeGrid.bind(lightingShader, 9);
+                ssao.bind(lightingShader, 10, ssaoFrame);
+                // material properties
+                lightingShader.setFloat("material.shininess", 64.0f);
+                lightingShader.setFloat("materialLodBias", materialLodBias);
+                lightingShader.setMat4("projection", projection);
+                lightingShader.setMat4("view", view);
+            }
+            if (lightCount > 0)
+            {
+                {
+                    PROFILE_SCOPE("light binning");
+                    lightClusters.setProjection(glm::radians(camera.Zoom), aspect, 0.1f, 100.0f);
+                    lightClusters.build(view, clusteredLights, &workers);
+                }
+                PROFILE_SCOPE("light upload");
+                lightClusters.upload(clusteredLights);
+                lightClusters.bind(lightingShader, 3, renderWidth, renderHeight);
+            }
+        }
 
         // world transformation
         glm::mat4 model = glm::mat4(1.0f);
-        lightingShader.setMat4("model", model);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, emmisionMap);
-
-        // render the cube
-        glBindVertexArray(VAO);
-        for (unsigned int i = 0; i < 10; i++)
+
+        // render the cubes, one instanced draw per set of texture arrays
+        overdrawCounter.beginShading();
+        cubeInstances.draw(materials, textureStreamer, 36);
+        overdrawCounter.endShading();
+        if (prepassFrame)
+            depthPrepass.finish();
+        if (overdrawViewOn)
+            glDisable(GL_BLEND);
+
+        if (deferredFrame)
         {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle),
-                                glm::vec3(1.0f, 0.3f, 0.5f));
-            lightingShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            if (ssaoFrame)
+            {
+                gpuProfiler.begin("ssao");
+                ssao.compute(ssaoDepthShader, ssaoShader, ssaoBlurShader, ssaoUpsampleShader, sceneRenderer.depthTexture(),
+                             projection);
+                gpuProfiler.end();
+            }
+            // lighting passes, added up in the light buffer
+            PROFILE_SCOPE("deferred lighting");
+            gpuProfiler.begin("lighting");
+            sceneRenderer.beginLighting();
+            deferredLightShader.use();
+            sceneRenderer.bindGBuffer(deferredLightShader, projection * view);
+            setSceneLights(deferredLightShader);
+            shadowCascades.bind(deferredLightShader, 6);
+            pointShadows.bind(deferredLightShader, 7, (int)shadowedPointLights.size());
+            if (probesOn)
+                probeGrid.bind(deferredLightShader, 9);
+            ssao.bind(deferredLightShader, 10, ssaoFrame);
+            sceneRenderer.drawFullscreen();
+            if (lightCount > 0)
+            {
+                lightVolumeShader.use();
+                sceneRenderer.bindGBuffer(lightVolumeShader, projection * view);
+                lightVolumeShader.setVec3("viewPos", camera.Position);
+                lightVolumeShader.setMat4("projection", projection);
+                lightVolumeShader.setMat4("view", view);
+                sceneRenderer.drawLightVolumes(clusteredLights);
+            }
+            sceneRenderer.endLighting();
+            gpuProfiler.end();
         }
+        overdrawCounter.endPass();
 
         // draw light object
         lightCubeShader.use();
@@ -265,22 +926,104 @@ int main()
         lightCubeShader.setMat4("model", model);
         glBindVertexArray(lightCubeVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
+        gpuProfiler.end();
+
+        gpuProfiler.begin("resolve");
+        sceneRenderer.resolveSamples();
+
+        // accumulate into the history at the window's size, then bloom (from
+        // the scene's own size) and tonemap into the window
+        unsigned int sceneTexture = sceneRenderer.lightTexture();
+        if (temporalFrame)
+            sceneTexture = temporalResolve.resolve(temporalResolveShader, sceneTexture, sceneRenderer.depthTexture(),
+                                                   renderWidth, renderHeight, unjitteredProjection * view);
+        gpuProfiler.end();
+        if (bloomOn)
+        {
+            gpuProfiler.begin("bloom");
+            bloom.render(bloomDownShader, bloomUpShader, sceneRenderer.lightTexture(), BLOOM_THRESHOLD);
+            gpuProfiler.end();
+        }
+        gpuProfiler.begin("tonemap");
+        glm::vec2 sceneScale = temporalFrame ? glm::vec2(1.0f) : sceneRenderer.uvScale();
+        bloom.tonemap(tonemapShader, sceneTexture, sceneScale, framebufferWidth, framebufferHeight, EXPOSURE,
+                      bloomOn ? BLOOM_STRENGTH : 0.0f, headless.framebuffer());
+        gpuProfiler.end();
+        // UI drawn from here on is at the window's own resolution
+        if (!benchmarkFrame)
+            dynamicResolution.endFrame();
+        if (overlayOn && !benchmarkFrame)
+        {
+            PerfOverlay::FrameStats overlayStats;
+            overlayStats.frameMs = deltaTime * 1000.0f;
+            overlayStats.draws = cubeInstances.lastStats().draws;
+            overlayStats.stateChanges = cubeInstances.lastStats().stateChanges;
+            TextureStreamer::Stats textureStats = textureStreamer.stats();
+            overlayStats.textureBytes = textureStats.residentBytes;
+            overlayStats.textureBudget = textureStats.budgetBytes;
+            {
+                PROFILE_SCOPE("overlay build");
+                overlay.build(overlayStats, gpuProfiler);
+            }
+            PROFILE_SCOPE("overlay render");
+            gpuProfiler.begin("overlay");
+            overlay.render(overlayShader, framebufferWidth, framebufferHeight);
+            gpuProfiler.end();
+        }
+        gpuProfiler.end();
+        gpuProfiler.endFrame();
+        if (headlessFrame)
+            headless.frameDone(cubeInstances.lastStats(), gpuProfiler);
+        if (benchmarkFrame)
+        {
+            glFinish();
+            if (shadingBenchmarkFrame)
+                shadingBenchmark.frameDone();
+            else
+                antialiasingBenchmark.frameDone(framebufferWidth, framebufferHeight);
+            if (!shadingBenchmark.running() && !antialiasingBenchmark.running() && window)
+                glfwSetWindowShouldClose(window, true);
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved
         // etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (window)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    cubeInstances.release();
+    lightmap.release();
+    probeGrid.release();
+    lightingVariants.release();
+    lightClusters.release();
+    sceneRenderer.release();
+    bloom.release();
+    temporalResolve.release();
+    ssao.release();
+    gpuProfiler.release();
+    overlay.release();
+    headless.release();
+    dynamicResolution.release();
+    shadowCascades.release();
+    pointShadows.release();
+    depthPrepass.release();
+    overdrawCounter.release();
+    textureStreamer.release();
+    writeProfileTrace(PROFILE_TRACE_PATH);
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
-    glfwTerminate();
+    if (window)
+        glfwTerminate();
+    headlessContext.release();
     return 0;
 }
 
@@ -289,6 +1032,7 @@ int main()
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window)
 {
+    PROFILE_SCOPE("processInput");
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -308,6 +1052,12 @@ void processInput(GLFWwindow *window)
         camera.ProcessKeyboard(DOWN, deltaTime);
 }
 
+// whether a key is held; never without a window
+bool keyPressed(GLFWwindow *window, int key)
+{
+    return window && glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback
 // function executes
 // ---------------------------------------------------------------------------------------------
@@ -341,38 +1091,3 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffest)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffest));
 }
-
-unsigned int loadTexture(char const *path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-    return textureID;
-}
\ No newline at end of file
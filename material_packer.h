@@ -0,0 +1,287 @@
+#ifndef MATERIAL_PACKER_H
+#define MATERIAL_PACKER_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "profiler.h"
+#include "shader.h"
+#include "stb_image.h"
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// a material's map files; an empty path means the material has no such map
+struct MaterialMaps
+{
+    std::string diffuse;
+    std::string specular;
+    std::string emmision;
+};
+
+// packs material maps into texture arrays
+// every map file is grouped with the others of the same size and channel count
+// into one streamed GL_TEXTURE_2D_ARRAY, so a material is just three layer
+// indices. materials whose maps landed in the same arrays (or that lack a map)
+// share their texture bindings and can be drawn together; the shader looks the
+// layers up through a per-instance material index (see materialVertShader.vs
+// and fragShader.fs).
+// ---------------------------------------------------------------------------
+class MaterialPacker
+{
+public:
+    // must match the size of materialLayers in fragShader.fs
+    static const int MAX_MATERIALS = 64;
+    static const int SLOTS = 3; // diffuse, specular, emmision
+
+    struct PackedMaterial
+    {
+        int array[SLOTS]; // streamer handle of the array holding each map, -1 if none
+        int layer[SLOTS]; // layer within that array, -1 if none
+    };
+
+    // returns the material index used by the other calls, or -1 when full
+    int addMaterial(const MaterialMaps &maps)
+    {
+        if ((int)materials.size() >= MAX_MATERIALS)
+        {
+            std::cout << "ERROR::MATERIAL_PACKER::TOO_MANY_MATERIALS" << std::endl;
+            return -1;
+        }
+        pending.push_back(maps);
+        PackedMaterial m;
+        std::fill(m.array, m.array + SLOTS, -1);
+        std::fill(m.layer, m.layer + SLOTS, -1);
+        materials.push_back(m);
+        return (int)materials.size() - 1;
+    }
+    // group the maps of every added material and start streaming the arrays
+    // ------------------------------------------------------------------------
+    void build(TextureStreamer &streamer)
+    {
+        // one group per (width, height, channels); each file gets one layer
+        std::map<std::tuple<int, int, int>, std::vector<std::string>> groups;
+        std::map<std::string, std::tuple<int, int, int>> groupOf;
+        for (const MaterialMaps &maps : pending)
+        {
+            for (const std::string *path : {&maps.diffuse, &maps.specular, &maps.emmision})
+            {
+                if (path->empty() || groupOf.count(*path))
+                    continue;
+                int width, height, nrComponents;
+                if (!stbi_info(path->c_str(), &width, &height, &nrComponents))
+                {
+                    std::cout << "ERROR::MATERIAL_PACKER::FILE_NOT_READ: " << *path << std::endl;
+                    continue;
+                }
+                // the streamer uploads 2 channel images as RGBA
+                std::tuple<int, int, int> key(width, height, nrComponents == 2 ? 4 : nrComponents);
+                groupOf[*path] = key;
+                groups[key].push_back(*path);
+            }
+        }
+        std::map<std::tuple<int, int, int>, int> arrayOf;
+        for (const auto &group : groups)
+            arrayOf[group.first] = streamer.loadArray(group.second);
+
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            const std::string *paths[SLOTS] = {&pending[i].diffuse, &pending[i].specular, &pending[i].emmision};
+            for (int slot = 0; slot < SLOTS; slot++)
+            {
+                auto found = groupOf.find(*paths[slot]);
+                if (found == groupOf.end() || arrayOf[found->second] < 0)
+                    continue;
+                const std::vector<std::string> &layers = groups[found->second];
+                materials[i].array[slot] = arrayOf[found->second];
+                materials[i].layer[slot] = (int)(std::find(layers.begin(), layers.end(), *paths[slot]) - layers.begin());
+            }
+        }
+        pending.clear();
+        arrays = (int)groups.size();
+    }
+    int materialCount() const
+    {
+        return (int)materials.size();
+    }
+    int arrayCount() const
+    {
+        return arrays;
+    }
+    const PackedMaterial &material(int index) const
+    {
+        return materials[index];
+    }
+    // add a material to a set of per-slot array bindings (-1 for unbound) if it
+    // can share them; a material without a map doesn't care what that slot holds
+    bool mergeBindings(int bindings[SLOTS], int index) const
+    {
+        const PackedMaterial &m = materials[index];
+        for (int slot = 0; slot < SLOTS; slot++)
+            if (m.array[slot] >= 0 && bindings[slot] >= 0 && m.array[slot] != bindings[slot])
+                return false;
+        for (int slot = 0; slot < SLOTS; slot++)
+            if (bindings[slot] < 0)
+                bindings[slot] = m.array[slot];
+        return true;
+    }
+    // bind arrays to texture units 0 (diffuse), 1 and 2
+    void bind(const TextureStreamer &streamer, const int bindings[SLOTS]) const
+    {
+        for (int slot = 0; slot < SLOTS; slot++)
+        {
+            glActiveTexture(GL_TEXTURE0 + slot);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, streamer.textureId(bindings[slot]));
+        }
+    }
+    // upload every material's layer indices to the shader's materialLayers
+    void setLayers(const Shader &shader) const
+    {
+        std::vector<int> layers;
+        for (const PackedMaterial &m : materials)
+            layers.insert(layers.end(), {m.layer[0], m.layer[1], m.layer[2], 0});
+        if (!layers.empty())
+            glUniform4iv(glGetUniformLocation(shader.ID, "materialLayers"), (int)materials.size(), layers.data());
+    }
+    // stream in the mips an object using this material needs
+    void request(TextureStreamer &streamer, int index, const glm::vec3 &center, float radius) const
+    {
+        for (int slot = 0; slot < SLOTS; slot++)
+            streamer.request(materials[index].array[slot], center, radius);
+    }
+
+private:
+    std::vector<MaterialMaps> pending;
+    std::vector<PackedMaterial> materials;
+    int arrays = 0;
+};
+
+// per-instance model matrices, material indices and lightmap tiles for one
+// mesh, drawn with one instanced draw per set of materials that share their
+// texture arrays
+// ---------------------------------------------------------------------------
+class MaterialInstances
+{
+public:
+    // what the last draw() issued: draw calls, and the bindings it changed
+    // (buffers, texture arrays that differ from the previous batch's, and
+    // instance attribute offsets)
+    struct Stats
+    {
+        int draws = 0;
+        int stateChanges = 0;
+    };
+
+    // adds the instance attributes (model at locations 3-6, material at 7,
+    // lightmap scale and offset at 9) to vao
+    MaterialInstances(unsigned int vao) : VAO(vao)
+    {
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glEnableVertexAttribArray(7);
+        glVertexAttribDivisor(7, 1);
+        glEnableVertexAttribArray(9);
+        glVertexAttribDivisor(9, 1);
+        pointAttributes(0);
+    }
+    MaterialInstances(const MaterialInstances &) = delete;
+    MaterialInstances &operator=(const MaterialInstances &) = delete;
+
+    void clear()
+    {
+        instances.clear();
+    }
+    // delete the instance buffer; call while the context is still current
+    void release()
+    {
+        glDeleteBuffers(1, &instanceVBO);
+        instanceVBO = 0;
+    }
+    // lightmap maps the mesh's lightmap UVs into the instance's tile
+    void add(const glm::mat4 &model, int material, const glm::vec4 &lightmap = glm::vec4(0.0f))
+    {
+        instances.push_back({model, material, lightmap});
+    }
+    // returns the number of draw calls issued
+    // ------------------------------------------------------------------------
+    int draw(const MaterialPacker &packer, const TextureStreamer &streamer, int vertexCount)
+    {
+        PROFILE_SCOPE("MaterialInstances::draw");
+        stats = Stats();
+        if (instances.empty())
+            return 0;
+        // instances that share bindings end up next to each other (a missing map
+        // sorts first, right before the materials it can share a draw with)
+        std::stable_sort(instances.begin(), instances.end(), [&](const Instance &a, const Instance &b) {
+            const MaterialPacker::PackedMaterial &ma = packer.material(a.material), &mb = packer.material(b.material);
+            return std::lexicographical_compare(ma.array, ma.array + MaterialPacker::SLOTS, mb.array, mb.array + MaterialPacker::SLOTS);
+        });
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+
+        int draws = 0;
+        size_t first = 0;
+        int previous[MaterialPacker::SLOTS] = {-2, -2, -2};
+        stats.stateChanges = 3;
+        while (first < instances.size())
+        {
+            int bindings[MaterialPacker::SLOTS] = {-1, -1, -1};
+            size_t last = first;
+            while (last < instances.size() && packer.mergeBindings(bindings, instances[last].material))
+                last++;
+            packer.bind(streamer, bindings);
+            for (int slot = 0; slot < MaterialPacker::SLOTS; slot++)
+            {
+                stats.stateChanges += bindings[slot] != previous[slot];
+                previous[slot] = bindings[slot];
+            }
+            // no base instance in GL 3.3, so move the attribute offsets instead
+            pointAttributes(first);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, (int)(last - first));
+            draws++;
+            stats.stateChanges++;
+            first = last;
+        }
+        stats.draws = draws;
+        return draws;
+    }
+    const Stats &lastStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Instance
+    {
+        glm::mat4 model;
+        int material;
+        glm::vec4 lightmap;
+    };
+    unsigned int VAO;
+    unsigned int instanceVBO;
+    std::vector<Instance> instances;
+    Stats stats;
+
+    void pointAttributes(size_t firstInstance)
+    {
+        size_t base = firstInstance * sizeof(Instance);
+        for (int i = 0; i < 4; i++)
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)(base + offsetof(Instance, model) + i * sizeof(glm::vec4)));
+        glVertexAttribIPointer(7, 1, GL_INT, sizeof(Instance), (void *)(base + offsetof(Instance, material)));
+        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void *)(base + offsetof(Instance, lightmap)));
+    }
+};
+#endif
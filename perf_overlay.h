@@ -0,0 +1,390 @@
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+#include "include/glm/gtc/matrix_transform.hpp"
+
+// the same configuration everywhere nuklear.h is included; the one file that
+// defines NK_IMPLEMENTATION before including this header gets the code
+#define NK_INCLUDE_FIXED_TYPES
+#define NK_INCLUDE_DEFAULT_ALLOCATOR
+#define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
+#define NK_INCLUDE_FONT_BAKING
+#define NK_INCLUDE_DEFAULT_FONT
+#include "nuklear.h"
+
+#include "gpu_profiler.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// performance overlay, drawn with nuklear over the finished frame
+// shows a graph of the last frame times (CPU in yellow, GPU in blue), the
+// scene's draw calls and state changes, memory use, and the CPU and GPU time
+// of every pass the GpuProfiler brackets. it takes no input, so the mouse
+// stays with the camera. building the UI and rendering it are timed apart,
+// and rendering is cheap enough to leave on: nk_convert writes the vertices
+// and indices straight into one vertex and one index buffer, each split into
+// FRAMES regions used in turn, with a fence per region so the CPU never
+// writes where the GPU may still read. with GL 4.4 the buffers are mapped
+// once, persistently; on a 3.3 context each region is mapped unsynchronized
+// for the frame instead.
+// ---------------------------------------------------------------------------
+class PerfOverlay
+{
+public:
+    // what the app measured this frame
+    struct FrameStats
+    {
+        float frameMs = 0.0f;
+        int draws = 0;
+        int stateChanges = 0;
+        size_t textureBytes = 0;
+        size_t textureBudget = 0;
+    };
+
+    PerfOverlay() = default;
+    PerfOverlay(const PerfOverlay &) = delete;
+    PerfOverlay &operator=(const PerfOverlay &) = delete;
+
+    // lay out this frame's overlay; needs a current context the first time
+    // ------------------------------------------------------------------------
+    void build(const FrameStats &stats, const GpuProfiler &gpu)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!created)
+            createObjects();
+        const GpuProfiler::Pass *gpuFrame = nullptr;
+        for (const GpuProfiler::Pass &p : gpu.passes())
+            if (p.depth == 0)
+                gpuFrame = &p;
+        cpuHistory[historyNext] = stats.frameMs;
+        gpuHistory[historyNext] = gpuFrame ? (float)gpuFrame->gpuMs : 0.0f;
+        historyNext = (historyNext + 1) % HISTORY;
+
+        nk_input_begin(&ctx);
+        nk_input_end(&ctx);
+        // five lines and the graph above the table, then a row per pass
+        float height = 5.0f * (ROW_HEIGHT + ROW_SPACING) + 60.0f + 40.0f + (ROW_HEIGHT + ROW_SPACING) * (float)gpu.passes().size();
+        if (nk_begin(&ctx, "performance", nk_rect(10.0f, 10.0f, WIDTH, height),
+                     NK_WINDOW_BORDER | NK_WINDOW_NO_INPUT | NK_WINDOW_NO_SCROLLBAR))
+        {
+            char line[128];
+            std::snprintf(line, sizeof(line), "frame %.2f ms cpu (%.0f fps), %.2f ms gpu", stats.frameMs,
+                          stats.frameMs > 0.0f ? 1000.0f / stats.frameMs : 0.0f, gpuFrame ? gpuFrame->gpuMs : 0.0);
+            nk_layout_row_dynamic(&ctx, ROW_HEIGHT, 1);
+            nk_label(&ctx, line, NK_TEXT_LEFT);
+
+            // scaled to the slowest frame shown, but never below 30 fps
+            float top = 33.3f;
+            for (int i = 0; i < HISTORY; i++)
+                top = std::max(top, std::max(cpuHistory[i], gpuHistory[i]));
+            nk_layout_row_dynamic(&ctx, 60.0f, 1);
+            if (nk_chart_begin_colored(&ctx, NK_CHART_LINES, nk_rgb(255, 210, 60), nk_rgb(255, 210, 60), HISTORY, 0.0f, top))
+            {
+                nk_chart_add_slot_colored(&ctx, NK_CHART_LINES, nk_rgb(90, 170, 255), nk_rgb(90, 170, 255), HISTORY, 0.0f, top);
+                for (int i = 0; i < HISTORY; i++)
+                {
+                    int sample = (historyNext + i) % HISTORY;
+                    nk_chart_push_slot(&ctx, cpuHistory[sample], 0);
+                    nk_chart_push_slot(&ctx, gpuHistory[sample], 1);
+                }
+                nk_chart_end(&ctx);
+            }
+
+            nk_layout_row_dynamic(&ctx, ROW_HEIGHT, 1);
+            std::snprintf(line, sizeof(line), "scene: %d draws, %d state changes; overlay: %d draws", stats.draws,
+                          stats.stateChanges, lastDraws);
+            nk_label(&ctx, line, NK_TEXT_LEFT);
+            std::snprintf(line, sizeof(line), "textures %.1f of %.1f MB", stats.textureBytes / (1024.0 * 1024.0),
+                          stats.textureBudget / (1024.0 * 1024.0));
+            // a file read, so only now and then
+            if (buildCount++ % MEMORY_INTERVAL == 0)
+                resident = residentBytes();
+            if (resident > 0)
+                std::snprintf(line + std::strlen(line), sizeof(line) - std::strlen(line), ", process %.1f MB",
+                              resident / (1024.0 * 1024.0));
+            nk_label(&ctx, line, NK_TEXT_LEFT);
+            std::snprintf(line, sizeof(line), "overlay: build %.3f ms, render %.3f ms cpu", buildMs, renderMs);
+            nk_label(&ctx, line, NK_TEXT_LEFT);
+
+            // averages, so the numbers stay readable
+            const float columns[3] = {0.5f, 0.25f, 0.25f};
+            nk_layout_row(&ctx, NK_DYNAMIC, ROW_HEIGHT, 3, columns);
+            nk_label(&ctx, "pass", NK_TEXT_LEFT);
+            nk_label(&ctx, "cpu ms", NK_TEXT_RIGHT);
+            nk_label(&ctx, "gpu ms", NK_TEXT_RIGHT);
+            for (const GpuProfiler::Pass &p : gpu.passes())
+            {
+                std::snprintf(line, sizeof(line), "%*s%s", 2 * p.depth, "", p.name);
+                nk_label(&ctx, line, NK_TEXT_LEFT);
+                std::snprintf(line, sizeof(line), "%.3f", p.cpuAverageMs);
+                nk_label(&ctx, line, NK_TEXT_RIGHT);
+                std::snprintf(line, sizeof(line), "%.3f", p.gpuAverageMs);
+                nk_label(&ctx, line, NK_TEXT_RIGHT);
+            }
+        }
+        nk_end(&ctx);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        buildMs = elapsed.count();
+    }
+
+    // draw what build() laid out into the bound framebuffer, w x h pixels
+    // ------------------------------------------------------------------------
+    void render(Shader &shader, int w, int h)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!created)
+            return;
+        // the region's last draw has to be done before it's overwritten
+        if (fences[region])
+        {
+            glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        size_t vertexOffset = (size_t)region * MAX_VERTICES * sizeof(Vertex);
+        size_t elementOffset = (size_t)region * MAX_ELEMENTS * sizeof(nk_draw_index);
+        void *vertices, *elements;
+        if (persistent)
+        {
+            vertices = (char *)vertexMemory + vertexOffset;
+            elements = (char *)elementMemory + elementOffset;
+        }
+        else
+        {
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            vertices = glMapBufferRange(GL_ARRAY_BUFFER, vertexOffset, MAX_VERTICES * sizeof(Vertex), access);
+            elements = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, elementOffset, MAX_ELEMENTS * sizeof(nk_draw_index), access);
+        }
+        nk_buffer vertexBuffer, elementBuffer;
+        nk_buffer_init_fixed(&vertexBuffer, vertices, MAX_VERTICES * sizeof(Vertex));
+        nk_buffer_init_fixed(&elementBuffer, elements, MAX_ELEMENTS * sizeof(nk_draw_index));
+        nk_flags result = nk_convert(&ctx, &commands, &vertexBuffer, &elementBuffer, &convertConfig);
+        if (!persistent)
+        {
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        if (result != NK_CONVERT_SUCCESS)
+            std::cout << "ERROR::PERF_OVERLAY::CONVERT_FAILED: " << result << std::endl;
+
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        glViewport(0, 0, w, h);
+        shader.use();
+        shader.setInt("atlas", 0);
+        shader.setMat4("projection", glm::ortho(0.0f, (float)w, (float)h, 0.0f));
+        glActiveTexture(GL_TEXTURE0);
+        int draws = 0;
+        const struct nk_draw_command *command;
+        size_t offset = elementOffset;
+        GLint baseVertex = (GLint)(region * MAX_VERTICES);
+        nk_draw_foreach(command, &ctx, &commands)
+        {
+            if (!command->elem_count)
+                continue;
+            glBindTexture(GL_TEXTURE_2D, (GLuint)command->texture.id);
+            // nuklear clips from the top left, GL from the bottom left
+            glScissor((GLint)command->clip_rect.x, (GLint)(h - (command->clip_rect.y + command->clip_rect.h)),
+                      (GLint)command->clip_rect.w, (GLint)command->clip_rect.h);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)command->elem_count, GL_UNSIGNED_SHORT, (void *)offset,
+                                     baseVertex);
+            offset += command->elem_count * sizeof(nk_draw_index);
+            draws++;
+        }
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % FRAMES;
+        nk_clear(&ctx);
+        nk_buffer_clear(&commands);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        lastDraws = draws;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        renderMs = elapsed.count();
+    }
+
+    void printStats() const
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "overlay: build %.3f ms, render %.3f ms cpu, %d draws, %s buffers", buildMs, renderMs,
+                      lastDraws, persistent ? "persistently mapped" : "unsynchronized mapped");
+        std::cout << line << std::endl;
+    }
+    // delete the buffers and the font; call while the context is still current
+    void release()
+    {
+        if (!created)
+            return;
+        for (GLsync &fence : fences)
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        if (persistent)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindVertexArray(VAO);
+            glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteTextures(1, &fontTexture);
+        nk_buffer_free(&commands);
+        nk_free(&ctx);
+        nk_font_atlas_clear(&atlas);
+        created = false;
+    }
+
+private:
+    struct Vertex
+    {
+        float position[2];
+        float uv[2];
+        nk_byte color[4];
+    };
+    static_assert(sizeof(nk_draw_index) == sizeof(GLushort), "the draws use GL_UNSIGNED_SHORT indices");
+    static const int FRAMES = 3;
+    // per region; nk_draw_index is 16 bits, so a region can't address more
+    static const int MAX_VERTICES = 16384;
+    static const int MAX_ELEMENTS = 3 * MAX_VERTICES;
+    static const int HISTORY = 120;
+    // frames between reads of the process's memory use
+    static const int MEMORY_INTERVAL = 30;
+    static constexpr float WIDTH = 360.0f;
+    static constexpr float ROW_HEIGHT = 16.0f;
+    // nuklear's default spacing between rows
+    static constexpr float ROW_SPACING = 4.0f;
+    static const GLuint64 FENCE_TIMEOUT_NS = 100000000;
+    bool created = false;
+    bool persistent = false;
+    nk_context ctx;
+    nk_font_atlas atlas;
+    nk_buffer commands;
+    nk_convert_config convertConfig;
+    nk_draw_null_texture nullTexture;
+    unsigned int fontTexture = 0;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    void *vertexMemory = nullptr, *elementMemory = nullptr;
+    GLsync fences[FRAMES] = {};
+    int region = 0;
+    float cpuHistory[HISTORY] = {};
+    float gpuHistory[HISTORY] = {};
+    int historyNext = 0;
+    double buildMs = 0.0, renderMs = 0.0;
+    int lastDraws = 0;
+    size_t resident = 0;
+    unsigned long long buildCount = 0;
+
+    void createObjects()
+    {
+        // the default font, baked into an RGBA atlas
+        nk_font_atlas_init_default(&atlas);
+        nk_font_atlas_begin(&atlas);
+        nk_font *font = nk_font_atlas_add_default(&atlas, 13.0f, nullptr);
+        int width = 0, height = 0;
+        const void *image = nk_font_atlas_bake(&atlas, &width, &height, NK_FONT_ATLAS_RGBA32);
+        glGenTextures(1, &fontTexture);
+        glBindTexture(GL_TEXTURE_2D, fontTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        nk_font_atlas_end(&atlas, nk_handle_id((int)fontTexture), &nullTexture);
+        nk_init_default(&ctx, &font->handle);
+        // see-through, so the scene stays visible behind it
+        ctx.style.window.fixed_background = nk_style_item_color(nk_rgba(20, 20, 20, 190));
+        nk_buffer_init_default(&commands);
+
+        static const nk_draw_vertex_layout_element layout[] = {
+            {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, offsetof(Vertex, position)},
+            {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, offsetof(Vertex, uv)},
+            {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, offsetof(Vertex, color)},
+            {NK_VERTEX_LAYOUT_END}};
+        convertConfig = nk_convert_config();
+        convertConfig.vertex_layout = layout;
+        convertConfig.vertex_size = sizeof(Vertex);
+        convertConfig.vertex_alignment = alignof(Vertex);
+        convertConfig.tex_null = nullTexture;
+        convertConfig.circle_segment_count = 22;
+        convertConfig.curve_segment_count = 22;
+        convertConfig.arc_segment_count = 22;
+        convertConfig.global_alpha = 1.0f;
+        convertConfig.shape_AA = NK_ANTI_ALIASING_ON;
+        convertConfig.line_AA = NK_ANTI_ALIASING_ON;
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        GLsizeiptr vertexBytes = (GLsizeiptr)FRAMES * MAX_VERTICES * sizeof(Vertex);
+        GLsizeiptr elementBytes = (GLsizeiptr)FRAMES * MAX_ELEMENTS * sizeof(nk_draw_index);
+        persistent = GLAD_GL_VERSION_4_4 && glBufferStorage;
+        if (persistent)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, vertexBytes, nullptr, flags);
+            glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, elementBytes, nullptr, flags);
+            vertexMemory = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes, flags);
+            elementMemory = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, elementBytes, flags);
+            if (!vertexMemory || !elementMemory)
+                std::cout << "ERROR::PERF_OVERLAY::MAP_FAILED" << std::endl;
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, elementBytes, nullptr, GL_STREAM_DRAW);
+        }
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, uv));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *)offsetof(Vertex, color));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        created = true;
+    }
+    // the process's resident memory, where the platform tells
+    static size_t residentBytes()
+    {
+#ifdef __linux__
+        FILE *file = std::fopen("/proc/self/statm", "r");
+        if (!file)
+            return 0;
+        long pages = 0, resident = 0;
+        int read = std::fscanf(file, "%ld %ld", &pages, &resident);
+        std::fclose(file);
+        return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+        return 0;
+#endif
+    }
+};
+#endif
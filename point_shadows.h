@@ -0,0 +1,293 @@
+#ifndef POINT_SHADOWS_H
+#define POINT_SHADOWS_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+#include "include/glm/gtc/matrix_transform.hpp"
+
+#include "mapped_file.h"
+#include "profiler.h"
+#include "shader.h"
+#include "shadow_cascades.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// a point light that may cast shadows; casters beyond radius are ignored
+struct PointShadowLight
+{
+    glm::vec3 position;
+    float radius;
+};
+
+// cached omnidirectional shadow maps for point lights
+// the maps live in a fixed atlas: a depth texture array with six layers (one
+// per cube face) for each of SLOTS lights, so memory doesn't grow with the
+// light count. every frame the lights closest to the camera relative to their
+// size get the slots. a slot's map is redrawn only when its light or a caster
+// within the light's radius moved, and at most maxUpdates maps are redrawn per
+// frame, most important first; the rest keep their old map (or no shadow if
+// they never had one) until their turn. a light's six faces are drawn in one
+// pass, the geometry shader routing each triangle to the layers it touches.
+// lights are identified by their index in the array passed to update().
+// ---------------------------------------------------------------------------
+class PointShadows
+{
+public:
+    static const int SLOTS = 16;
+    static const int RESOLUTION = 256;
+    static constexpr float NEAR_PLANE = 0.05f;
+
+    struct Stats
+    {
+        int shadowed;   // lights holding a slot
+        int stale;      // of those, waiting for a redraw
+        int updated;    // maps redrawn this frame
+        int totalUpdates;
+    };
+
+    // mesh is the casters' vertex buffer, positions first in each vertex
+    // ------------------------------------------------------------------------
+    PointShadows(unsigned int meshVBO, int stride, int vertexCount, int maxUpdates = 2)
+        : vertexCount(vertexCount), maxUpdates(maxUpdates)
+    {
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, RESOLUTION, RESOLUTION, SLOTS * 6, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // the layered framebuffer draws all faces; clearing it would clear
+        // every slot, so single layers are cleared through a second one
+        glGenFramebuffers(1, &layeredFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::POINT_SHADOWS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glGenFramebuffers(1, &layerFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, layerFBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    PointShadows(const PointShadows &) = delete;
+    PointShadows &operator=(const PointShadows &) = delete;
+
+    // hand out the slots and redraw the maps that are out of date, within
+    // the budget. leaves the default framebuffer bound
+    // ------------------------------------------------------------------------
+    void update(Shader &depthShader, const glm::vec3 &cameraPosition, const std::vector<PointShadowLight> &lights,
+                const std::vector<ShadowCaster> &casters)
+    {
+        PROFILE_SCOPE("PointShadows::update");
+        // most important first: big lights near the camera
+        std::vector<int> order(lights.size());
+        std::vector<float> importance(lights.size());
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            order[i] = (int)i;
+            importance[i] = lights[i].radius / std::max(glm::length(lights[i].position - cameraPosition), 1e-3f);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return importance[a] > importance[b]; });
+        int wanted = std::min((int)lights.size(), SLOTS);
+
+        // free the slots of lights that dropped out, then seat the newcomers
+        lightSlot.assign(lights.size(), -1);
+        std::vector<bool> keep(lights.size(), false);
+        for (int k = 0; k < wanted; k++)
+            keep[order[k]] = true;
+        for (int s = 0; s < SLOTS; s++)
+        {
+            int owner = slots[s].owner;
+            if (owner >= (int)lights.size() || (owner >= 0 && !keep[owner]))
+                slots[s] = Slot();
+            else if (owner >= 0)
+                lightSlot[owner] = s;
+        }
+        for (int k = 0; k < wanted; k++)
+        {
+            int light = order[k];
+            if (lightSlot[light] >= 0)
+                continue;
+            for (int s = 0; s < SLOTS; s++)
+                if (slots[s].owner < 0)
+                {
+                    slots[s] = Slot();
+                    slots[s].owner = light;
+                    lightSlot[light] = s;
+                    break;
+                }
+        }
+
+        // which maps are out of date, and what they'd draw
+        std::vector<int> dirty;
+        std::vector<std::vector<int>> casterLists(SLOTS);
+        std::vector<uint64_t> hashes(SLOTS, 0);
+        stats.shadowed = stats.stale = stats.updated = 0;
+        for (int k = 0; k < wanted; k++)
+        {
+            int light = order[k];
+            int s = lightSlot[light];
+            const PointShadowLight &l = lights[light];
+            uint64_t h = hashBytes(&l, sizeof(l));
+            for (size_t i = 0; i < casters.size(); i++)
+            {
+                float reach = l.radius + casters[i].radius;
+                glm::vec3 d = casters[i].center - l.position;
+                if (glm::dot(d, d) > reach * reach)
+                    continue;
+                casterLists[s].push_back((int)i);
+                h = hashBytes(&casters[i].model, sizeof(casters[i].model), h);
+            }
+            hashes[s] = h;
+            stats.shadowed++;
+            if (!slots[s].drawn || slots[s].hash != h)
+                dirty.push_back(s);
+        }
+        // dirty is in importance order already
+        int updates = std::min((int)dirty.size(), maxUpdates);
+        stats.stale = (int)dirty.size() - updates;
+        stats.updated = updates;
+        stats.totalUpdates += updates;
+        if (updates == 0)
+            return;
+
+        std::vector<glm::mat4> models;
+        std::vector<int> firstInstance(updates), instanceCount(updates);
+        for (int u = 0; u < updates; u++)
+        {
+            firstInstance[u] = (int)models.size();
+            for (int caster : casterLists[dirty[u]])
+                models.push_back(casters[caster].model);
+            instanceCount[u] = (int)models.size() - firstInstance[u];
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (!models.empty())
+            glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+        glViewport(0, 0, RESOLUTION, RESOLUTION);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        depthShader.use();
+        glBindVertexArray(VAO);
+        for (int u = 0; u < updates; u++)
+        {
+            int s = dirty[u];
+            const PointShadowLight &l = lights[slots[s].owner];
+            glBindFramebuffer(GL_FRAMEBUFFER, layerFBO);
+            for (int face = 0; face < 6; face++)
+            {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas, 0, s * 6 + face);
+                glClear(GL_DEPTH_BUFFER_BIT);
+            }
+            if (instanceCount[u] > 0)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+                glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, l.radius);
+                for (int face = 0; face < 6; face++)
+                {
+                    glm::mat4 view = glm::lookAt(l.position, l.position + FACE_FORWARD[face], FACE_UP[face]);
+                    depthShader.setMat4("faceMatrices[" + std::to_string(face) + "]", projection * view);
+                }
+                depthShader.setInt("firstLayer", s * 6);
+                // no base instance in GL 3.3, so move the attribute offsets instead
+                for (int i = 0; i < 4; i++)
+                    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                          (void *)(firstInstance[u] * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+                glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceCount[u]);
+            }
+            slots[s].drawn = true;
+            slots[s].hash = hashes[s];
+            slots[s].far = l.radius;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    // bind the atlas to unit and set pointShadowParams for the first
+    // lightCount lights (see shaders/point_shadows.glsl)
+    // ------------------------------------------------------------------------
+    void bind(const Shader &shader, int unit, int lightCount) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, atlas);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("pointShadowMap", unit);
+        for (int i = 0; i < lightCount; i++)
+        {
+            int s = i < (int)lightSlot.size() ? lightSlot[i] : -1;
+            // a light waiting for its first map goes without a shadow
+            bool drawn = s >= 0 && slots[s].drawn;
+            shader.setVec4("pointShadowParams[" + std::to_string(i) + "]",
+                           drawn ? glm::vec4((float)s + 1.0f, NEAR_PLANE, slots[s].far, 0.0f) : glm::vec4(0.0f));
+        }
+    }
+    const Stats &lastStats() const
+    {
+        return stats;
+    }
+    void printStats() const
+    {
+        std::cout << "point shadows: " << stats.shadowed << " of " << SLOTS << " slots used, " << stats.updated
+                  << " redrawn this frame, " << stats.stale << " waiting, " << stats.totalUpdates << " redraws in total" << std::endl;
+    }
+    // delete the atlas and buffers; call while the context is still current
+    void release()
+    {
+        glDeleteTextures(1, &atlas);
+        unsigned int framebuffers[2] = {layeredFBO, layerFBO};
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+        atlas = layeredFBO = layerFBO = VAO = instanceVBO = 0;
+    }
+
+private:
+    struct Slot
+    {
+        int owner = -1;     // index of the light, -1 when free
+        bool drawn = false; // holds a map for owner
+        uint64_t hash = 0;  // light and casters the map was drawn with
+        float far = 0.0f;
+    };
+    // each face's view; shaders/point_shadows.glsl holds the matching bases
+    static inline const glm::vec3 FACE_FORWARD[6] = {glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                                     glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+    static inline const glm::vec3 FACE_UP[6] = {glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+                                                glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)};
+    int vertexCount;
+    int maxUpdates;
+    unsigned int atlas = 0, layeredFBO = 0, layerFBO = 0, VAO = 0, instanceVBO = 0;
+    Slot slots[SLOTS];
+    std::vector<int> lightSlot;
+    Stats stats = {0, 0, 0, 0};
+};
+#endif
@@ -0,0 +1,354 @@
+#ifndef PROBE_GRID_H
+#define PROBE_GRID_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "bvh.h"
+#include "mapped_file.h"
+#include "shader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// a point light as CalcPointLight sees it
+struct ProbePointLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    float constant, linear, quadratic;
+};
+
+// the lights whose bounces the probes gather
+struct ProbeLighting
+{
+    glm::vec3 dirDirection;
+    glm::vec3 dirColor;
+    // radiance of every ray that escapes the scene
+    glm::vec3 skyColor;
+    std::vector<ProbePointLight> pointLights;
+    // reflectance of every surface the rays hit
+    float albedo = 0.5f;
+};
+
+// irradiance probes on a regular grid over the static scene
+// each probe casts a fixed set of rays into the scene; a ray that hits a
+// surface brings back the lights' shadowed diffuse light reflected there, one
+// that escapes brings back the sky. the radiance is projected onto L2
+// spherical harmonics and convolved with the cosine lobe, so the shader gets
+// the irradiance for any normal from 9 coefficients. the grid lives in one
+// 3D texture: 7 RGBA16F slabs stacked along z hold the 27 values, and
+// sampling stays inside a slab so trilinear filtering never mixes them.
+// probes bake on the worker pool in the background; when the lights change
+// every probe is queued again, and each frame starts only as many as its
+// budget of worker time allows, while the texture keeps the old values.
+// ---------------------------------------------------------------------------
+class ProbeGrid
+{
+public:
+    ProbeGrid(ThreadPool &pool, const glm::vec3 &min, const glm::vec3 &max, const glm::ivec3 &dims)
+        : pool(pool), gridMin(min), gridMax(max), dims(dims), done(std::make_shared<Completed>())
+    {
+        int count = dims.x * dims.y * dims.z;
+        coefficients.assign(count * SLABS * 4, 0.0f);
+        dirty.assign(count, false);
+        inFlight.assign(count, false);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, dims.x, dims.y, dims.z * SLABS, 0, GL_RGBA, GL_FLOAT, coefficients.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        // a fixed spherical Fibonacci set, so probes next to each other agree
+        directions.resize(RAYS);
+        for (int i = 0; i < RAYS; i++)
+        {
+            float z = 1.0f - (2.0f * i + 1.0f) / RAYS;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = 2.39996323f * i;
+            directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+        }
+    }
+    ProbeGrid(const ProbeGrid &) = delete;
+    ProbeGrid &operator=(const ProbeGrid &) = delete;
+
+    // the geometry rays are cast against; queues every probe
+    void setScene(std::shared_ptr<const StaticScene> staticScene)
+    {
+        scene = std::move(staticScene);
+        invalidate();
+    }
+    // cheap to call every frame: only a change queues the probes again
+    void setLighting(const ProbeLighting &newLighting)
+    {
+        uint64_t h = hashBytes(&newLighting.dirDirection, sizeof(glm::vec3) * 3);
+        h = hashBytes(&newLighting.albedo, sizeof(float), h);
+        if (!newLighting.pointLights.empty())
+            h = hashBytes(newLighting.pointLights.data(), newLighting.pointLights.size() * sizeof(ProbePointLight), h);
+        if (h == lightingHash && lighting)
+            return;
+        lightingHash = h;
+        lighting = std::make_shared<const ProbeLighting>(newLighting);
+        invalidate();
+    }
+
+    // upload finished probes, then start dirty ones on the workers until the
+    // worker time they're expected to take reaches budgetMs
+    // ------------------------------------------------------------------------
+    void update(float budgetMs)
+    {
+        uploadCompleted();
+        if (!scene || !lighting)
+            return;
+        int count = dims.x * dims.y * dims.z;
+        double planned = 0.0;
+        int started = 0;
+        std::vector<int> batch;
+        for (int probe = nextProbe, visited = 0; visited < count && planned < budgetMs; visited++, probe = (probe + 1) % count)
+        {
+            if (!dirty[probe] || inFlight[probe])
+                continue;
+            batch.push_back(probe);
+            inFlight[probe] = true;
+            planned += msPerProbe;
+            nextProbe = (probe + 1) % count;
+            if ((int)batch.size() == BATCH)
+            {
+                submit(batch);
+                started += (int)batch.size();
+                batch.clear();
+            }
+        }
+        if (!batch.empty())
+        {
+            started += (int)batch.size();
+            submit(batch);
+        }
+        startedLastFrame = started;
+    }
+
+    void bind(const Shader &shader, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("probeGrid", unit);
+        shader.setVec3("probeGridMin", gridMin);
+        shader.setVec3("probeGridMax", gridMax);
+        glUniform3i(glGetUniformLocation(shader.ID, "probeGridDims"), dims.x, dims.y, dims.z);
+    }
+    // every probe is baked and uploaded for the current scene and lighting
+    bool settled() const
+    {
+        return scene && lighting && std::count(dirty.begin(), dirty.end(), true) == 0;
+    }
+    void printStats() const
+    {
+        int pending = (int)std::count(dirty.begin(), dirty.end(), true);
+        char line[160];
+        std::snprintf(line, sizeof(line), "probe grid %dx%dx%d: %d of %d probes to bake, %d started last frame, %.3f ms per probe",
+                      dims.x, dims.y, dims.z, pending, (int)dirty.size(), startedLastFrame, msPerProbe);
+        std::cout << line << std::endl;
+    }
+    // delete the texture; call while the context is still current. probes
+    // still baking finish into a result nobody reads
+    void release()
+    {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    static const int SLABS = 7;
+    static const int RAYS = 256;
+    // probes per worker task
+    static const int BATCH = 8;
+    static constexpr float RAY_OFFSET = 1e-3f;
+
+    struct Result
+    {
+        int probe;
+        int generation;
+        float values[SLABS * 4];
+        double ms;
+    };
+    // filled by the workers, drained by update()
+    struct Completed
+    {
+        std::mutex mutex;
+        std::vector<Result> results;
+    };
+
+    ThreadPool &pool;
+    glm::vec3 gridMin, gridMax;
+    glm::ivec3 dims;
+    unsigned int texture = 0;
+    std::vector<float> coefficients;
+    std::vector<bool> dirty, inFlight;
+    std::vector<glm::vec3> directions;
+    std::shared_ptr<const StaticScene> scene;
+    std::shared_ptr<const ProbeLighting> lighting;
+    uint64_t lightingHash = 0;
+    // results of an older generation were baked for other lights
+    int generation = 0;
+    int nextProbe = 0;
+    int startedLastFrame = 0;
+    // measured, per probe and worker; starts as a guess
+    double msPerProbe = 1.0;
+    std::shared_ptr<Completed> done;
+
+    void invalidate()
+    {
+        generation++;
+        std::fill(dirty.begin(), dirty.end(), true);
+    }
+    glm::vec3 probePosition(int probe) const
+    {
+        glm::ivec3 cell(probe % dims.x, (probe / dims.x) % dims.y, probe / (dims.x * dims.y));
+        return gridMin + (gridMax - gridMin) * glm::vec3(cell) / glm::vec3(glm::max(dims - 1, glm::ivec3(1)));
+    }
+
+    void submit(const std::vector<int> &probes)
+    {
+        std::vector<glm::vec3> positions;
+        for (int probe : probes)
+            positions.push_back(probePosition(probe));
+        std::shared_ptr<const StaticScene> s = scene;
+        std::shared_ptr<const ProbeLighting> l = lighting;
+        std::shared_ptr<Completed> completed = done;
+        const std::vector<glm::vec3> *rays = &directions;
+        int g = generation;
+        pool.submit([=]() {
+            std::vector<Result> results(probes.size());
+            for (size_t i = 0; i < probes.size(); i++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                results[i].probe = probes[i];
+                results[i].generation = g;
+                bake(*s, *l, *rays, positions[i], results[i].values);
+                results[i].ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::lock_guard<std::mutex> lock(completed->mutex);
+            completed->results.insert(completed->results.end(), results.begin(), results.end());
+        });
+    }
+    void uploadCompleted()
+    {
+        std::vector<Result> results;
+        {
+            std::lock_guard<std::mutex> lock(done->mutex);
+            results.swap(done->results);
+        }
+        if (results.empty())
+            return;
+        for (const Result &r : results)
+        {
+            inFlight[r.probe] = false;
+            msPerProbe = msPerProbe * 0.9 + r.ms * 0.1;
+            if (r.generation != generation)
+                continue;
+            dirty[r.probe] = false;
+            std::copy(r.values, r.values + SLABS * 4, &coefficients[r.probe * SLABS * 4]);
+        }
+        // the texture is small, so it goes up whole: probe-major on the CPU,
+        // slab-major in the texture
+        int count = dims.x * dims.y * dims.z;
+        std::vector<float> texels(count * SLABS * 4);
+        for (int probe = 0; probe < count; probe++)
+            for (int slab = 0; slab < SLABS; slab++)
+                std::copy_n(&coefficients[(probe * SLABS + slab) * 4], 4, &texels[(slab * count + probe) * 4]);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, dims.x, dims.y, dims.z * SLABS, GL_RGBA, GL_FLOAT, texels.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+
+    // the light a surface at position reflects: every light's shadowed
+    // diffuse term, times albedo over pi
+    static glm::vec3 surfaceRadiance(const StaticScene &scene, const ProbeLighting &lighting, const glm::vec3 &position,
+                                     const glm::vec3 &normal)
+    {
+        glm::vec3 origin = position + normal * RAY_OFFSET;
+        glm::vec3 light(0.0f);
+        glm::vec3 toDir = -glm::normalize(lighting.dirDirection);
+        float cosine = glm::dot(normal, toDir);
+        if (cosine > 0.0f && !scene.bvh.occluded(origin, toDir, 1e30f))
+            light += lighting.dirColor * cosine;
+        for (const ProbePointLight &p : lighting.pointLights)
+        {
+            glm::vec3 toLight = p.position - position;
+            float distance = glm::length(toLight);
+            toLight /= std::max(distance, 1e-4f);
+            cosine = glm::dot(normal, toLight);
+            if (cosine <= 0.0f || scene.bvh.occluded(origin, toLight, distance))
+                continue;
+            // attenuated as in CalcPointLight
+            float attenuation = 1.0f / (p.constant + p.linear + distance + p.quadratic * distance * distance);
+            light += p.color * cosine * attenuation;
+        }
+        return light * (lighting.albedo / 3.14159265f);
+    }
+    // one probe: radiance along every ray, projected onto the L2 basis and
+    // convolved with the clamped cosine (pi, 2pi/3, pi/4 per band), then
+    // divided by pi so the shader multiplies by albedo and is done
+    static void bake(const StaticScene &scene, const ProbeLighting &lighting, const std::vector<glm::vec3> &rays,
+                     const glm::vec3 &position, float *values)
+    {
+        glm::vec3 sh[9] = {};
+        int used = 0;
+        for (const glm::vec3 &d : rays)
+        {
+            TriangleBVH::Hit hit;
+            glm::vec3 radiance = lighting.skyColor;
+            if (scene.bvh.intersect(position, d, 1e30f, hit))
+            {
+                const glm::vec3 &normal = scene.normals[hit.triangle];
+                // the inside of a mesh: this ray tells nothing about the room
+                if (glm::dot(normal, d) > 0.0f)
+                    continue;
+                radiance = surfaceRadiance(scene, lighting, position + d * hit.t, normal);
+            }
+            float basis[9] = {0.282095f,
+                              0.488603f * d.y,
+                              0.488603f * d.z,
+                              0.488603f * d.x,
+                              1.092548f * d.x * d.y,
+                              1.092548f * d.y * d.z,
+                              0.315392f * (3.0f * d.z * d.z - 1.0f),
+                              1.092548f * d.x * d.z,
+                              0.546274f * (d.x * d.x - d.y * d.y)};
+            for (int k = 0; k < 9; k++)
+                sh[k] += radiance * basis[k];
+            used++;
+        }
+        if (used == 0)
+        {
+            // buried in geometry: fall back to an open sky
+            std::fill(values, values + SLABS * 4, 0.0f);
+            for (int c = 0; c < 3; c++)
+                values[c] = lighting.skyColor[c] / 0.282095f;
+            return;
+        }
+        const float band[9] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+        float weight = 4.0f * 3.14159265f / used;
+        for (int k = 0; k < 9; k++)
+        {
+            glm::vec3 c = sh[k] * weight * band[k];
+            values[k * 3] = c.r;
+            values[k * 3 + 1] = c.g;
+            values[k * 3 + 2] = c.b;
+        }
+        values[27] = 0.0f;
+    }
+};
+#endif
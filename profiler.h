@@ -0,0 +1,357 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_RDTSC
+#endif
+
+// scoped CPU profiler, written out as a Chrome trace
+// PROFILE_SCOPE("name") records when the enclosing block starts and ends.
+// every thread appends to its own ring of events, so recording takes no lock
+// and never allocates; only a thread's first event registers its ring. the
+// clock is the time stamp counter where there is one (steady_clock
+// otherwise), converted to microseconds against steady_clock when the trace
+// is written. writeProfileTrace() saves the most recent events of every
+// thread as JSON that chrome://tracing and ui.perfetto.dev open. names must
+// be string literals, only their pointer is kept. built without the
+// ENABLE_PROFILER option the macros expand to nothing.
+// ---------------------------------------------------------------------------
+#ifdef ENABLE_PROFILER
+
+struct ProfileEvent
+{
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+class Profiler
+{
+public:
+    static uint64_t now()
+    {
+#ifdef PROFILER_RDTSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    // one thread's events; only that thread writes, the trace writer reads
+    // ------------------------------------------------------------------------
+    class Buffer
+    {
+    public:
+        static const uint64_t CAPACITY = 1 << 16;
+
+        void record(const char *name, uint64_t start, uint64_t end)
+        {
+            uint64_t n = head.load(std::memory_order_relaxed);
+            ProfileEvent &e = events[n & (CAPACITY - 1)];
+            e.name = name;
+            e.start = start;
+            e.end = end;
+            head.store(n + 1, std::memory_order_release);
+        }
+        // copies what's there; events the owner overwrote meanwhile are dropped
+        void snapshot(std::vector<ProfileEvent> &out) const
+        {
+            uint64_t end = head.load(std::memory_order_acquire);
+            uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+            size_t first = out.size();
+            for (uint64_t i = begin; i < end; i++)
+                out.push_back(events[i & (CAPACITY - 1)]);
+            uint64_t after = head.load(std::memory_order_acquire);
+            if (after > begin + CAPACITY)
+            {
+                size_t torn = (size_t)std::min<uint64_t>(after - begin - CAPACITY, end - begin);
+                out.erase(out.begin() + first, out.begin() + first + torn);
+            }
+        }
+
+        std::string name;
+        int id = 0;
+
+    private:
+        std::atomic<uint64_t> head{0};
+        ProfileEvent events[CAPACITY];
+    };
+
+    static Profiler &shared()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+    // this thread's ring, registered on first use
+    static Buffer &threadBuffer()
+    {
+        thread_local Buffer *buffer = shared().addBuffer();
+        return *buffer;
+    }
+    static void nameThread(const char *name)
+    {
+        Buffer &buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(shared().mutex);
+        buffer.name = name;
+    }
+
+    // an extra track for events that aren't timed on a CPU thread, e.g. the
+    // GPU's; record into it from one thread only
+    Buffer &track(const char *name)
+    {
+        Buffer *buffer = addBuffer();
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->name = name;
+        return *buffer;
+    }
+
+    // the recorded events of every thread as Chrome trace JSON
+    // ------------------------------------------------------------------------
+    bool writeTrace(const char *path)
+    {
+        double ticksPerUs = ticksPerMicrosecond();
+        std::vector<ProfileEvent> events;
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        size_t eventCount = 0;
+        char line[256];
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::unique_ptr<Buffer> &buffer : buffers)
+        {
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                          buffer->id, buffer->name.c_str());
+            json += line;
+            events.clear();
+            buffer->snapshot(events);
+            for (const ProfileEvent &e : events)
+            {
+                double ts = (double)(int64_t)(e.start - epoch) / ticksPerUs;
+                double dur = (double)(e.end - e.start) / ticksPerUs;
+                std::snprintf(line, sizeof(line),
+                              "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n", e.name,
+                              buffer->id, ts, dur);
+                json += line;
+            }
+            eventCount += events.size();
+        }
+        // no trailing comma
+        if (json.compare(json.size() - 2, 2, ",\n") == 0)
+            json.erase(json.size() - 2);
+        json += "\n]}\n";
+
+        std::string temporary = std::string(path) + ".tmp";
+        FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::FILE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        bool written = std::fwrite(json.data(), 1, json.size(), file) == json.size();
+        written = std::fclose(file) == 0 && written;
+        std::remove(path);
+        if (!written || std::rename(temporary.c_str(), path) != 0)
+        {
+            std::cout << "ERROR::PROFILER::FILE_NOT_WRITTEN: " << path << std::endl;
+            std::remove(temporary.c_str());
+            return false;
+        }
+        std::cout << "profile: " << eventCount << " events from " << buffers.size() << " threads written to " << path
+                  << std::endl;
+        return true;
+    }
+
+    // trace ticks per microsecond; the counter's rate is measured against
+    // steady_clock over the time since the profiler started
+    // ------------------------------------------------------------------------
+    double ticksPerMicrosecond() const
+    {
+#ifdef PROFILER_RDTSC
+        uint64_t ticks = now();
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - epochTime;
+        // too soon after startup to tell the rate apart from noise
+        if (elapsed.count() < 1000.0)
+        {
+            std::chrono::steady_clock::time_point until = epochTime + std::chrono::milliseconds(1);
+            while (std::chrono::steady_clock::now() < until)
+                ;
+            ticks = now();
+            elapsed = std::chrono::steady_clock::now() - epochTime;
+        }
+        return (double)(ticks - epoch) / elapsed.count();
+#else
+        return 1000.0;
+#endif
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    uint64_t epoch = now();
+    std::chrono::steady_clock::time_point epochTime = std::chrono::steady_clock::now();
+
+    Profiler() = default;
+    Buffer *addBuffer()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.push_back(std::make_unique<Buffer>());
+        Buffer *buffer = buffers.back().get();
+        buffer->id = (int)buffers.size();
+        buffer->name = "thread " + std::to_string(buffer->id);
+        return buffer;
+    }
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name) : name(name), start(Profiler::now())
+    {
+    }
+    ~ProfileScope()
+    {
+        Profiler::threadBuffer().record(name, start, Profiler::now());
+    }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+inline bool writeProfileTrace(const char *path)
+{
+    return Profiler::shared().writeTrace(path);
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::nameThread(name)
+
+#else
+
+inline bool writeProfileTrace(const char *)
+{
+    std::cout << "profile: built without ENABLE_PROFILER, nothing recorded" << std::endl;
+    return false;
+}
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+
+#endif
+
+// per-scope overhead benchmark, without a window:
+//   ./app --bench-profiler [-n scopes]
+// times an empty loop and the same loop with a PROFILE_SCOPE in its body,
+// on one thread and then on every hardware thread at once, each thread
+// against its own loop time
+// ---------------------------------------------------------------------------
+inline int runProfilerBenchmark(int argc, char **argv)
+{
+#ifndef ENABLE_PROFILER
+    (void)argc;
+    (void)argv;
+    std::cout << "profiler benchmark: built without ENABLE_PROFILER, PROFILE_SCOPE compiles to nothing" << std::endl;
+    return 0;
+#else
+    long scopes = 10000000;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            scopes = std::max(1L, std::atol(argv[++i]));
+    }
+    // the compiler mustn't drop or merge the loop; every thread counts on its
+    // own cache line, so the threads don't measure each other's contention
+    struct alignas(64) Sink
+    {
+        std::atomic<long> count{0};
+    };
+    auto run = [&](Sink &sink, bool profiled)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (long i = 0; i < scopes; i++)
+        {
+            if (profiled)
+            {
+                PROFILE_SCOPE("benchmark scope");
+                sink.count.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+                sink.count.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        return elapsed.count() / scopes;
+    };
+    // ns per iteration without and with a scope, on the calling thread
+    struct Timing
+    {
+        double empty = 0.0;
+        double profiled = 0.0;
+    };
+    auto measure = [&](Sink &sink)
+    {
+        Timing timing;
+        // first touch of the ring's pages stays out of the numbers
+        run(sink, true);
+        timing.empty = run(sink, false);
+        timing.profiled = run(sink, true);
+        return timing;
+    };
+    PROFILE_THREAD("benchmark");
+    Sink sink;
+    Timing single = measure(sink);
+    char line[128];
+    std::snprintf(line, sizeof(line), "profiler benchmark: %ld scopes, %.2f ns per scope (%.2f ns loop, %.2f ns with scope)",
+                  scopes, single.profiled - single.empty, single.empty, single.profiled);
+    std::cout << line << std::endl;
+#ifdef PROFILER_RDTSC
+    std::cout << "clock: time stamp counter, " << Profiler::shared().ticksPerMicrosecond() << " ticks per us" << std::endl;
+#else
+    std::cout << "clock: steady_clock" << std::endl;
+#endif
+
+    // each thread subtracts its own loop time, taken while the others run too
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Sink> sinks(threads);
+    std::vector<Timing> perThread(threads);
+    std::vector<std::thread> runners;
+    for (unsigned int t = 0; t < threads; t++)
+        runners.emplace_back([&, t]() { perThread[t] = measure(sinks[t]); });
+    for (std::thread &runner : runners)
+        runner.join();
+    double worst = 0.0, total = 0.0;
+    for (const Timing &timing : perThread)
+    {
+        worst = std::max(worst, timing.profiled - timing.empty);
+        total += timing.profiled - timing.empty;
+    }
+    std::snprintf(line, sizeof(line), "%u threads at once: %.2f ns per scope on average, %.2f ns on the slowest", threads,
+                  total / threads, worst);
+    std::cout << line << std::endl;
+    return 0;
+#endif
+}
+#endif
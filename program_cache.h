@@ -0,0 +1,174 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include "include/glad/glad.h"
+
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// on-disk cache of linked program binaries
+// programs are keyed by a hash of their sources and the GL vendor, renderer and
+// version strings, so a driver update or a different GPU simply misses. binaries
+// come from glGetProgramBinary (GL 4.1 / ARB_get_program_binary); when the
+// context doesn't offer any binary format the cache stays disabled and Shader
+// compiles from source as before. create it once the context is current.
+// ---------------------------------------------------------------------------
+class ProgramCache
+{
+public:
+    ProgramCache(const std::string &directory) : directory(directory)
+    {
+        int formats = 0;
+        if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        enabled = formats > 0;
+        if (!enabled)
+            return;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char *value = (const char *)glGetString(name);
+            if (value)
+                driver += std::string(value) + "\n";
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec)
+        {
+            std::cout << "ERROR::PROGRAM_CACHE::DIRECTORY_NOT_CREATED: " << directory << " (" << ec.message() << ")" << std::endl;
+            enabled = false;
+        }
+    }
+
+    bool supported() const
+    {
+        return enabled;
+    }
+    // identifies a program built from these sources on this driver
+    uint64_t programKey(const std::vector<std::string> &sources) const
+    {
+        uint64_t h = hashBytes(driver.data(), driver.size());
+        for (const std::string &source : sources)
+        {
+            uint64_t length = source.size();
+            h = hashBytes(&length, sizeof(length), h);
+            h = hashBytes(source.data(), source.size(), h);
+        }
+        return h;
+    }
+    // link program from a cached binary; false (program left unlinked) when
+    // there's no entry or the driver rejects it
+    // ------------------------------------------------------------------------
+    bool load(unsigned int program, uint64_t key)
+    {
+        if (!enabled)
+            return false;
+        MappedFile file;
+        Header header;
+        if (!file.open(entryPath(key)) || file.size() < sizeof(Header))
+        {
+            misses++;
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, "PGB1", 4) != 0 || header.key != key || sizeof(Header) + header.length > file.size())
+        {
+            misses++;
+            return false;
+        }
+        glProgramBinary(program, header.format, file.data() + sizeof(Header), (GLsizei)header.length);
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            // stale after a driver change that kept its version string; rebuilt on store
+            rejected++;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+    // ask the driver to keep the binary around; call before glLinkProgram
+    void prepare(unsigned int program) const
+    {
+        if (enabled)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    // save a successfully linked program
+    // ------------------------------------------------------------------------
+    void store(unsigned int program, uint64_t key)
+    {
+        if (!enabled)
+            return;
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "PGB1", 4);
+        header.format = format;
+        header.length = (uint32_t)length;
+        header.key = key;
+        // write next to the entry and rename, so a crash never leaves half a file
+        std::string path = entryPath(key);
+        {
+            std::ofstream out(path + ".tmp", std::ios::binary | std::ios::trunc);
+            out.write((const char *)&header, sizeof(header));
+            out.write(binary.data(), length);
+            if (!out)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_WRITTEN: " << path << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(path + ".tmp", path, ec);
+    }
+    int hitCount() const
+    {
+        return hits;
+    }
+    int missCount() const
+    {
+        return misses;
+    }
+    int rejectedCount() const
+    {
+        return rejected;
+    }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t format;
+        uint32_t length;
+        uint32_t reserved;
+        uint64_t key;
+    };
+
+    std::string directory;
+    std::string driver;
+    bool enabled = false;
+    int hits = 0, misses = 0, rejected = 0;
+
+    std::string entryPath(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+};
+#endif
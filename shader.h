@@ -6,70 +6,174 @@
 #include "include/glad/glad.h"
 #include "include/glm/glm.hpp"
 
-#include <fstream>
+#include "profiler.h"
+#include "program_cache.h"
+#include "shader_sources.h"
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <vector>
+
+// GL_KHR_parallel_shader_compile isn't part of the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, or loads the linked program
+    // from cache when it was built from the same sources before. with wait set
+    // to false the compile and link are only queued; the program can't be used
+    // until ready() returns true. defines go right after each #version line.
+    // the geometry stage is optional
     // ------------------------------------------------------------------------
-    Shader(const char *vertexPath, const char *fragmentPath)
-    {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        try
+    Shader(const char *vertexPath, const char *fragmentPath, ProgramCache *cache = nullptr, bool wait = true,
+           const std::string &defines = "", const char *geometryPath = nullptr)
+        : cache(cache), vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : ""),
+          defines(defines)
+    {
+        PROFILE_SCOPE("Shader");
+        // 1. retrieve the vertex/fragment source code from filePath, includes expanded
+        std::string vertexCode = ShaderSources::shared().expand(vertexPath);
+        std::string fragmentCode = ShaderSources::shared().expand(fragmentPath);
+        std::string geometryCode = geometryPath ? ShaderSources::shared().expand(geometryPath) : std::string();
+        if (!defines.empty())
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+            if (geometryPath)
+                geometryCode = injectDefines(geometryCode, defines);
         }
-        catch (std::ifstream::failure &e)
+        if (cache && cache->supported())
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            cacheKey = geometryPath ? cache->programKey({vertexCode, fragmentCode, geometryCode})
+                                    : cache->programKey({vertexCode, fragmentCode});
+            ID = glCreateProgram();
+            if (cache->load(ID, cacheKey))
+                return;
+            // missing or rejected by the driver: build from source below
+            glDeleteProgram(ID);
         }
         const char *vShaderCode = vertexCode.c_str();
         const char *fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
+        // 2. compile shaders; nothing here asks for a status, so the driver is
+        // free to compile in the background until ready() or finish() does
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        // geometry shader
+        if (geometryPath)
+        {
+            const char *gShaderCode = geometryCode.c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+        }
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (geometry)
+            glAttachShader(ID, geometry);
+        if (cache)
+            cache->prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        pending = true;
+        if (wait)
+            finish();
+    }
+    // let the driver compile on as many threads as it likes, if it can; call
+    // once after loading GL. returns whether ready() can poll without blocking
+    // ------------------------------------------------------------------------
+    static bool enableParallelCompile(GLADloadproc load)
+    {
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++)
+        {
+            const char *name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+            {
+                PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+                    std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+                if (maxThreads)
+                    maxThreads(0xFFFFFFFFu);
+                parallelCompile = true;
+                break;
+            }
+        }
+        return parallelCompile;
+    }
+    // whether the program is linked and usable; without parallel compile
+    // support this waits for it
+    // ------------------------------------------------------------------------
+    bool ready()
+    {
+        if (!pending)
+            return true;
+        if (parallelCompile)
+        {
+            int complete = 0;
+            glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+                return false;
+        }
+        finish();
+        return true;
+    }
+    // whether any of the changed files (from ShaderSources::poll) feed this program
+    bool dependsOn(const std::vector<std::string> &changed) const
+    {
+        return ShaderSources::shared().dependsOn(vertexPath, changed) || ShaderSources::shared().dependsOn(fragmentPath, changed) ||
+               (!geometryPath.empty() && ShaderSources::shared().dependsOn(geometryPath, changed));
+    }
+    // rebuild from the current sources; the old program stays in use if the
+    // new one fails, so a typo doesn't take the object off screen. uniforms
+    // start over at their defaults
+    // ------------------------------------------------------------------------
+    bool reload()
+    {
+        finish();
+        Shader replacement(vertexPath.c_str(), fragmentPath.c_str(), cache, true, defines,
+                           geometryPath.empty() ? nullptr : geometryPath.c_str());
+        if (!replacement.linked)
+        {
+            glDeleteProgram(replacement.ID);
+            return false;
+        }
+        glDeleteProgram(ID);
+        ID = replacement.ID;
+        return true;
+    }
+    // wait for the program, report errors and store it in the cache
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        if (!pending)
+            return;
+        pending = false;
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        if (geometry)
+            checkCompileErrors(geometry, "GEOMETRY");
+        linked = checkCompileErrors(ID, "PROGRAM");
+        if (linked && cache)
+            cache->store(ID, cacheKey);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        if (geometry)
+            glDeleteShader(geometry);
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -98,6 +202,10 @@ public:
     {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
+    void setVec2(const std::string &name, const glm::vec2 &value) const
+    {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
@@ -117,9 +225,30 @@ public:
     }
 
 private:
+    ProgramCache *cache;
+    std::string vertexPath, fragmentPath, geometryPath, defines;
+    uint64_t cacheKey = 0;
+    bool linked = true; // cleared when finish() finds a link error
+    unsigned int vertex = 0, fragment = 0, geometry = 0;
+    bool pending = false;
+    static inline bool parallelCompile = false;
+
+    // insert defines after the #version line, keeping error line numbers intact
+    static std::string injectDefines(const std::string &source, const std::string &defines)
+    {
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return defines + "#line 1\n" + source;
+        size_t end = source.find('\n', version);
+        if (end == std::string::npos)
+            return source + "\n" + defines;
+        int line = 2 + (int)std::count(source.begin(), source.begin() + end, '\n');
+        return source.substr(0, end + 1) + defines + "#line " + std::to_string(line) + "\n" + source.substr(end + 1);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(unsigned int shader, std::string type)
+    // returns whether it succeeded
+    bool checkCompileErrors(unsigned int shader, std::string type)
     {
         int success;
         char infoLog[1024];
@@ -143,6 +272,36 @@ private:
                           << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
+
+// shaders submitted together, so the driver compiles them side by side while
+// the caller gets on with other loading
+// ---------------------------------------------------------------------------
+class ShaderBatch
+{
+public:
+    void add(Shader &shader)
+    {
+        shaders.push_back(&shader);
+    }
+    // true once every shader is ready; polls each, never waits when parallel
+    // compile is available
+    bool poll()
+    {
+        bool all = true;
+        for (Shader *shader : shaders)
+            all = shader->ready() && all;
+        return all;
+    }
+    void finish()
+    {
+        for (Shader *shader : shaders)
+            shader->finish();
+    }
+
+private:
+    std::vector<Shader *> shaders;
+};
 #endif
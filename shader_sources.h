@@ -0,0 +1,199 @@
+#ifndef SHADER_SOURCES_H
+#define SHADER_SOURCES_H
+
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GLSL front end: #include "file" and the include graph
+// each file is read and split into text and include directives once, and kept
+// until it changes on disk. expanding a program's root file pastes its includes
+// in place (every file once per program, so include guards aren't needed) with
+// #line directives naming the file by its index in expansion order. poll() finds
+// edited files, so only the programs that reach them need rebuilding.
+// ---------------------------------------------------------------------------
+class ShaderSources
+{
+public:
+    // the one every Shader reads through
+    static ShaderSources &shared()
+    {
+        static ShaderSources instance;
+        return instance;
+    }
+
+    // path's source with every include expanded; empty if any file is missing
+    // or includes itself
+    // ------------------------------------------------------------------------
+    std::string expand(const std::string &path)
+    {
+        std::string out;
+        std::vector<std::string> order, stack;
+        if (!expandFile(normalize(path), out, order, stack))
+            return std::string();
+        return out;
+    }
+    // re-check every loaded file and return the ones that changed since
+    // ------------------------------------------------------------------------
+    std::vector<std::string> poll()
+    {
+        std::vector<std::string> changed;
+        for (auto &entry : files)
+        {
+            std::error_code ec;
+            std::filesystem::file_time_type time = std::filesystem::last_write_time(entry.first, ec);
+            if (ec || time == entry.second.time)
+                continue;
+            uint64_t before = entry.second.hash;
+            entry.second = parse(entry.first);
+            // editors like to save unchanged files
+            if (entry.second.hash != before)
+                changed.push_back(entry.first);
+        }
+        return changed;
+    }
+    // whether the program rooted at path reads any of the changed files
+    bool dependsOn(const std::string &path, const std::vector<std::string> &changed)
+    {
+        if (changed.empty())
+            return false;
+        for (const std::string &dependency : dependencies(path))
+            if (std::find(changed.begin(), changed.end(), dependency) != changed.end())
+                return true;
+        return false;
+    }
+
+private:
+    struct Chunk
+    {
+        std::string text;    // lines up to the next include
+        std::string include; // resolved path, empty for the last chunk
+        int includeLine = 0; // line of the #include, 1 based
+    };
+    struct File
+    {
+        bool ok = false;
+        std::filesystem::file_time_type time;
+        uint64_t hash = 0;
+        std::vector<Chunk> chunks;
+    };
+    std::map<std::string, File> files;
+
+    // path and every file it pulls in, in expansion order
+    std::vector<std::string> dependencies(const std::string &path)
+    {
+        std::vector<std::string> order, stack;
+        std::string out;
+        expandFile(normalize(path), out, order, stack);
+        return order;
+    }
+    static std::string normalize(const std::string &path)
+    {
+        return std::filesystem::path(path).lexically_normal().generic_string();
+    }
+    const File &load(const std::string &path)
+    {
+        auto found = files.find(path);
+        if (found == files.end())
+            found = files.emplace(path, parse(path)).first;
+        return found->second;
+    }
+    static File parse(const std::string &path)
+    {
+        File file;
+        std::error_code ec;
+        file.time = std::filesystem::last_write_time(path, ec);
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return file;
+        }
+        std::stringstream stream;
+        stream << in.rdbuf();
+        std::string source = stream.str();
+        file.ok = true;
+        file.hash = hashBytes(source.data(), source.size());
+
+        std::string directory = std::filesystem::path(path).parent_path().generic_string();
+        file.chunks.push_back(Chunk());
+        std::istringstream lines(source);
+        std::string line;
+        int number = 0;
+        while (std::getline(lines, line))
+        {
+            number++;
+            std::string target;
+            if (parseInclude(line, target))
+            {
+                Chunk &chunk = file.chunks.back();
+                chunk.include = normalize((std::filesystem::path(directory) / target).string());
+                chunk.includeLine = number;
+                file.chunks.push_back(Chunk());
+            }
+            else
+            {
+                file.chunks.back().text += line + "\n";
+            }
+        }
+        return file;
+    }
+    // matches   #include "target"   with any spacing
+    static bool parseInclude(const std::string &line, std::string &target)
+    {
+        size_t i = line.find_first_not_of(" \t");
+        if (i == std::string::npos || line[i] != '#')
+            return false;
+        i = line.find_first_not_of(" \t", i + 1);
+        if (i == std::string::npos || line.compare(i, 7, "include") != 0)
+            return false;
+        size_t open = line.find('"', i + 7);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos)
+            return false;
+        target = line.substr(open + 1, close - open - 1);
+        return true;
+    }
+    bool expandFile(const std::string &path, std::string &out, std::vector<std::string> &order, std::vector<std::string> &stack)
+    {
+        if (std::find(stack.begin(), stack.end(), path) != stack.end())
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_CYCLE: " << path << std::endl;
+            return false;
+        }
+        // already pasted into this program
+        if (std::find(order.begin(), order.end(), path) != order.end())
+            return true;
+        const File &file = load(path);
+        if (!file.ok)
+            return false;
+        int index = (int)order.size();
+        order.push_back(path);
+        stack.push_back(path);
+        int line = 1;
+        bool ok = true;
+        for (const Chunk &chunk : file.chunks)
+        {
+            // the root's first line is #version, which must come first
+            if (line > 1 || index > 0)
+                out += "#line " + std::to_string(line) + " " + std::to_string(index) + "\n";
+            out += chunk.text;
+            if (chunk.include.empty())
+                continue;
+            ok = expandFile(chunk.include, out, order, stack) && ok;
+            line = chunk.includeLine + 1;
+        }
+        stack.pop_back();
+        return ok;
+    }
+};
+#endif
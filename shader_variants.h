@@ -0,0 +1,151 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "program_cache.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// compile-time permutations of one vertex/fragment pair
+// options become #defines instead of uniforms branched on in every fragment:
+// feature bits define NAME when set, counts define NAME as a small number.
+// a variant is compiled the first time it's asked for and kept in a table keyed
+// by its option values; prewarm() queues the ones a scene will need at load
+// time so get() never has to stall a frame on the compiler.
+// ---------------------------------------------------------------------------
+class ShaderVariants
+{
+public:
+    // a set of option values; build it with set() and setCount()
+    typedef uint64_t Key;
+    static const int MAX_FEATURES = 32;
+    static const int MAX_COUNTS = 8;
+    static const int MAX_COUNT_VALUE = 15;
+
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath, ProgramCache *cache = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), cache(cache)
+    {
+    }
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+    // register the options up front; each returns the index for set/setCount
+    int addFeature(const std::string &define)
+    {
+        if ((int)features.size() >= MAX_FEATURES)
+        {
+            std::cout << "ERROR::SHADER_VARIANTS::TOO_MANY_FEATURES: " << define << std::endl;
+            return -1;
+        }
+        features.push_back(define);
+        return (int)features.size() - 1;
+    }
+    int addCount(const std::string &define)
+    {
+        if ((int)counts.size() >= MAX_COUNTS)
+        {
+            std::cout << "ERROR::SHADER_VARIANTS::TOO_MANY_COUNTS: " << define << std::endl;
+            return -1;
+        }
+        counts.push_back(define);
+        return (int)counts.size() - 1;
+    }
+    static Key set(Key key, int feature, bool on = true)
+    {
+        if (feature < 0)
+            return key;
+        return on ? key | (1ull << feature) : key & ~(1ull << feature);
+    }
+    // counts are clamped to 0..MAX_COUNT_VALUE
+    static Key setCount(Key key, int count, int value)
+    {
+        if (count < 0)
+            return key;
+        int shift = MAX_FEATURES + count * 4;
+        value = value < 0 ? 0 : value > MAX_COUNT_VALUE ? MAX_COUNT_VALUE : value;
+        return (key & ~(0xFull << shift)) | ((Key)value << shift);
+    }
+    // the #define block a variant is compiled with
+    std::string defines(Key key) const
+    {
+        std::string block;
+        for (int i = 0; i < (int)features.size(); i++)
+            if (key & (1ull << i))
+                block += "#define " + features[i] + "\n";
+        for (int i = 0; i < (int)counts.size(); i++)
+            block += "#define " + counts[i] + " " + std::to_string((key >> (MAX_FEATURES + i * 4)) & 0xF) + "\n";
+        return block;
+    }
+    // queue a variant's compile without waiting for it
+    void prewarm(Key key)
+    {
+        if (!variants.count(key))
+            variants[key] = compile(key, false);
+    }
+    // true once every variant compiled so far is ready to draw with
+    bool poll()
+    {
+        bool all = true;
+        for (auto &variant : variants)
+            all = variant.second->ready() && all;
+        return all;
+    }
+    // the variant for key, compiling it now if it wasn't prewarmed
+    // ------------------------------------------------------------------------
+    Shader &get(Key key)
+    {
+        auto found = variants.find(key);
+        if (found == variants.end())
+        {
+            lazyCompiles++;
+            found = variants.emplace(key, compile(key, true)).first;
+        }
+        found->second->finish();
+        return *found->second;
+    }
+    int variantCount() const
+    {
+        return (int)variants.size();
+    }
+    // variants that weren't prewarmed and had to be compiled on first use
+    int lazyCompileCount() const
+    {
+        return lazyCompiles;
+    }
+    // rebuild the variants that read any of the changed files (from
+    // ShaderSources::poll); returns how many were rebuilt
+    int reloadChanged(const std::vector<std::string> &changed)
+    {
+        int reloaded = 0;
+        for (auto &variant : variants)
+            if (variant.second->dependsOn(changed) && variant.second->reload())
+                reloaded++;
+        return reloaded;
+    }
+    // delete every program; call while the context is still current
+    void release()
+    {
+        for (auto &variant : variants)
+            glDeleteProgram(variant.second->ID);
+        variants.clear();
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    ProgramCache *cache;
+    std::vector<std::string> features;
+    std::vector<std::string> counts;
+    std::map<Key, std::unique_ptr<Shader>> variants;
+    int lazyCompiles = 0;
+
+    std::unique_ptr<Shader> compile(Key key, bool wait)
+    {
+        return std::unique_ptr<Shader>(new Shader(vertexPath.c_str(), fragmentPath.c_str(), cache, wait, defines(key)));
+    }
+};
+#endif
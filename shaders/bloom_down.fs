@@ -0,0 +1,41 @@
+#version 330 core
+// dual filter downsample, see bloom.h: the center and four diagonal taps one
+// source texel out, each bilinear tap averaging a 2x2 block
+out vec4 FragColor;
+
+uniform sampler2D source;
+// the last coordinate inside the part of the source this frame drew
+uniform vec2 sourceMax;
+// brightness kept from the scene on the first step; negative keeps everything
+uniform float threshold;
+
+vec3 Tap(vec2 uv)
+{
+    return texture(source, min(uv, sourceMax)).rgb;
+}
+
+// soft knee cut: ramps in over half the threshold instead of a hard step
+vec3 Prefilter(vec3 color)
+{
+    float brightness = max(color.r, max(color.g, color.b));
+    float knee = threshold * 0.5;
+    float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 1e-4);
+    return color * max(soft, brightness - threshold) / max(brightness, 1e-4);
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    // this level is half the source, so its pixel centers sit on source texel corners
+    vec2 uv = gl_FragCoord.xy * 2.0 * texel;
+    vec3 sum = Tap(uv) * 4.0;
+    sum += Tap(uv + vec2(-texel.x, -texel.y));
+    sum += Tap(uv + vec2(texel.x, -texel.y));
+    sum += Tap(uv + vec2(-texel.x, texel.y));
+    sum += Tap(uv + vec2(texel.x, texel.y));
+    vec3 color = sum / 8.0;
+    if (threshold >= 0.0)
+        color = Prefilter(color);
+    FragColor = vec4(color, 1.0);
+}
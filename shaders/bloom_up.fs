@@ -0,0 +1,30 @@
+#version 330 core
+// dual filter upsample, see bloom.h: a tent of eight taps around the pixel,
+// added onto the level being drawn
+out vec4 FragColor;
+
+uniform sampler2D source;
+// the last coordinate inside the part of the source this frame drew
+uniform vec2 sourceMax;
+
+vec3 Tap(vec2 uv)
+{
+    return texture(source, min(uv, sourceMax)).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    // this level is twice the source
+    vec2 uv = gl_FragCoord.xy * 0.5 * texel;
+    vec2 h = texel * 0.5;
+    vec3 sum = Tap(uv + vec2(-2.0 * h.x, 0.0));
+    sum += Tap(uv + vec2(2.0 * h.x, 0.0));
+    sum += Tap(uv + vec2(0.0, -2.0 * h.y));
+    sum += Tap(uv + vec2(0.0, 2.0 * h.y));
+    sum += Tap(uv + vec2(-h.x, -h.y)) * 2.0;
+    sum += Tap(uv + vec2(h.x, -h.y)) * 2.0;
+    sum += Tap(uv + vec2(-h.x, h.y)) * 2.0;
+    sum += Tap(uv + vec2(h.x, h.y)) * 2.0;
+    FragColor = vec4(sum / 12.0, 1.0);
+}
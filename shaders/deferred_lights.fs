@@ -0,0 +1,73 @@
+#version 330 core
+out vec4 FragColor;
+
+// the lights that reach every pixel, applied in one fullscreen pass
+#ifndef NR_DIR_LIGHTS
+#define NR_DIR_LIGHTS 1
+#endif
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 1
+#endif
+// DIR_SHADOWS: cascaded shadow map for the first directional light
+// POINT_SHADOWS: cached cube shadow maps for the point lights
+// LIGHTMAP: gbuffer.fs wrote the first directional light's diffuse and
+// ambient, baked; only its specular is added here
+// PROBE_GRID: the probe grid's irradiance replaces the lights' ambient terms
+// SSAO: ambient terms are scaled by the screen-space occlusion
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+#ifdef DIR_SHADOWS
+#include "shadows.glsl"
+#endif
+#if defined(POINT_SHADOWS) && NR_POINT_LIGHTS > 0
+#include "point_shadows.glsl"
+#endif
+#ifdef PROBE_GRID
+#include "probe_grid.glsl"
+#endif
+
+uniform vec3 viewPos;
+#if NR_DIR_LIGHTS > 0
+uniform DirLight dirLights[NR_DIR_LIGHTS];
+#endif
+#if NR_POINT_LIGHTS > 0
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
+
+void main()
+{
+    Surface s;
+    if (!ReadSurface(ivec2(gl_FragCoord.xy), s))
+        discard;
+    vec3 viewDir = normalize(viewPos - s.position);
+
+    vec3 result = vec3(0.0);
+#ifdef PROBE_GRID
+    result += s.albedo * ProbeIrradiance(s.position, s.normal) * AmbientOcclusion();
+#endif
+#if NR_DIR_LIGHTS > 0
+    float dirShadow = 1.0;
+#ifdef DIR_SHADOWS
+    dirShadow = DirShadow(s.position, s.normal);
+#endif
+#ifdef LIGHTMAP
+    result += CalcDirSpecular(dirLights[0], s.normal, viewDir, s.specular, s.shininess, dirShadow);
+    for (int i = 1; i < NR_DIR_LIGHTS; i++)
+#else
+    for (int i = 0; i < NR_DIR_LIGHTS; i++)
+#endif
+        result += CalcDirLight(dirLights[i], s.normal, viewDir, s.albedo, s.specular, s.shininess, i == 0 ? dirShadow : 1.0);
+#endif
+#if NR_POINT_LIGHTS > 0
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        float shadow = 1.0;
+#ifdef POINT_SHADOWS
+        shadow = PointShadow(i, pointLights[i].position, s.position, s.normal);
+#endif
+        result += CalcPointLight(pointLights[i], s.normal, s.position, viewDir, s.albedo, s.specular, s.shininess, shadow);
+    }
+#endif
+    FragColor = vec4(result, 1.0);
+}
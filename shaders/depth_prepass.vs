@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance
+layout (location = 3) in mat4 aModel;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// the color pass tests GL_EQUAL against this depth, so the position must be
+// computed exactly as materialVertShader.vs does
+invariant gl_Position;
+
+void main()
+{
+    vec3 FragPos = vec3(aModel * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
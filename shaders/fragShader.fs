@@ -1,43 +1,61 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-    sampler2D diffuse;
-    sampler2D specular;    
-    sampler2D emmision;
-    float shininess;
-}; 
+// compile-time options (see shader_variants.h); defaults match the demo scene
+#ifndef NR_DIR_LIGHTS
+#define NR_DIR_LIGHTS 1
+#endif
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 1
+#endif
+// HAS_EMMISION: add the emmision map
+// CLUSTERED_LIGHTS: add the lights binned by light_clusters.h
+// DIR_SHADOWS: cascaded shadow map for the first directional light
+// POINT_SHADOWS: cached cube shadow maps for the point lights
+// LIGHTMAP: the first directional light's diffuse and ambient, bounces
+// included, come from the baked lightmap
+// PROBE_GRID: the probe grid's irradiance replaces the lights' ambient terms
+// SSAO: ambient terms are scaled by the screen-space occlusion
 
-struct DirLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
+#include "material.glsl"
+#include "lighting.glsl"
+#ifdef DIR_SHADOWS
+#include "shadows.glsl"
+#endif
+#if defined(POINT_SHADOWS) && NR_POINT_LIGHTS > 0
+#include "point_shadows.glsl"
+#endif
+#ifdef LIGHTMAP
+#include "lightmap.glsl"
+#endif
+#ifdef PROBE_GRID
+#include "probe_grid.glsl"
+#endif
 
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
+flat in int MaterialIndex;
+in vec2 LightmapUV;
   
 uniform vec3 viewPos;
-uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLight;
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+#if NR_DIR_LIGHTS > 0
+uniform DirLight dirLights[NR_DIR_LIGHTS];
+#endif
+#if NR_POINT_LIGHTS > 0
+uniform PointLight pointLights[NR_POINT_LIGHTS];
+#endif
+#ifdef CLUSTERED_LIGHTS
+uniform mat4 view;
+// (offset, count) into clusterIndices per cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+// two texels per light: position and radius, then color
+uniform samplerBuffer clusterLights;
+// tiles per pixel in x and y, depth slices per log unit of depth, near plane
+uniform vec4 clusterParams;
+uniform ivec3 clusterDims;
+#endif
 
 void main()
 {
@@ -45,51 +63,63 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
 
+    // every light shares one sample of each map
+    vec3 diffuseColor = SampleMap(material.diffuse, materialLayers[MaterialIndex].x, TexCoords);
+    vec3 specularColor = SampleMap(material.specular, materialLayers[MaterialIndex].y, TexCoords);
+
+    vec3 result = vec3(0.0);
+#ifdef PROBE_GRID
+    result += diffuseColor * ProbeIrradiance(FragPos, norm) * AmbientOcclusion();
+#endif
     // dir lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    result += CalcPointLight(pointLight, norm, FragPos, viewDir);
+#if NR_DIR_LIGHTS > 0
+    float dirShadow = 1.0;
+#ifdef DIR_SHADOWS
+    dirShadow = DirShadow(FragPos, norm);
+#endif
+#ifdef LIGHTMAP
+    // the bake already shadowed the diffuse light; only specular is live
+    result += diffuseColor * BakedLight(LightmapUV);
+    result += CalcDirSpecular(dirLights[0], norm, viewDir, specularColor, material.shininess, dirShadow);
+    for (int i = 1; i < NR_DIR_LIGHTS; i++)
+#else
+    for (int i = 0; i < NR_DIR_LIGHTS; i++)
+#endif
+        result += CalcDirLight(dirLights[i], norm, viewDir, diffuseColor, specularColor, material.shininess, i == 0 ? dirShadow : 1.0);
+#endif
+    // point lights
+#if NR_POINT_LIGHTS > 0
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        float shadow = 1.0;
+#ifdef POINT_SHADOWS
+        shadow = PointShadow(i, pointLights[i].position, FragPos, norm);
+#endif
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, diffuseColor, specularColor, material.shininess, shadow);
+    }
+#endif
+#ifdef CLUSTERED_LIGHTS
+    // only the lights binned into this fragment's cluster
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(log(depth / clusterParams.w) * clusterParams.z), 0, clusterDims.z - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy), clusterDims.xy - 1);
+    uvec2 range = texelFetch(clusterGrid, (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x).rg;
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, light * 2);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb;
+        result += CalcRangedLight(positionRadius.xyz, positionRadius.w, color, norm, FragPos, viewDir, diffuseColor, specularColor, material.shininess);
+    }
+#endif
 
+#ifdef HAS_EMMISION
     // emmision
-    vec3 emmision = texture(material.emmision, TexCoords).rgb;
+    vec3 emmision = SampleMap(material.emmision, materialLayers[MaterialIndex].z, TexCoords);
     // lower emmisive strength
     emmision *= 0.8;
     result += emmision;
+#endif
 
     FragColor = vec4(result, 1.0);
-} 
-
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    return (ambient+diffuse+specular);
 }
-
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear + distance + light.quadratic * (distance * distance));
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
\ No newline at end of file
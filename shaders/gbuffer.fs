@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gSpecular;
+layout (location = 2) out vec2 gNormal;
+layout (location = 3) out vec4 gLight;
+
+// HAS_EMMISION: write the emmision map into the light buffer
+// LIGHTMAP: add the baked light, deferred_lights.fs then skips it
+
+#include "material.glsl"
+#include "gbuffer.glsl"
+#ifdef LIGHTMAP
+#include "lightmap.glsl"
+#endif
+
+in vec3 FragPos;  
+in vec3 Normal;  
+in vec2 TexCoords;
+flat in int MaterialIndex;
+in vec2 LightmapUV;
+
+void main()
+{
+    gAlbedo = vec4(SampleMap(material.diffuse, materialLayers[MaterialIndex].x, TexCoords), 1.0);
+    gSpecular = vec4(SampleMap(material.specular, materialLayers[MaterialIndex].y, TexCoords), material.shininess / 255.0);
+    gNormal = EncodeNormal(normalize(Normal));
+#ifdef HAS_EMMISION
+    // lower emmisive strength, as in fragShader.fs
+    gLight = vec4(SampleMap(material.emmision, materialLayers[MaterialIndex].z, TexCoords) * 0.8, 1.0);
+#else
+    gLight = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+#ifdef LIGHTMAP
+    gLight.rgb += gAlbedo.rgb * BakedLight(LightmapUV);
+#endif
+}
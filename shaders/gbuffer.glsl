@@ -0,0 +1,62 @@
+// G-buffer layout, written by gbuffer.fs and read by the deferred light passes
+//   albedo    RGBA8   diffuse color
+//   specular  RGBA8   specular color, shininess / 255 in alpha
+//   normal    RG16    octahedral encoded world space normal
+//   depth     D24S8   world position is rebuilt from it
+// emmision goes straight into the light buffer the light passes add to
+
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferSpecular;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferDepth;
+uniform mat4 inverseViewProjection;
+// the part of the targets the scene covers, from their lower left corner
+uniform vec2 gbufferSize;
+
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 albedo;
+    vec3 specular;
+    float shininess;
+};
+
+// unit vectors folded onto an octahedron and its lower half unfolded over the
+// corners of the square, so two 16 bit channels hold a normal
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return e * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// the surface under a pixel; false where nothing was drawn
+bool ReadSurface(ivec2 pixel, out Surface surface)
+{
+    float depth = texelFetch(gbufferDepth, pixel, 0).r;
+    if (depth == 1.0)
+        return false;
+    vec2 uv = (vec2(pixel) + 0.5) / gbufferSize;
+    vec4 position = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    surface.position = position.xyz / position.w;
+    surface.normal = DecodeNormal(texelFetch(gbufferNormal, pixel, 0).rg);
+    surface.albedo = texelFetch(gbufferAlbedo, pixel, 0).rgb;
+    vec4 specular = texelFetch(gbufferSpecular, pixel, 0);
+    surface.specular = specular.rgb;
+    surface.shininess = specular.a * 255.0;
+    return true;
+}
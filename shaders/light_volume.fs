@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+// one ranged light, drawn as its bounding volume over the pixels it may reach
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+flat in vec4 LightPositionRadius;
+flat in vec3 LightColor;
+
+uniform vec3 viewPos;
+
+void main()
+{
+    Surface s;
+    if (!ReadSurface(ivec2(gl_FragCoord.xy), s))
+        discard;
+    // the volume's back faces only reject surfaces behind it
+    vec3 toLight = LightPositionRadius.xyz - s.position;
+    if (dot(toLight, toLight) >= LightPositionRadius.w * LightPositionRadius.w)
+        discard;
+    vec3 viewDir = normalize(viewPos - s.position);
+    FragColor = vec4(CalcRangedLight(LightPositionRadius.xyz, LightPositionRadius.w, LightColor, s.normal, s.position, viewDir,
+                                     s.albedo, s.specular, s.shininess), 1.0);
+}
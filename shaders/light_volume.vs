@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance
+layout (location = 1) in vec4 aPositionRadius;
+layout (location = 2) in vec3 aColor;
+
+flat out vec4 LightPositionRadius;
+flat out vec3 LightColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    LightPositionRadius = aPositionRadius;
+    LightColor = aColor;
+    // the mesh encloses the unit sphere
+    gl_Position = projection * view * vec4(aPositionRadius.xyz + aPos * aPositionRadius.w, 1.0);
+}
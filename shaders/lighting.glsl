@@ -0,0 +1,112 @@
+// light types and their Phong terms, shared by the lighting shaders
+// surface colors are passed in already sampled, so callers decide where they
+// come from and sample them once for all lights
+// PROBE_GRID: the probes stand in for the constant ambient terms, so they're
+// left out here and the caller adds ProbeIrradiance once
+// SSAO: ambient light is scaled by the screen-space occlusion (ssao.h)
+
+#ifdef SSAO
+uniform sampler2D ambientOcclusion;
+// how much ambient light reaches this pixel, from the scene sized occlusion
+float AmbientOcclusion()
+{
+    ivec2 texel = min(ivec2(gl_FragCoord.xy), textureSize(ambientOcclusion, 0) - 1);
+    return texelFetch(ambientOcclusion, texel, 0).r;
+}
+#else
+float AmbientOcclusion()
+{
+    return 1.0;
+}
+#endif
+
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// shadow is the fraction of the light that isn't blocked; ambient ignores it
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // combine results
+#ifdef PROBE_GRID
+    vec3 ambient = vec3(0.0);
+#else
+    vec3 ambient = light.ambient * diffuseColor * AmbientOcclusion();
+#endif
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    return (ambient + shadow * (diffuse + specular));
+}
+
+// the specular part of CalcDirLight alone, for surfaces whose diffuse light
+// comes from the lightmap
+vec3 CalcDirSpecular(DirLight light, vec3 normal, vec3 viewDir, vec3 specularColor, float shininess, float shadow)
+{
+    vec3 reflectDir = reflect(normalize(light.direction), normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    return shadow * light.specular * spec * specularColor;
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess, float shadow)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear + distance + light.quadratic * (distance * distance));
+    // combine results
+#ifdef PROBE_GRID
+    vec3 ambient = vec3(0.0);
+#else
+    vec3 ambient = light.ambient * diffuseColor * AmbientOcclusion();
+#endif
+    vec3 diffuse = light.diffuse * diff * diffuseColor;
+    vec3 specular = light.specular * spec * specularColor;
+    ambient *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
+    return (ambient + diffuse + specular);
+}
+
+// a point light that fades out completely at its radius, so it can be binned
+// into clusters: inverse square falloff windowed to reach zero at the edge
+vec3 CalcRangedLight(vec3 position, float radius, vec3 color, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+    vec3 toLight = position - fragPos;
+    float distance = length(toLight);
+    vec3 lightDir = toLight / max(distance, 1e-4);
+    // diffuse shading
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular shading
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    // attenuation
+    float window = clamp(1.0 - pow(distance / radius, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (1.0 + distance * distance);
+    return color * attenuation * (diff * diffuseColor + spec * specularColor);
+}
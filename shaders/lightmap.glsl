@@ -0,0 +1,9 @@
+// baked lighting, see lightmap.h: the first directional light's diffuse
+// light, shadowed, plus what reaches a surface from bounces and the sky
+
+uniform sampler2D lightmap;
+
+vec3 BakedLight(vec2 uv)
+{
+    return texture(lightmap, uv).rgb;
+}
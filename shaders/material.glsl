@@ -0,0 +1,22 @@
+// material maps, shared by the forward and G-buffer shaders
+// maps are layers of texture arrays; which layers is per material
+struct Material {
+    sampler2DArray diffuse;
+    sampler2DArray specular;    
+    sampler2DArray emmision;
+    float shininess;
+}; 
+
+uniform Material material;
+// diffuse, specular and emmision layer of every material, -1 for no map
+uniform ivec4 materialLayers[64];
+// added to every map's mip level; negative when a smaller scene is upscaled
+// temporally, so the maps keep the detail of the output resolution
+uniform float materialLodBias;
+
+vec3 SampleMap(sampler2DArray map, int layer, vec2 uv)
+{
+    if (layer < 0)
+        return vec3(0.0);
+    return texture(map, vec3(uv, float(layer)), materialLodBias).rgb;
+}
@@ -0,0 +1,33 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per instance
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in int aMaterial;
+// lightmap.h: the mesh's lightmap UVs and the instance's tile of the atlas
+layout (location = 8) in vec2 aLightmapUV;
+layout (location = 9) in vec4 aLightmapScaleOffset;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;
+flat out int MaterialIndex;
+out vec2 LightmapUV;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// matches depth_prepass.vs, so the depth pre-pass can be tested for equality
+invariant gl_Position;
+
+void main()
+{
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    // models only rotate, translate and scale uniformly
+    Normal = mat3(aModel) * aNormal;
+    TexCoords = aTexCoords;
+    MaterialIndex = aMaterial;
+    LightmapUV = aLightmapUV * aLightmapScaleOffset.xy + aLightmapScaleOffset.zw;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// every shaded fragment adds one step; eight fragments on a pixel is white
+void main()
+{
+    FragColor = vec4(vec3(0.125), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+// the font atlas, or a white texel for untextured shapes
+uniform sampler2D atlas;
+
+void main()
+{
+    FragColor = Color * texture(atlas, TexCoords);
+}
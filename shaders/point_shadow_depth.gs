@@ -0,0 +1,38 @@
+#version 330 core
+// draws each triangle into the six faces of one point light's shadow map in
+// a single pass, skipping the faces it can't touch
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 faceMatrices[6];
+// the light's first layer in the shadow atlas
+uniform int firstLayer;
+
+bool Outside(vec4 a, vec4 b, vec4 c)
+{
+    return (a.x < -a.w && b.x < -b.w && c.x < -c.w) || (a.x > a.w && b.x > b.w && c.x > c.w) ||
+           (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w) ||
+           (a.z < -a.w && b.z < -b.w && c.z < -c.w);
+}
+
+void main()
+{
+    for (int face = 0; face < 6; face++)
+    {
+        vec4 a = faceMatrices[face] * gl_in[0].gl_Position;
+        vec4 b = faceMatrices[face] * gl_in[1].gl_Position;
+        vec4 c = faceMatrices[face] * gl_in[2].gl_Position;
+        if (Outside(a, b, c))
+            continue;
+        gl_Layer = firstLayer + face;
+        gl_Position = a;
+        EmitVertex();
+        gl_Layer = firstLayer + face;
+        gl_Position = b;
+        EmitVertex();
+        gl_Layer = firstLayer + face;
+        gl_Position = c;
+        EmitVertex();
+        EndPrimitive();
+    }
+}
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance
+layout (location = 3) in mat4 aModel;
+
+void main()
+{
+    // world space; the geometry shader projects once per cube face
+    gl_Position = aModel * vec4(aPos, 1.0);
+}
@@ -0,0 +1,41 @@
+// omnidirectional shadows of the point lights, see point_shadows.h
+// each shadowed light owns six layers of the atlas, one per cube face in the
+// order +x, -x, +y, -y, +z, -z, each a 90 degree perspective view from the
+// light. NR_POINT_LIGHTS must be defined before this is included
+
+uniform sampler2DArrayShadow pointShadowMap;
+// per point light: atlas slot + 1 (0 for no shadow), near and far plane
+uniform vec4 pointShadowParams[NR_POINT_LIGHTS];
+
+// right, up and forward of each face's view, as built in point_shadows.h
+const vec3 pointShadowRight[6] = vec3[6](vec3(0, 0, -1), vec3(0, 0, 1), vec3(1, 0, 0), vec3(1, 0, 0), vec3(1, 0, 0), vec3(-1, 0, 0));
+const vec3 pointShadowUp[6] = vec3[6](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+const vec3 pointShadowForward[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+
+// fraction of point light 'light' reaching position
+float PointShadow(int light, vec3 lightPosition, vec3 position, vec3 normal)
+{
+    vec4 params = pointShadowParams[light];
+    if (params.x < 0.5)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(pointShadowMap, 0).xy);
+    vec3 toSurface = position - lightPosition;
+    // look up a little off the surface, by about a texel at this distance
+    float major = max(abs(toSurface.x), max(abs(toSurface.y), abs(toSurface.z)));
+    toSurface += normal * (3.0 * major * texel.x);
+    vec3 a = abs(toSurface);
+    int face = a.x >= a.y && a.x >= a.z ? (toSurface.x >= 0.0 ? 0 : 1) : a.y >= a.z ? (toSurface.y >= 0.0 ? 2 : 3) : (toSurface.z >= 0.0 ? 4 : 5);
+    float distance = dot(pointShadowForward[face], toSurface);
+    vec2 uv = vec2(dot(pointShadowRight[face], toSurface), dot(pointShadowUp[face], toSurface)) / distance * 0.5 + 0.5;
+    uv = clamp(uv, 0.5 * texel, 1.0 - 0.5 * texel);
+    // the depth a perspective projection with these planes would store
+    float near = params.y, far = params.z;
+    float depth = clamp(0.5 * ((far + near) / (far - near) - 2.0 * far * near / ((far - near) * distance)) + 0.5, 0.0, 1.0);
+    float layer = (params.x - 1.0) * 6.0 + float(face);
+    float lit = 0.0;
+    lit += texture(pointShadowMap, vec4(uv + vec2(-0.5, -0.5) * texel, layer, depth));
+    lit += texture(pointShadowMap, vec4(uv + vec2(0.5, -0.5) * texel, layer, depth));
+    lit += texture(pointShadowMap, vec4(uv + vec2(-0.5, 0.5) * texel, layer, depth));
+    lit += texture(pointShadowMap, vec4(uv + vec2(0.5, 0.5) * texel, layer, depth));
+    return lit * 0.25;
+}
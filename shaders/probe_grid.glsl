@@ -0,0 +1,34 @@
+// irradiance from the probe grid, see probe_grid.h
+// each probe holds L2 spherical harmonics of the irradiance around it,
+// already divided by pi: 9 RGB coefficients in 7 RGBA slabs stacked along z
+
+uniform sampler3D probeGrid;
+uniform vec3 probeGridMin;
+uniform vec3 probeGridMax;
+uniform ivec3 probeGridDims;
+
+// light arriving at a surface facing normal, to be multiplied by its albedo
+vec3 ProbeIrradiance(vec3 position, vec3 normal)
+{
+    vec3 dims = vec3(probeGridDims);
+    // probe space, nudged off the surface so it leans on the probes in front
+    vec3 cell = (position - probeGridMin) / (probeGridMax - probeGridMin) * (dims - 1.0);
+    cell = clamp(cell + normal * 0.25, vec3(0.0), dims - 1.0);
+    // texel centers; z stays within its slab so the filter never crosses into the next
+    vec2 xy = (cell.xy + 0.5) / dims.xy;
+    float depth = dims.z * 7.0;
+    vec4 c[7];
+    for (int i = 0; i < 7; i++)
+        c[i] = texture(probeGrid, vec3(xy, (cell.z + 0.5 + float(i) * dims.z) / depth));
+    vec3 n = normal;
+    vec3 result = c[0].rgb * 0.282095;
+    result += vec3(c[0].a, c[1].rg) * 0.488603 * n.y;
+    result += vec3(c[1].ba, c[2].r) * 0.488603 * n.z;
+    result += c[2].gba * 0.488603 * n.x;
+    result += c[3].rgb * 1.092548 * n.x * n.y;
+    result += vec3(c[3].a, c[4].rg) * 1.092548 * n.y * n.z;
+    result += vec3(c[4].ba, c[5].r) * 0.315392 * (3.0 * n.z * n.z - 1.0);
+    result += c[5].gba * 1.092548 * n.x * n.z;
+    result += c[6].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(result, 0.0);
+}
@@ -0,0 +1,36 @@
+// cascaded shadow map of the first directional light, see shadow_cascades.h
+// each cascade's matrix maps world space straight to shadow map coordinates
+// (0 to 1); the first cascade whose square holds the point is used
+
+#define MAX_CASCADES 4
+
+uniform sampler2DArrayShadow cascadeShadowMap;
+uniform mat4 cascadeMatrices[MAX_CASCADES];
+// world size of one shadow map texel, per cascade
+uniform vec4 cascadeTexelSizes;
+uniform int cascadeCount;
+
+// fraction of the light reaching position, 1 outside every cascade
+float DirShadow(vec3 position, vec3 normal)
+{
+    vec2 texel = 1.0 / vec2(textureSize(cascadeShadowMap, 0).xy);
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        // look up a little off the surface, against acne on sloped faces
+        vec3 offsetPosition = position + normal * cascadeTexelSizes[i] * 1.5;
+        vec3 coord = (cascadeMatrices[i] * vec4(offsetPosition, 1.0)).xyz;
+        if (any(lessThan(coord.xy, texel)) || any(greaterThan(coord.xy, 1.0 - texel)))
+            continue;
+        // in front of every caster is lit, behind all of them compares against
+        // whatever was drawn
+        float depth = clamp(coord.z, 0.0, 1.0);
+        // four bilinear compares cover a 3x3 texel footprint
+        float lit = 0.0;
+        lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(-0.5, -0.5) * texel, float(i), depth));
+        lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(0.5, -0.5) * texel, float(i), depth));
+        lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(-0.5, 0.5) * texel, float(i), depth));
+        lit += texture(cascadeShadowMap, vec4(coord.xy + vec2(0.5, 0.5) * texel, float(i), depth));
+        return lit * 0.25;
+    }
+    return 1.0;
+}
@@ -0,0 +1,76 @@
+#version 330 core
+// ssao, see ssao.h: occlusion of one half size pixel from a hemisphere of
+// samples around its normal, rotated by a per pixel angle
+out vec4 FragColor;
+
+#include "ssao.glsl"
+
+uniform sampler2D linearDepth;
+// the part of it this frame drew, from the lower left corner
+uniform vec2 halfSize;
+uniform int samples;
+// kernel radius in world units, and the power the result is raised to
+uniform float radius;
+uniform float intensity;
+
+vec3 PositionAt(ivec2 texel, vec2 size)
+{
+    texel = clamp(texel, ivec2(0), ivec2(size) - 1);
+    return ViewPosition((vec2(texel) + 0.5) / size, texelFetch(linearDepth, texel, 0).r);
+}
+
+// Jimenez's interleaved gradient noise: neighbouring pixels get well spread
+// angles, which the blur then averages out
+float InterleavedGradientNoise(vec2 pixel)
+{
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+void main()
+{
+    vec2 size = halfSize;
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float distance = texelFetch(linearDepth, texel, 0).r;
+    if (distance > 1e3)
+    {
+        FragColor = vec4(1.0);
+        return;
+    }
+    vec3 position = ViewPosition((vec2(texel) + 0.5) / size, distance);
+    // the normal from the neighbours on the same surface: the closer in depth
+    // of each pair, so edges don't bend it
+    vec3 left = position - PositionAt(texel - ivec2(1, 0), size);
+    vec3 right = PositionAt(texel + ivec2(1, 0), size) - position;
+    vec3 down = position - PositionAt(texel - ivec2(0, 1), size);
+    vec3 up = PositionAt(texel + ivec2(0, 1), size) - position;
+    vec3 dx = abs(left.z) < abs(right.z) ? left : right;
+    vec3 dy = abs(down.z) < abs(up.z) ? down : up;
+    vec3 normal = normalize(cross(dx, dy));
+
+    // a tangent frame turned by this pixel's angle
+    float angle = 6.2831853 * InterleavedGradientNoise(gl_FragCoord.xy);
+    vec3 helper = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(helper, normal));
+    vec3 bitangent = cross(normal, tangent);
+    tangent = tangent * cos(angle) + bitangent * sin(angle);
+    bitangent = cross(normal, tangent);
+
+    float occlusion = 0.0;
+    for (int i = 0; i < samples; i++)
+    {
+        // a spiral over the hemisphere, cosine weighted, with more samples close in
+        float f = (float(i) + 0.5) / float(samples);
+        float phi = 2.3999632 * float(i);
+        float sinTheta = sqrt(f);
+        vec3 direction = (tangent * cos(phi) + bitangent * sin(phi)) * sinTheta + normal * sqrt(1.0 - f);
+        vec3 samplePosition = position + direction * radius * mix(0.1, 1.0, f * f);
+        vec4 clip = projection * vec4(samplePosition, 1.0);
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        ivec2 sampleTexel = clamp(ivec2(floor(uv * size)), ivec2(0), ivec2(size) - 1);
+        float sceneDistance = texelFetch(linearDepth, sampleTexel, 0).r;
+        // occluders much nearer the camera than the pixel don't count
+        float range = smoothstep(0.0, 1.0, radius / abs(distance - sceneDistance));
+        occlusion += sceneDistance < -samplePosition.z - 0.02 ? range : 0.0;
+    }
+    FragColor = vec4(pow(clamp(1.0 - occlusion / float(samples), 0.0, 1.0), intensity));
+}
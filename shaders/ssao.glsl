@@ -0,0 +1,18 @@
+// shared by the ssao passes, see ssao.h
+
+// the projection the scene was drawn with (jitter included)
+uniform mat4 projection;
+
+// distance in front of the camera for a depth buffer value
+float LinearDepth(float depth)
+{
+    return projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+}
+
+// view space position at uv (0 to 1 over the screen), distance in front
+vec3 ViewPosition(vec2 uv, float distance)
+{
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3((ndc.x + projection[2][0]) * distance / projection[0][0],
+                (ndc.y + projection[2][1]) * distance / projection[1][1], -distance);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+// ssao, see ssao.h: one direction of the blur, weighted down for texels at
+// other depths so occlusion doesn't bleed across edges
+out vec4 FragColor;
+
+uniform sampler2D occlusion;
+uniform sampler2D linearDepth;
+// the part of both this frame drew, from the lower left corner
+uniform vec2 halfSize;
+// (1, 0) or (0, 1), and the taps either side
+uniform vec2 direction;
+uniform int radius;
+
+void main()
+{
+    ivec2 size = ivec2(halfSize);
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float centerDistance = texelFetch(linearDepth, texel, 0).r;
+    float sum = 0.0, weights = 0.0;
+    float sigma = float(radius) * 0.5 + 0.5;
+    for (int i = -radius; i <= radius; i++)
+    {
+        ivec2 tap = clamp(texel + ivec2(direction * float(i)), ivec2(0), size - 1);
+        float distance = texelFetch(linearDepth, tap, 0).r;
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma)) * exp(-abs(distance - centerDistance) * 50.0 / centerDistance);
+        sum += texelFetch(occlusion, tap, 0).r * weight;
+        weights += weight;
+    }
+    FragColor = vec4(sum / weights);
+}
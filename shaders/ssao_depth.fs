@@ -0,0 +1,18 @@
+#version 330 core
+// ssao, see ssao.h: the scene's depth at half size, as linear view depth
+out vec4 FragColor;
+
+#include "ssao.glsl"
+
+uniform sampler2D sceneDepth;
+// the part of it the scene covers, from the lower left corner
+uniform vec2 sceneSize;
+
+void main()
+{
+    // one texel of each 2x2 block, so the upsample knows which one it was
+    ivec2 texel = min(ivec2(gl_FragCoord.xy) * 2, ivec2(sceneSize) - 1);
+    float depth = texelFetch(sceneDepth, texel, 0).r;
+    // nothing drawn: far enough that no kernel reaches it
+    FragColor = vec4(depth < 1.0 ? LinearDepth(depth) : 1e4, 0.0, 0.0, 1.0);
+}
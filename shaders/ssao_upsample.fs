@@ -0,0 +1,40 @@
+#version 330 core
+// ssao, see ssao.h: the blurred half size occlusion at the scene's size,
+// from the four nearest half size texels weighted by distance and by how
+// close their depth is to this pixel's
+out vec4 FragColor;
+
+#include "ssao.glsl"
+
+uniform sampler2D occlusion;
+uniform sampler2D linearDepth;
+uniform sampler2D sceneDepth;
+// the part of the half size targets this frame drew, from the lower left corner
+uniform vec2 halfSize;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(sceneDepth, texel, 0).r;
+    if (depth >= 1.0)
+    {
+        FragColor = vec4(1.0);
+        return;
+    }
+    float distance = LinearDepth(depth);
+    // half size texel i was read from full size texel 2i
+    vec2 position = vec2(texel) * 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    float sum = 0.0, weights = 0.0;
+    for (int y = 0; y <= 1; y++)
+        for (int x = 0; x <= 1; x++)
+        {
+            ivec2 tap = min(base + ivec2(x, y), ivec2(halfSize) - 1);
+            float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+            float weight = (bilinear + 1e-3) / (1e-3 + abs(texelFetch(linearDepth, tap, 0).r - distance));
+            sum += texelFetch(occlusion, tap, 0).r * weight;
+            weights += weight;
+        }
+    FragColor = vec4(sum / weights);
+}
@@ -0,0 +1,95 @@
+#version 330 core
+// temporal resolve, see temporal_resolve.h: one output pixel of the new history
+out vec4 FragColor;
+
+// this frame, rendered with the jittered projection at the scene's size
+uniform sampler2D currentColor;
+uniform sampler2D currentDepth;
+// last frame's result, at the output size
+uniform sampler2D history;
+// this frame's jitter, in scene pixels
+uniform vec2 jitter;
+uniform vec2 outputSize;
+// the part of the scene textures drawn this frame, from the lower left corner
+uniform vec2 sceneSize;
+// from this frame's unjittered clip space to last frame's
+uniform mat4 reprojection;
+uniform bool historyValid;
+// share of the current frame at a perfectly placed sample
+uniform float feedback;
+
+// blend in a range where single bright pixels can't dominate (Karis)
+vec3 Compress(vec3 color)
+{
+    return color / (1.0 + max(color.r, max(color.g, color.b)));
+}
+vec3 Uncompress(vec3 color)
+{
+    return color / max(1.0 - max(color.r, max(color.g, color.b)), 1e-4);
+}
+
+// Catmull-Rom filtered history in five bilinear taps, so it stays sharp
+// when it is resampled frame after frame
+vec3 SampleHistory(vec2 uv)
+{
+    vec2 size = vec2(textureSize(history, 0));
+    vec2 position = uv * size;
+    vec2 center = floor(position - 0.5) + 0.5;
+    vec2 f = position - center;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+    vec2 uv0 = (center - 1.0) / size;
+    vec2 uv3 = (center + 2.0) / size;
+    vec2 uv12 = (center + w2 / w12) / size;
+    vec3 sum = texture(history, vec2(uv12.x, uv0.y)).rgb * (w12.x * w0.y);
+    sum += texture(history, vec2(uv0.x, uv12.y)).rgb * (w0.x * w12.y);
+    sum += texture(history, uv12).rgb * (w12.x * w12.y);
+    sum += texture(history, vec2(uv3.x, uv12.y)).rgb * (w3.x * w12.y);
+    sum += texture(history, vec2(uv12.x, uv3.y)).rgb * (w12.x * w3.y);
+    float weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+    return max(sum / weight, 0.0);
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    // the jittered projection moved this point by jitter scene pixels
+    vec2 scenePosition = uv * sceneSize + jitter;
+    ivec2 nearest = ivec2(floor(scenePosition));
+
+    // color bounds of the scene pixels around this one, and the closest depth
+    // among them so edges reproject with the object in front
+    vec3 low = vec3(1e4), high = vec3(-1e4);
+    float closestDepth = 1.0;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 texel = clamp(nearest + ivec2(x, y), ivec2(0), ivec2(sceneSize) - 1);
+            vec3 color = Compress(texelFetch(currentColor, texel, 0).rgb);
+            low = min(low, color);
+            high = max(high, color);
+            closestDepth = min(closestDepth, texelFetch(currentDepth, texel, 0).r);
+        }
+    ivec2 center = clamp(nearest, ivec2(0), ivec2(sceneSize) - 1);
+    vec3 current = Compress(texelFetch(currentColor, center, 0).rgb);
+
+    vec4 previous = reprojection * vec4(uv * 2.0 - 1.0, closestDepth * 2.0 - 1.0, 1.0);
+    vec2 previousUV = previous.xy / previous.w * 0.5 + 0.5;
+    if (!historyValid || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        // nothing to accumulate onto: take the current frame, filtered
+        vec2 sceneUV = min(scenePosition, sceneSize - 0.5) / vec2(textureSize(currentColor, 0));
+        FragColor = vec4(texture(currentColor, sceneUV).rgb, 1.0);
+        return;
+    }
+    vec3 previousColor = clamp(Compress(SampleHistory(previousUV)), low, high);
+
+    // the nearest scene sample counts for less the farther it landed from this
+    // output pixel's center, measured in output pixels
+    vec2 distance = (scenePosition - (vec2(nearest) + 0.5)) * outputSize / sceneSize;
+    float weight = feedback * exp(-2.29 * dot(distance, distance));
+    FragColor = vec4(Uncompress(mix(previousColor, current, weight)), 1.0);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+// last pass of the frame: scene plus bloom, exposed and tonemapped to the window
+out vec4 FragColor;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomStrength;
+uniform float exposure;
+// the window can differ in size from the scene; both are filtered linearly
+uniform vec2 windowSize;
+// the share of each texture the image covers, from its lower left corner
+uniform vec2 sceneScale;
+uniform vec2 bloomScale;
+
+// uv over the window into the covered part of a texture, kept half a texel
+// inside it so the filter doesn't reach past it
+vec2 Covered(sampler2D image, vec2 uv, vec2 scale)
+{
+    return min(uv * scale, scale - 0.5 / vec2(textureSize(image, 0)));
+}
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 ACESFilm(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy / windowSize;
+    vec3 color = texture(scene, Covered(scene, uv, sceneScale)).rgb +
+                 texture(bloom, Covered(bloom, uv, bloomScale)).rgb * bloomStrength;
+    FragColor = vec4(ACESFilm(color * exposure), 1.0);
+}
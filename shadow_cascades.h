@@ -0,0 +1,332 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+#include "include/glm/gtc/matrix_transform.hpp"
+
+#include "mapped_file.h"
+#include "profiler.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// an object that casts shadows: its model matrix and a bounding sphere.
+// static casters are the only ones drawn into the cached cascades
+struct ShadowCaster
+{
+    glm::mat4 model;
+    glm::vec3 center;
+    float radius;
+    bool isStatic;
+};
+
+// cascaded shadow maps for one directional light
+// the camera frustum up to the shadow distance is cut into CASCADES slices,
+// each covered by an orthographic shadow map fitted to the slice's bounding
+// sphere. the sphere's size doesn't change as the camera turns, and the map's
+// origin is snapped to whole texels, so shadow edges don't crawl. every
+// cascade only draws the casters whose spheres overlap its square.
+// the first cascade is redrawn every frame. the others are drawn with a
+// margin around the slice and kept until the camera leaves the margin, the
+// light turns, or a static caster changes; they only hold static casters.
+// all casters share one mesh, drawn instanced.
+// ---------------------------------------------------------------------------
+class ShadowCascades
+{
+public:
+    static const int CASCADES = 4;
+    static const int RESOLUTION = 1024;
+    // cached cascades cover this much more than their slice needs
+    static constexpr float CACHE_MARGIN = 1.4f;
+
+    struct Stats
+    {
+        float splitNear, splitFar;
+        int casters;    // drawn the last time it was rendered
+        int renders;    // times rendered since startup
+        bool rendered;  // rendered this frame
+        double gpuMs;   // last measured render time, -1 until known
+    };
+
+    // mesh is the casters' vertex buffer, positions first in each vertex
+    // ------------------------------------------------------------------------
+    ShadowCascades(unsigned int meshVBO, int stride, int vertexCount, float shadowDistance = 40.0f)
+        : vertexCount(vertexCount), shadowDistance(shadowDistance)
+    {
+        glGenTextures(1, &depthArray);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, RESOLUTION, RESOLUTION, CASCADES, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // hardware compare with bilinear filtering: one lookup blends 4 tests
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SHADOW_CASCADES::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenQueries(CASCADES, queries);
+        for (int i = 0; i < CASCADES; i++)
+            stats[i] = {0.0f, 0.0f, 0, 0, false, -1.0};
+    }
+    ShadowCascades(const ShadowCascades &) = delete;
+    ShadowCascades &operator=(const ShadowCascades &) = delete;
+
+    // fit the cascades to the camera and redraw the ones that need it. pass
+    // what the projection matrix is built from; lightDirection points from
+    // the light into the scene. leaves the default framebuffer bound
+    // ------------------------------------------------------------------------
+    void update(Shader &depthShader, const glm::mat4 &view, float fovY, float aspect, float nearPlane,
+                const glm::vec3 &lightDirection, const std::vector<ShadowCaster> &casters)
+    {
+        PROFILE_SCOPE("ShadowCascades::update");
+        collectTimings();
+        glm::vec3 direction = glm::normalize(lightDirection);
+        bool lightMoved = direction != lastDirection;
+        lastDirection = direction;
+        // light space rotation; cascades are squares in its xy plane
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+        uint64_t hash = staticHash(casters);
+        bool staticChanged = hash != lastStaticHash;
+        lastStaticHash = hash;
+
+        // casters in light space
+        std::vector<glm::vec4> spheres(casters.size());
+        for (size_t i = 0; i < casters.size(); i++)
+            spheres[i] = glm::vec4(glm::vec3(lightRotation * glm::vec4(casters[i].center, 1.0f)), casters[i].radius);
+
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        float tanHalf = std::tan(fovY * 0.5f);
+        std::vector<glm::mat4> models;
+        int firstInstance[CASCADES], instanceCount[CASCADES];
+        bool redraw[CASCADES];
+        for (int c = 0; c < CASCADES; c++)
+        {
+            Cascade &cascade = cascades[c];
+            Stats &s = stats[c];
+            s.splitNear = splitDistance(c, nearPlane);
+            s.splitFar = splitDistance(c + 1, nearPlane);
+            // bounding sphere of the slice, centered on the view axis; its
+            // radius only depends on the projection, rounded so it stays put
+            float mid = 0.5f * (s.splitNear + s.splitFar);
+            float halfDepth = 0.5f * (s.splitFar - s.splitNear);
+            float farHalfWidth = s.splitFar * tanHalf;
+            float radius = std::sqrt(halfDepth * halfDepth + farHalfWidth * farHalfWidth * (1.0f + aspect * aspect));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+            glm::vec3 center = glm::vec3(lightRotation * cameraToWorld * glm::vec4(0.0f, 0.0f, -mid, 1.0f));
+
+            bool cached = c > 0;
+            redraw[c] = !cached || !cascade.valid || lightMoved || staticChanged ||
+                        std::max(std::abs(center.x - cascade.center.x), std::abs(center.y - cascade.center.y)) + radius > cascade.extent;
+            s.rendered = redraw[c];
+            firstInstance[c] = (int)models.size();
+            instanceCount[c] = 0;
+            if (!redraw[c])
+                continue;
+
+            // snap the square's origin to whole texels
+            cascade.extent = cached ? radius * CACHE_MARGIN : radius;
+            float texel = 2.0f * cascade.extent / RESOLUTION;
+            cascade.center = glm::vec2(std::floor(center.x / texel) * texel, std::floor(center.y / texel) * texel);
+            cascade.valid = true;
+            cascade.texelSize = texel;
+
+            // cull casters to the square and fit the depth range to them
+            float zMin = 0.0f, zMax = 0.0f;
+            for (size_t i = 0; i < casters.size(); i++)
+            {
+                const glm::vec4 &sphere = spheres[i];
+                if ((cached && !casters[i].isStatic) || std::abs(sphere.x - cascade.center.x) > cascade.extent + sphere.w ||
+                    std::abs(sphere.y - cascade.center.y) > cascade.extent + sphere.w)
+                    continue;
+                zMin = instanceCount[c] ? std::min(zMin, sphere.z - sphere.w) : sphere.z - sphere.w;
+                zMax = instanceCount[c] ? std::max(zMax, sphere.z + sphere.w) : sphere.z + sphere.w;
+                models.push_back(casters[i].model);
+                instanceCount[c]++;
+            }
+            s.casters = instanceCount[c];
+            s.renders++;
+            // light space looks down -z, so near and far are negated z
+            glm::mat4 projection = glm::ortho(cascade.center.x - cascade.extent, cascade.center.x + cascade.extent,
+                                              cascade.center.y - cascade.extent, cascade.center.y + cascade.extent,
+                                              -zMax - 0.1f, -zMin + 0.1f);
+            cascade.viewProjection = projection * lightRotation;
+        }
+
+        // one upload for every cascade drawn this frame
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (!models.empty())
+            glBufferData(GL_ARRAY_BUFFER, models.size() * sizeof(glm::mat4), models.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, RESOLUTION, RESOLUTION);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        depthShader.use();
+        glBindVertexArray(VAO);
+        for (int c = 0; c < CASCADES; c++)
+        {
+            if (!redraw[c])
+                continue;
+            // a query whose result hasn't come back yet can't be reused
+            bool timed = !queryPending[c];
+            if (timed)
+                glBeginQuery(GL_TIME_ELAPSED, queries[c]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            if (instanceCount[c] > 0)
+            {
+                depthShader.setMat4("lightViewProjection", cascades[c].viewProjection);
+                // no base instance in GL 3.3, so move the attribute offsets instead
+                glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+                for (int i = 0; i < 4; i++)
+                    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                          (void *)(firstInstance[c] * sizeof(glm::mat4) + i * sizeof(glm::vec4)));
+                glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceCount[c]);
+            }
+            if (timed)
+            {
+                glEndQuery(GL_TIME_ELAPSED);
+                queryPending[c] = true;
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    // bind the shadow map to unit and set the shader's cascade uniforms (see
+    // shaders/shadows.glsl)
+    // ------------------------------------------------------------------------
+    void bind(const Shader &shader, int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("cascadeShadowMap", unit);
+        shader.setInt("cascadeCount", CASCADES);
+        // from clip space to texture coordinates
+        glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        glm::vec4 texelSizes(0.0f);
+        for (int c = 0; c < CASCADES; c++)
+        {
+            shader.setMat4("cascadeMatrices[" + std::to_string(c) + "]", bias * cascades[c].viewProjection);
+            texelSizes[c] = cascades[c].texelSize;
+        }
+        shader.setVec4("cascadeTexelSizes", texelSizes);
+    }
+    const Stats &cascadeStats(int cascade) const
+    {
+        return stats[cascade];
+    }
+    void printStats() const
+    {
+        for (int c = 0; c < CASCADES; c++)
+        {
+            const Stats &s = stats[c];
+            char line[160];
+            std::snprintf(line, sizeof(line), "shadow cascade %d: %.1f-%.1f, %d casters, %s, rendered %d times, %.3f ms gpu", c,
+                          s.splitNear, s.splitFar, s.casters, s.rendered ? "redrawn" : "cached", s.renders, s.gpuMs);
+            std::cout << line << std::endl;
+        }
+    }
+    // delete the shadow map and buffers; call while the context is still current
+    void release()
+    {
+        glDeleteTextures(1, &depthArray);
+        glDeleteFramebuffers(1, &FBO);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteQueries(CASCADES, queries);
+        depthArray = FBO = VAO = instanceVBO = 0;
+    }
+
+private:
+    struct Cascade
+    {
+        bool valid = false;
+        glm::vec2 center = glm::vec2(0.0f); // light space
+        float extent = 0.0f;                 // half the square's side
+        float texelSize = 0.0f;
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+    };
+    int vertexCount;
+    float shadowDistance;
+    unsigned int depthArray = 0, FBO = 0, VAO = 0, instanceVBO = 0;
+    unsigned int queries[CASCADES];
+    bool queryPending[CASCADES] = {};
+    Cascade cascades[CASCADES];
+    Stats stats[CASCADES];
+    glm::vec3 lastDirection = glm::vec3(0.0f);
+    uint64_t lastStaticHash = 0;
+
+    // split i of CASCADES, blending logarithmic and uniform spacing so the
+    // near cascades stay small without the far ones getting huge
+    float splitDistance(int i, float nearPlane) const
+    {
+        if (i == 0)
+            return nearPlane;
+        float t = (float)i / CASCADES;
+        float logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, t);
+        float uniform = nearPlane + (shadowDistance - nearPlane) * t;
+        return 0.8f * logarithmic + 0.2f * uniform;
+    }
+    static uint64_t staticHash(const std::vector<ShadowCaster> &casters)
+    {
+        uint64_t h = hashBytes(nullptr, 0);
+        for (const ShadowCaster &caster : casters)
+            if (caster.isStatic)
+                h = hashBytes(&caster.model, sizeof(caster.model), h);
+        return h;
+    }
+    // pick up the render times that have come back, without waiting
+    void collectTimings()
+    {
+        for (int c = 0; c < CASCADES; c++)
+        {
+            if (!queryPending[c])
+                continue;
+            int available = 0;
+            glGetQueryObjectiv(queries[c], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[c], GL_QUERY_RESULT, &nanoseconds);
+            stats[c].gpuMs = nanoseconds / 1.0e6;
+            queryPending[c] = false;
+        }
+    }
+};
+#endif
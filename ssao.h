@@ -0,0 +1,275 @@
+#ifndef SSAO_H
+#define SSAO_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// screen-space ambient occlusion, at half the scene's resolution
+// the scene's depth is first reduced to half size as linear view depth. the
+// occlusion pass rebuilds each pixel's view position and normal from it and
+// tests a small hemisphere kernel, rotated per pixel, against the depth
+// around it. a separable blur that ignores pixels at other depths removes
+// the rotation pattern, and a bilateral upsample brings the result to the
+// scene's size, taking the half size texels whose depth matches the full
+// size pixel. the lighting shaders scale their ambient terms by the result.
+// the targets are allocated for the largest scene and every pass draws into
+// the lower left corner the current scene size covers.
+// ---------------------------------------------------------------------------
+class ScreenSpaceAO
+{
+public:
+    struct Preset
+    {
+        const char *name;
+        // kernel samples per pixel and blur taps either side
+        int samples;
+        int blurRadius;
+    };
+    static const int PRESET_COUNT = 3;
+
+    ScreenSpaceAO() = default;
+    ScreenSpaceAO(const ScreenSpaceAO &) = delete;
+    ScreenSpaceAO &operator=(const ScreenSpaceAO &) = delete;
+
+    // (re)allocate the targets for a scene of up to w x h; cheap when the
+    // size didn't change
+    // ------------------------------------------------------------------------
+    void resize(int w, int h)
+    {
+        if (w == allocatedWidth && h == allocatedHeight)
+            return;
+        if (!emptyVAO)
+            createObjects();
+        allocatedWidth = w;
+        allocatedHeight = h;
+        int allocatedHalfWidth = std::max(w / 2, 1), allocatedHalfHeight = std::max(h / 2, 1);
+        allocate(HALF_DEPTH, GL_R32F, GL_RED, allocatedHalfWidth, allocatedHalfHeight);
+        allocate(HALF_AO, GL_R8, GL_RED, allocatedHalfWidth, allocatedHalfHeight);
+        allocate(HALF_BLUR, GL_R8, GL_RED, allocatedHalfWidth, allocatedHalfHeight);
+        allocate(FULL_AO, GL_R8, GL_RED, w, h);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        setViewport(w, h);
+    }
+    // the scene's size this frame, within the allocated one
+    void setViewport(int w, int h)
+    {
+        sceneWidth = std::min(std::max(w, 1), allocatedWidth);
+        sceneHeight = std::min(std::max(h, 1), allocatedHeight);
+        halfWidth = std::max(sceneWidth / 2, 1);
+        halfHeight = std::max(sceneHeight / 2, 1);
+    }
+    void setPreset(int index)
+    {
+        preset = std::min(std::max(index, 0), PRESET_COUNT - 1);
+    }
+    int presetIndex() const
+    {
+        return preset;
+    }
+    const Preset &currentPreset() const
+    {
+        return PRESETS[preset];
+    }
+
+    // occlusion for the scene depth texture, rendered with projection; leaves
+    // the viewport at the scene's size and no framebuffer bound
+    // ------------------------------------------------------------------------
+    void compute(Shader &depthShader, Shader &occlusionShader, Shader &blurShader, Shader &upsampleShader,
+                 unsigned int depthTexture, const glm::mat4 &projection)
+    {
+        collect();
+        bool timed = !pending[next];
+        if (timed)
+            glQueryCounter(startQueries[next], GL_TIMESTAMP);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        const Preset &p = PRESETS[preset];
+
+        // linear view depth at half size
+        depthShader.use();
+        depthShader.setInt("sceneDepth", 0);
+        depthShader.setMat4("projection", projection);
+        depthShader.setVec2("sceneSize", glm::vec2(sceneWidth, sceneHeight));
+        draw(HALF_DEPTH, depthTexture, halfWidth, halfHeight);
+
+        // raw occlusion
+        occlusionShader.use();
+        occlusionShader.setInt("linearDepth", 0);
+        occlusionShader.setMat4("projection", projection);
+        occlusionShader.setInt("samples", p.samples);
+        occlusionShader.setFloat("radius", RADIUS);
+        occlusionShader.setFloat("intensity", INTENSITY);
+        occlusionShader.setVec2("halfSize", glm::vec2(halfWidth, halfHeight));
+        draw(HALF_AO, textures[HALF_DEPTH], halfWidth, halfHeight);
+
+        // depth aware blur, across then down
+        blurShader.use();
+        blurShader.setInt("occlusion", 0);
+        blurShader.setInt("linearDepth", 1);
+        blurShader.setInt("radius", p.blurRadius);
+        blurShader.setVec2("halfSize", glm::vec2(halfWidth, halfHeight));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, textures[HALF_DEPTH]);
+        glActiveTexture(GL_TEXTURE0);
+        blurShader.setVec2("direction", glm::vec2(1.0f, 0.0f));
+        draw(HALF_BLUR, textures[HALF_AO], halfWidth, halfHeight);
+        blurShader.setVec2("direction", glm::vec2(0.0f, 1.0f));
+        draw(HALF_AO, textures[HALF_BLUR], halfWidth, halfHeight);
+
+        // back to the scene's size
+        upsampleShader.use();
+        upsampleShader.setInt("occlusion", 0);
+        upsampleShader.setInt("linearDepth", 1);
+        upsampleShader.setInt("sceneDepth", 2);
+        upsampleShader.setMat4("projection", projection);
+        upsampleShader.setVec2("halfSize", glm::vec2(halfWidth, halfHeight));
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glActiveTexture(GL_TEXTURE0);
+        draw(FULL_AO, textures[HALF_AO], sceneWidth, sceneHeight);
+
+        for (int i = 2; i >= 0; i--)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, sceneWidth, sceneHeight);
+        glEnable(GL_DEPTH_TEST);
+        if (timed)
+        {
+            glQueryCounter(endQueries[next], GL_TIMESTAMP);
+            pending[next] = true;
+            next = (next + 1) % FRAMES;
+        }
+    }
+    // the occlusion for the lighting shaders; off binds a white texel instead
+    void bind(const Shader &shader, int unit, bool on) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, on ? textures[FULL_AO] : white);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setInt("ambientOcclusion", unit);
+    }
+
+    void printStats() const
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "ssao %s %dx%d -> %dx%d: %.3f ms gpu", PRESETS[preset].name, halfWidth, halfHeight,
+                      sceneWidth, sceneHeight, lastMs);
+        std::cout << line << std::endl;
+    }
+    // delete the targets; call while the context is still current
+    void release()
+    {
+        if (!emptyVAO)
+            return;
+        glDeleteTextures(TARGETS, textures);
+        glDeleteTextures(1, &white);
+        glDeleteFramebuffers(TARGETS, framebuffers);
+        glDeleteQueries(FRAMES, startQueries);
+        glDeleteQueries(FRAMES, endQueries);
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+        allocatedWidth = allocatedHeight = sceneWidth = sceneHeight = 0;
+    }
+
+private:
+    static constexpr Preset PRESETS[PRESET_COUNT] = {{"low", 6, 2}, {"medium", 10, 3}, {"high", 16, 4}};
+    // kernel radius in world units, and how dark full occlusion gets
+    static constexpr float RADIUS = 0.5f;
+    static constexpr float INTENSITY = 1.5f;
+    enum Target
+    {
+        HALF_DEPTH,
+        HALF_AO,
+        HALF_BLUR,
+        FULL_AO,
+        TARGETS
+    };
+    static const int FRAMES = 4;
+    int allocatedWidth = 0, allocatedHeight = 0;
+    // the scene and its half size as used this frame
+    int sceneWidth = 0, sceneHeight = 0;
+    int halfWidth = 0, halfHeight = 0;
+    int preset = 1;
+    unsigned int textures[TARGETS] = {}, framebuffers[TARGETS] = {};
+    unsigned int white = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int startQueries[FRAMES] = {}, endQueries[FRAMES] = {};
+    bool pending[FRAMES] = {};
+    int next = 0;
+    double lastMs = 0.0;
+
+    void createObjects()
+    {
+        glGenTextures(TARGETS, textures);
+        glGenFramebuffers(TARGETS, framebuffers);
+        for (int i = 0; i < TARGETS; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            // the upsample weighs the four nearest texels itself
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        const unsigned char one = 255;
+        glGenTextures(1, &white);
+        glBindTexture(GL_TEXTURE_2D, white);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 1, 1, 0, GL_RED, GL_UNSIGNED_BYTE, &one);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenQueries(FRAMES, startQueries);
+        glGenQueries(FRAMES, endQueries);
+        // core profile draws need a vertex array even without attributes
+        glGenVertexArrays(1, &emptyVAO);
+    }
+    void allocate(Target target, GLenum internalFormat, GLenum format, int w, int h)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[target]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_FLOAT, NULL);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[target]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[target], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::SSAO::TARGET_INCOMPLETE" << std::endl;
+    }
+    // one fullscreen pass into target, reading source on unit 0
+    void draw(Target target, unsigned int source, int w, int h)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[target]);
+        glViewport(0, 0, w, h);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    void collect()
+    {
+        for (int i = 0; i < FRAMES; i++)
+        {
+            if (!pending[i])
+                continue;
+            int available = 0;
+            glGetQueryObjectiv(endQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(startQueries[i], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(endQueries[i], GL_QUERY_RESULT, &end);
+            pending[i] = false;
+            lastMs = (end - start) / 1.0e6;
+        }
+    }
+};
+#endif
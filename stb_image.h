@@ -274,6 +274,18 @@ RECENT REVISION HISTORY:
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
 //
+// With -mavx2 the JPEG IDCT and YCbCr->RGB conversion use AVX2 kernels that
+// produce the same output as their SSE2 counterparts.
+//
+// The PNG decoder also unfilters 8-bit RGB/RGBA scanlines with SSE2 when it
+// is available, and the "up" filter additionally uses AVX2 when the compiler
+// targets it (-mavx2); define STBI_NO_AVX2 to opt out of the latter.
+//
+// Defining STBI_ZLIB_FAST switches the zlib decoder to a 64-bit bit buffer
+// that is refilled a word at a time, wider fast-path huffman tables, and a
+// literal loop that decodes several symbols per refill. STBI_ZFAST_BITS can
+// be defined to pick the fast table width explicitly (9..15 bits).
+//
 // ===========================================================================
 //
 // HDR image support   (disable by defining STBI_NO_HDR)
@@ -524,6 +536,27 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// stb_image starts no threads of its own. Baseline JPEGs decoded from memory that
+// contain restart markers can have their restart intervals decoded in parallel
+// if you register a parallel-for here: fn must call job(job_user, i) for every i
+// in [0,count) and return once all calls have finished. max_jobs caps how many
+// jobs a scan is split into (a few per worker thread is a good choice).
+// Pass NULL to go back to decoding on the calling thread.
+typedef void stbi_parallel_job(void *job_user, int index);
+typedef void stbi_parallel_for(stbi_parallel_job *job, void *job_user, int count, void *user);
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *fn, void *user, int max_jobs);
+
+// decode JPEGs at 1/2, 1/4 or 1/8 of their size (log2_scale 1, 2 or 3; 0 is
+// full size). the reduction happens in the IDCT, so this is much cheaper than
+// decoding at full size and downsampling. output is ceil(w/scale) x ceil(h/scale)
+// and stbi_info reports the reduced size too. other formats are unaffected.
+// each pixel is within about one level (mean) of the box-filtered full decode
+// for 4:4:4 and 4:2:0 images. chroma subsampled in one direction only (4:2:2,
+// 4:4:0, 4:1:1) is still upsampled from a reduced plane and comes out softer:
+// a mean of about 4 levels at 1/8 scale, with edges off by several times that.
+STBIDEF void stbi_set_jpeg_scale_on_load(int log2_scale);
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int log2_scale);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -643,12 +676,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -792,6 +827,13 @@ static int stbi__sse2_available(void)
 #define STBI_SIMD_ALIGN(type, name) type name
 #endif
 
+// AVX2 is never detected at runtime either: compile with -mavx2 (or /arch:AVX2)
+// to get the wider loops, and define STBI_NO_AVX2 to keep them out of the build.
+#if defined(STBI_SSE2) && defined(__AVX2__) && !defined(STBI_NO_AVX2)
+#define STBI_AVX2
+#include <immintrin.h>
+#endif
+
 #ifndef STBI_MAX_DIMENSIONS
 #define STBI_MAX_DIMENSIONS (1 << 24)
 #endif
@@ -1111,6 +1153,17 @@ static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp);
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
+static stbi_parallel_for *stbi__jpeg_parallel_fn = NULL;
+static void *stbi__jpeg_parallel_user = NULL;
+static int stbi__jpeg_parallel_max_jobs = 0;
+
+STBIDEF void stbi_set_jpeg_parallel_for(stbi_parallel_for *fn, void *user, int max_jobs)
+{
+   stbi__jpeg_parallel_fn = fn;
+   stbi__jpeg_parallel_user = user;
+   stbi__jpeg_parallel_max_jobs = max_jobs;
+}
+
 static int stbi__vertically_flip_on_load_global = 0;
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
@@ -1134,6 +1187,29 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_scale_on_load_global = 0;
+
+STBIDEF void stbi_set_jpeg_scale_on_load(int log2_scale)
+{
+   stbi__jpeg_scale_on_load_global = log2_scale < 0 ? 0 : log2_scale > 3 ? 3 : log2_scale;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale_on_load  stbi__jpeg_scale_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_on_load_local, stbi__jpeg_scale_on_load_set;
+
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int log2_scale)
+{
+   stbi__jpeg_scale_on_load_local = log2_scale < 0 ? 0 : log2_scale > 3 ? 3 : log2_scale;
+   stbi__jpeg_scale_on_load_set = 1;
+}
+
+#define stbi__jpeg_scale_on_load  (stbi__jpeg_scale_on_load_set       \
+                                    ? stbi__jpeg_scale_on_load_local  \
+                                    : stbi__jpeg_scale_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1959,6 +2035,9 @@ typedef struct
    int img_mcu_x, img_mcu_y;
    int img_mcu_w, img_mcu_h;
 
+// reduced-resolution decode: the output is 1 << scale_shift times smaller
+   int scale_shift;
+
 // definition of jpeg image component
    struct
    {
@@ -1974,6 +2053,11 @@ typedef struct
       stbi_uc *linebuf;
       short   *coeff;   // progressive only
       int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
+
+      // each 8x8 block becomes block_out x block_out samples; subsampled
+      // components are reduced by less than scale_shift (see shift)
+      int      shift, block_out;
+      void   (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    } img_comp[4];
 
    stbi__uint32   code_buffer; // jpeg entropy-coded buffer
@@ -2523,6 +2607,100 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced-size IDCTs for decoding at 1/2, 1/4 and 1/8 scale. each output pixel
+// is the average of the 2x2, 4x4 or 8x8 pixels the full IDCT would produce,
+// evaluated directly from the coefficients (the terms that cancel out in the
+// average are skipped). the constants are the pair/quad-averaged IDCT basis,
+// normalized so two passes scale by 1<<12 each; like the full IDCT we keep 2
+// extra bits after the first pass, so 1<<14 is removed at the end.
+#define STBI__IDCT_4(s0,s1,s2,s3,s5,s6,s7)          \
+   int e0,e1,e2,o0,o1;                               \
+   e0 = (s0) * stbi__f2f(0.353553391f);              \
+   e2 = (s2) * stbi__f2f(0.326640741f)               \
+      + (s6) * stbi__f2f(-0.135299025f);             \
+   e1 = e0 - e2;                                     \
+   e0 = e0 + e2;                                     \
+   o0 = (s1) * stbi__f2f(0.453063723f)               \
+      + (s3) * stbi__f2f(0.159094823f)               \
+      + (s5) * stbi__f2f(-0.106303762f)              \
+      + (s7) * stbi__f2f(-0.090119978f);             \
+   o1 = (s1) * stbi__f2f(0.187665139f)               \
+      + (s3) * stbi__f2f(-0.384088878f)              \
+      + (s5) * stbi__f2f(0.256639984f)               \
+      + (s7) * stbi__f2f(-0.037328917f);
+
+#define STBI__IDCT_2(s0,s1,s3,s5,s7)                 \
+   int e0,o0;                                        \
+   e0 = (s0) * stbi__f2f(0.353553391f);              \
+   o0 = (s1) * stbi__f2f(0.320364431f)               \
+      + (s3) * stbi__f2f(-0.112497028f)              \
+      + (s5) * stbi__f2f(0.075168111f)               \
+      + (s7) * stbi__f2f(-0.063724447f);
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[32],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, 4 rows out; column 4 never contributes to the averages
+   for (i=0; i < 8; ++i,++d,++v) {
+      if (i == 4) continue;
+      if (d[ 8]==0 && d[16]==0 && d[24]==0 && d[40]==0 && d[48]==0 && d[56]==0) {
+         v[0] = v[8] = v[16] = v[24] = (d[0] * stbi__f2f(0.353553391f) + 512) >> 10;
+      } else {
+         STBI__IDCT_4(d[0],d[8],d[16],d[24],d[40],d[48],d[56])
+         e0 += 512; e1 += 512;
+         v[ 0] = (e0+o0) >> 10;
+         v[24] = (e0-o0) >> 10;
+         v[ 8] = (e1+o1) >> 10;
+         v[16] = (e1-o1) >> 10;
+      }
+   }
+
+   for (i=0, v=val, o=out; i < 4; ++i,v+=8,o+=out_stride) {
+      STBI__IDCT_4(v[0],v[1],v[2],v[3],v[5],v[6],v[7])
+      e0 += 8192 + (128<<14);
+      e1 += 8192 + (128<<14);
+      o[0] = stbi__clamp((e0+o0) >> 14);
+      o[3] = stbi__clamp((e0-o0) >> 14);
+      o[1] = stbi__clamp((e1+o1) >> 14);
+      o[2] = stbi__clamp((e1-o1) >> 14);
+   }
+}
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, 2 rows out; only the odd columns (and DC) survive the averaging
+   for (i=0; i < 8; ++i,++d,++v) {
+      if (i != 0 && !(i & 1)) continue;
+      {
+         STBI__IDCT_2(d[0],d[8],d[24],d[40],d[56])
+         e0 += 512;
+         v[0] = (e0+o0) >> 10;
+         v[8] = (e0-o0) >> 10;
+      }
+   }
+
+   for (i=0, v=val, o=out; i < 2; ++i,v+=8,o+=out_stride) {
+      STBI__IDCT_2(v[0],v[1],v[3],v[5],v[7])
+      e0 += 8192 + (128<<14);
+      o[0] = stbi__clamp((e0+o0) >> 14);
+      o[1] = stbi__clamp((e0-o0) >> 14);
+   }
+}
+
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   // the block average is just the DC term: dc/8, plus 128
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2702,6 +2880,176 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 #undef dct_pass
 }
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above: same 16-bit transposes, but all the
+// 32-bit math runs on full rows (8 lanes) instead of lo/hi halves, so it
+// stays bit-identical to the generic C version.
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // interleave two rows into 8 (x,y) pairs, columns 0-3 in the low lane
+   #define dct_pair(x,y) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1)
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = dct_pair(x,y); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // 32-bit row back to 16 bits with signed saturation
+   #define dct_pack(v) \
+      _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256((v), 1))
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         out0 = dct_pack(_mm256_srai_epi32(_mm256_add_epi32(abiased, b), s)); \
+         out1 = dct_pack(_mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s)); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_pair
+#undef dct_rot
+#undef dct_widen
+#undef dct_pack
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #endif // STBI_SSE2
 
 #ifdef STBI_NEON
@@ -2946,8 +3294,161 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// parallel baseline decode
+//    every restart interval starts with a fresh bit reader and dc predictors,
+//    so once the RSTn markers have been located each run of intervals can be
+//    decoded on its own copy of the decoder state. the idct output of
+//    different MCUs never overlaps, so the jobs write straight into the
+//    component buffers.
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **seg;     // seg[k] = first entropy byte of restart interval k
+   stbi_uc *scan_end; // first byte of the marker that ends the scan
+   int units;         // MCUs (or blocks, for single-component scans) in the scan
+   int intervals;
+   int per_job;       // restart intervals handled by each job
+   int *ok;
+} stbi__jpeg_parallel;
+
+static void stbi__jpeg_parallel_job(void *user, int index)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) user;
+   stbi__jpeg *z = p->z;
+   int ri = z->restart_interval;
+   int first = index * p->per_job;
+   int last = first + p->per_job < p->intervals ? first + p->per_job : p->intervals;
+   int u, u_end = last * ri < p->units ? last * ri : p->units;
+   stbi_uc *end = last < p->intervals ? p->seg[last] : p->scan_end;
+   stbi__context s;
+   stbi__jpeg *j;
+   STBI_SIMD_ALIGN(short, data[64]);
+
+   p->ok[index] = 0;
+   j = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!j) return;
+   memcpy(j, z, sizeof(stbi__jpeg));
+   stbi__start_mem(&s, p->seg[first], (int) (end - p->seg[first]));
+   j->s = &s;
+   stbi__jpeg_reset(j);
+
+   for (u = first * ri; u < u_end; ++u) {
+      if (j->scan_n == 1) {
+         int n = j->order[0];
+         int w = (j->img_comp[n].x+7) >> 3;
+         int i = u % w, jj = u / w;
+         int ha = j->img_comp[n].ha;
+         if (!stbi__jpeg_decode_block(j, data, j->huff_dc+j->img_comp[n].hd, j->huff_ac+ha, j->fast_ac[ha], n, j->dequant[j->img_comp[n].tq])) break;
+         j->img_comp[n].idct_block_kernel(j->img_comp[n].data+j->img_comp[n].w2*jj*j->img_comp[n].block_out+i*j->img_comp[n].block_out, j->img_comp[n].w2, data);
+      } else {
+         int i = u % j->img_mcu_x, jj = u / j->img_mcu_x;
+         int k,x,y;
+         for (k=0; k < j->scan_n; ++k) {
+            int n = j->order[k];
+            for (y=0; y < j->img_comp[n].v; ++y) {
+               for (x=0; x < j->img_comp[n].h; ++x) {
+                  int x2 = (i*j->img_comp[n].h + x)*j->img_comp[n].block_out;
+                  int y2 = (jj*j->img_comp[n].v + y)*j->img_comp[n].block_out;
+                  int ha = j->img_comp[n].ha;
+                  if (!stbi__jpeg_decode_block(j, data, j->huff_dc+j->img_comp[n].hd, j->huff_ac+ha, j->fast_ac[ha], n, j->dequant[j->img_comp[n].tq])) goto done;
+                  j->img_comp[n].idct_block_kernel(j->img_comp[n].data+j->img_comp[n].w2*y2+x2, j->img_comp[n].w2, data);
+               }
+            }
+         }
+      }
+      // intervals inside this job are separated by the markers we already found
+      if (--j->todo <= 0 && u+1 < u_end) {
+         if (j->code_bits < 24) stbi__grow_buffer_unsafe(j);
+         // like the serial path, a missing restart just leaves the rest of
+         // this job's MCUs undecoded rather than failing the image
+         if (!STBI__RESTART(j->marker)) { u = u_end; break; }
+         stbi__jpeg_reset(j);
+      }
+   }
+   if (u == u_end) p->ok[index] = 1;
+done:
+   STBI_FREE(j);
+}
+
+// returns 1/0 like stbi__parse_entropy_coded_data, or -1 if the scan has to be
+// decoded serially (no registered parallel-for, not in memory, too few restart
+// intervals, or markers that don't line up with the MCU count)
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+   stbi__jpeg_parallel p;
+   stbi__context *s = z->s;
+   stbi_uc *c;
+   int units, intervals, jobs, nseg, i, ok = 1;
+
+   if (!stbi__jpeg_parallel_fn || stbi__jpeg_parallel_max_jobs < 2) return -1;
+   if (z->progressive || z->restart_interval <= 0 || s->read_from_callbacks) return -1;
+   if (z->marker != STBI__MARKER_none) return -1;
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      units = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else {
+      units = z->img_mcu_x * z->img_mcu_y;
+   }
+   intervals = (units + z->restart_interval - 1) / z->restart_interval;
+   if (intervals < 2) return -1;
+
+   p.seg = (stbi_uc **) stbi__malloc_mad2(intervals, sizeof(stbi_uc *), 0);
+   if (!p.seg) return -1;
+
+   // find the restart markers; 0xff00 is a stuffed byte and repeated 0xff are fill
+   nseg = 0;
+   p.seg[nseg++] = s->img_buffer;
+   p.scan_end = NULL;
+   for (c = s->img_buffer; c + 1 < s->img_buffer_end; ++c) {
+      stbi_uc *m;
+      if (*c != 0xff) continue;
+      m = c + 1;
+      while (m < s->img_buffer_end && *m == 0xff) ++m;
+      if (m >= s->img_buffer_end) break;
+      if (*m == 0x00) { c = m; continue; }
+      if (!STBI__RESTART(*m)) { p.scan_end = c; break; }
+      // a trailing RSTn after the final interval ends the scan too
+      if (nseg == intervals) { p.scan_end = c; break; }
+      p.seg[nseg++] = m + 1;
+      c = m;
+   }
+   if (!p.scan_end || nseg != intervals) {
+      STBI_FREE(p.seg);
+      return -1;
+   }
+
+   jobs = stbi__jpeg_parallel_max_jobs < intervals ? stbi__jpeg_parallel_max_jobs : intervals;
+   p.z = z;
+   p.units = units;
+   p.intervals = intervals;
+   p.per_job = (intervals + jobs - 1) / jobs;
+   jobs = (intervals + p.per_job - 1) / p.per_job;
+   p.ok = (int *) stbi__malloc_mad2(jobs, sizeof(int), 0);
+   if (!p.ok) {
+      STBI_FREE(p.seg);
+      return -1;
+   }
+
+   stbi__jpeg_parallel_fn(stbi__jpeg_parallel_job, &p, jobs, stbi__jpeg_parallel_user);
+
+   for (i = 0; i < jobs; ++i)
+      ok &= p.ok[i];
+   STBI_FREE(p.ok);
+   STBI_FREE(p.seg);
+   if (!ok) return stbi__err("bad huffman code","Corrupt JPEG");
+
+   // leave the stream where the serial decoder would: at the marker after the scan
+   stbi__jpeg_reset(z);
+   s->img_buffer = p.scan_end;
+   return 1;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
+   int parallel = stbi__parse_entropy_coded_data_parallel(z);
+   if (parallel >= 0) return parallel;
+
    stbi__jpeg_reset(z);
    if (!z->progressive) {
       if (z->scan_n == 1) {
@@ -2964,7 +3465,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->img_comp[n].idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*z->img_comp[n].block_out+i*z->img_comp[n].block_out, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2988,11 +3489,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*z->img_comp[n].block_out;
+                        int y2 = (j*z->img_comp[n].v + y)*z->img_comp[n].block_out;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        z->img_comp[n].idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -3089,7 +3590,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->img_comp[n].idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*z->img_comp[n].block_out+i*z->img_comp[n].block_out, z->img_comp[n].w2, data);
             }
          }
       }
@@ -3319,6 +3820,22 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
    for (i=0; i < s->img_n; ++i) {
+      // at reduced resolution a subsampled component has fewer samples to
+      // lose, so its blocks are reduced by that much less: 4:2:0 chroma at
+      // 1/8 scale comes out of a 2x2 IDCT at the output's size instead of
+      // being averaged down to 1x1 and upsampled again
+      int hs = h_max / z->img_comp[i].h, vs = v_max / z->img_comp[i].v;
+      z->img_comp[i].shift = z->scale_shift;
+      while (z->img_comp[i].shift > 0 && hs % 2 == 0 && vs % 2 == 0) {
+         --z->img_comp[i].shift;
+         hs >>= 1;
+         vs >>= 1;
+      }
+      z->img_comp[i].block_out = 8 >> z->img_comp[i].shift;
+      z->img_comp[i].idct_block_kernel = z->img_comp[i].shift == 1 ? stbi__idct_4x4
+                                       : z->img_comp[i].shift == 2 ? stbi__idct_2x2
+                                       : z->img_comp[i].shift == 3 ? stbi__idct_1x1
+                                       : z->idct_block_kernel;
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
       z->img_comp[i].y = (s->img_y * z->img_comp[i].v + v_max-1) / v_max;
@@ -3329,8 +3846,9 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // (block_out is 8 unless decoding at reduced resolution)
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->img_comp[i].block_out;
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * z->img_comp[i].block_out;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3340,10 +3858,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // coefficients are kept for every 8x8 block even when the output is reduced
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3817,6 +4335,67 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// same fixed-point math as the sse2 path, 16 pixels at a time; the tail goes
+// through the sse2 version so results match it exactly.
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((const __m128i *) (y+i));
+         __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (pcr+i)), signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (pcb+i)), signflip); // -128
+
+         // widen to short the way the sse2 unpacks do: y<<8 | 128, cr/cb << 8
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte; each 128-bit lane now holds 8 pixels, so the
+         // interleave below leaves pixels 0-3,8-11 in o0 and 4-7,12-15 in o1
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+   }
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3829,6 +4408,10 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
       j->idct_block_kernel = stbi__idct_simd;
       j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
       j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+#endif
    }
 #endif
 
@@ -3837,6 +4420,10 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   // reduced-resolution decode replaces the full IDCT with a smaller one
+   // per component once the frame header gives the subsampling
+   j->scale_shift = stbi__jpeg_scale_on_load;
 }
 
 // clean up the temporary component buffers
@@ -3851,6 +4438,7 @@ typedef struct
    stbi_uc *line0,*line1;
    int hs,vs;   // expansion factor in each axis
    int w_lores; // horizontal pixels pre-expansion
+   int h_lores; // rows pre-expansion
    int ystep;   // how far through vertical expansion we are
    int ypos;    // which pre-expansion row we're on
 } stbi__resample;
@@ -3865,6 +4453,7 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
+   unsigned int out_w, out_h;
    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
 
    // validate req_comp
@@ -3873,6 +4462,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // output size, smaller than the image when decoding at reduced resolution
+   out_w = (z->s->img_x + (1u << z->scale_shift) - 1) >> z->scale_shift;
+   out_h = (z->s->img_y + (1u << z->scale_shift) - 1) >> z->scale_shift;
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3901,13 +4494,15 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
          // allocate line buffer big enough for upsampling off the edges
          // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
+         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(out_w + 3);
          if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
+         // what's left of the subsampling after the component's reduced IDCT
+         r->hs      = z->img_h_max / z->img_comp[k].h >> (z->scale_shift - z->img_comp[k].shift);
+         r->vs      = z->img_v_max / z->img_comp[k].v >> (z->scale_shift - z->img_comp[k].shift);
          r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+         r->w_lores = (out_w + r->hs-1) / r->hs;
+         r->h_lores = (z->img_comp[k].y + (1 << z->img_comp[k].shift) - 1) >> z->img_comp[k].shift;
          r->ypos    = 0;
          r->line0   = r->line1 = z->img_comp[k].data;
 
@@ -3919,12 +4514,12 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       }
 
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+      output = (stbi_uc *) stbi__malloc_mad3(n, out_w, out_h, 1);
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+      for (j=0; j < out_h; ++j) {
+         stbi_uc *out = output + n * out_w * j;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -3935,7 +4530,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
             if (++r->ystep >= r->vs) {
                r->ystep = 0;
                r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
+               if (++r->ypos < r->h_lores)
                   r->line1 += z->img_comp[k].w2;
             }
          }
@@ -3943,7 +4538,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
             stbi_uc *y = coutput[0];
             if (z->s->img_n == 3) {
                if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
+                  for (i=0; i < out_w; ++i) {
                      out[0] = y[i];
                      out[1] = coutput[1][i];
                      out[2] = coutput[2][i];
@@ -3951,11 +4546,11 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                      out += n;
                   }
                } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], out_w, n);
                }
             } else if (z->s->img_n == 4) {
                if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
+                  for (i=0; i < out_w; ++i) {
                      stbi_uc m = coutput[3][i];
                      out[0] = stbi__blinn_8x8(coutput[0][i], m);
                      out[1] = stbi__blinn_8x8(coutput[1][i], m);
@@ -3964,8 +4559,8 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                      out += n;
                   }
                } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
+                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], out_w, n);
+                  for (i=0; i < out_w; ++i) {
                      stbi_uc m = coutput[3][i];
                      out[0] = stbi__blinn_8x8(255 - out[0], m);
                      out[1] = stbi__blinn_8x8(255 - out[1], m);
@@ -3973,10 +4568,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                      out += n;
                   }
                } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], out_w, n);
                }
             } else
-               for (i=0; i < z->s->img_x; ++i) {
+               for (i=0; i < out_w; ++i) {
                   out[0] = out[1] = out[2] = y[i];
                   out[3] = 255; // not used if n==3
                   out += n;
@@ -3984,16 +4579,16 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          } else {
             if (is_rgb) {
                if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
+                  for (i=0; i < out_w; ++i)
                      *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
                else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  for (i=0; i < out_w; ++i, out += 2) {
                      out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
                      out[1] = 255;
                   }
                }
             } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
+               for (i=0; i < out_w; ++i) {
                   stbi_uc m = coutput[3][i];
                   stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
                   stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
@@ -4003,7 +4598,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   out += n;
                }
             } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
+               for (i=0; i < out_w; ++i) {
                   out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
                   out[1] = 255;
                   out += n;
@@ -4011,15 +4606,15 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
             } else {
                stbi_uc *y = coutput[0];
                if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+                  for (i=0; i < out_w; ++i) out[i] = y[i];
                else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+                  for (i=0; i < out_w; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
       }
       stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
+      *out_x = out_w;
+      *out_y = out_h;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
       return output;
    }
@@ -4059,8 +4654,8 @@ static int stbi__jpeg_info_raw(stbi__jpeg *j, int *x, int *y, int *comp)
       stbi__rewind( j->s );
       return 0;
    }
-   if (x) *x = j->s->img_x;
-   if (y) *y = j->s->img_y;
+   if (x) *x = (j->s->img_x + (1 << j->scale_shift) - 1) >> j->scale_shift;
+   if (y) *y = (j->s->img_y + (1 << j->scale_shift) - 1) >> j->scale_shift;
    if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
    return 1;
 }
@@ -4072,6 +4667,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    if (!j) return stbi__err("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
    j->s = s;
+   j->scale_shift = stbi__jpeg_scale_on_load;
    result = stbi__jpeg_info_raw(j, x, y, comp);
    STBI_FREE(j);
    return result;
@@ -4088,7 +4684,13 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
+#ifdef STBI_ZFAST_BITS
+#define STBI__ZFAST_BITS  STBI_ZFAST_BITS
+#elif defined(STBI_ZLIB_FAST)
+#define STBI__ZFAST_BITS  11 // resolves nearly all dynamic-table codes in one lookup
+#else
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#endif
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
@@ -4174,12 +4776,21 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
+#ifdef STBI_ZLIB_FAST
+typedef stbi__uint64 stbi__zbits;
+#define STBI__ZBITS_REFILL 56 // refill tops the buffer up to 56..63 bits
+#else
+typedef stbi__uint32 stbi__zbits;
+#define STBI__ZBITS_REFILL 24
+#endif
+
 typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
    int num_bits;
    int hit_zeof_once;
-   stbi__uint32 code_buffer;
+   int zero_bits; // zero bits buffered past the end of the input
+   stbi__zbits code_buffer;
 
    char *zout;
    char *zout_start;
@@ -4199,16 +4810,52 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
    return stbi__zeof(z) ? 0 : *z->zbuffer++;
 }
 
+#ifdef STBI_ZLIB_FAST
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+   // little-endian regardless of host
+   return (stbi__uint64) p[0]       | ((stbi__uint64) p[1] << 8)  |
+          ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) |
+          ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+}
+#endif
+
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->code_buffer >= ((stbi__zbits) 1 << z->num_bits)) {
+     z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
+     return;
+   }
+#ifdef STBI_ZLIB_FAST
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // take as many whole bytes of one 8-byte load as fit, and keep the
+      // bits above num_bits clear since the eof handling relies on it
+      int n = (63 - z->num_bits) >> 3;
+      z->code_buffer |= stbi__zload64(z->zbuffer) << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += n << 3;
+      z->code_buffer &= ((stbi__zbits) 1 << z->num_bits) - 1;
+      return;
+   }
+#endif
    do {
-      if (z->code_buffer >= (1U << z->num_bits)) {
+      if (z->code_buffer >= ((stbi__zbits) 1 << z->num_bits)) {
         z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
         return;
       }
-      z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
+      if (stbi__zeof(z)) z->zero_bits += 8;
+      z->code_buffer |= (stbi__zbits) stbi__zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= STBI__ZBITS_REFILL);
+}
+
+// the zero bits a refill pads in past the end of the input sit at the top of
+// the bit buffer; once fewer bits than that remain, the decoder has consumed
+// some of them and read past the end of the stream
+stbi_inline static int stbi__zoverread(stbi__zbuf *z)
+{
+   return z->num_bits < z->zero_bits;
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
@@ -4226,7 +4873,7 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse((int) (a->code_buffer & 0xffff), 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4251,6 +4898,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
             // though, that is invalid data. This is caught later.
             a->hit_zeof_once = 1;
             a->num_bits += 16; // add 16 implicit zero bits
+            a->zero_bits += 16;
          } else {
             // We already inserted our extra 16 padding bits and are again
             // out, this stream is actually prematurely terminated.
@@ -4270,6 +4918,21 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+#ifdef STBI_ZLIB_FAST
+// caller guarantees at least 15 bits (the longest code) are buffered
+stbi_inline static int stbi__zhuffman_decode_nofill(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   if (b) {
+      int s = b >> 9;
+      a->code_buffer >>= s;
+      a->num_bits -= s;
+      return b & 511;
+   }
+   return stbi__zhuffman_decode_slowpath(a, z);
+}
+#endif
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
@@ -4310,7 +4973,24 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+#ifdef STBI_ZLIB_FAST
+      if (a->zbuffer_end - a->zbuffer >= 8) {
+         // one refill covers several symbols: peel off literals until a
+         // length/end code turns up or fewer than 15 bits remain buffered
+         if (a->num_bits < 15) stbi__fill_bits(a);
+         z = stbi__zhuffman_decode_nofill(a, &a->z_length);
+         while ((unsigned) z < 256 && a->num_bits >= 15) {
+            if (zout >= a->zout_end) {
+               if (!stbi__zexpand(a, zout, 1)) return 0;
+               zout = a->zout;
+            }
+            *zout++ = (char) z;
+            z = stbi__zhuffman_decode_nofill(a, &a->z_length);
+         }
+      } else
+#endif
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4323,11 +5003,12 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          int len,dist;
          if (z == 256) {
             a->zout = zout;
-            if (a->hit_zeof_once && a->num_bits < 16) {
-               // The first time we hit zeof, we inserted 16 extra zero bits into our bit
-               // buffer so the decoder can just do its speculative decoding. But if we
-               // actually consumed any of those bits (which is the case when num_bits < 16),
-               // the stream actually read past the end so it is malformed.
+            if (stbi__zoverread(a)) {
+               // Refills past the end of the input pad the bit buffer with zero bits
+               // (up to 7 bytes of them with the 64-bit buffer, plus the 16 implicit
+               // bits added when we hit zeof) so the decoder can just do its speculative
+               // decoding. But if we actually consumed any of those bits, the stream
+               // read past the end so it is malformed.
                return stbi__err("unexpected end","Corrupt PNG");
             }
             return 1;
@@ -4346,6 +5027,20 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             zout = a->zout;
          }
          p = (stbi_uc *) (zout - dist);
+#ifdef STBI_ZLIB_FAST
+         if (dist >= 8 && a->zout_end - zout >= len + 8) {
+            // 8-byte chunks never overlap their source when dist >= 8; the
+            // overshoot past len lands in unused buffer space and is overwritten later
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+            continue;
+         }
+#endif
          if (dist == 1) { // run of one byte; common in images.
             stbi_uc v = *p;
             if (len) { do *zout++ = v; while (--len); }
@@ -4414,7 +5109,7 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
       stbi__zreceive(a, a->num_bits & 7); // discard
    // drain the bit-packed data into header
    k = 0;
-   while (a->num_bits > 0) {
+   while (a->num_bits > 0 && k < 4) {
       header[k++] = (stbi_uc) (a->code_buffer & 255); // suppress MSVC run-time check
       a->code_buffer >>= 8;
       a->num_bits -= 8;
@@ -4426,9 +5121,18 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   // a wide bit buffer can still hold the first stored bytes (or even the
+   // next block header when len is tiny); those come out before the raw copy
+   while (a->num_bits > 0 && len > 0) {
+      *a->zout++ = (char) (a->code_buffer & 255);
+      a->code_buffer >>= 8;
+      a->num_bits -= 8;
+      --len;
+   }
+   if (stbi__zoverread(a)) return stbi__err("unexpected end","Corrupt PNG");
+   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4486,6 +5190,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
    a->num_bits = 0;
    a->code_buffer = 0;
    a->hit_zeof_once = 0;
+   a->zero_bits = 0;
    do {
       final = stbi__zreceive(a,1);
       type = stbi__zreceive(a,2);
@@ -4667,6 +5372,101 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+#ifdef STBI_SSE2
+// sub/avg/paeth depend on the pixel just decoded, so the SIMD versions carry one
+// pixel per register (the same trick libpng uses); only up is truly data-parallel.
+// bpp must be 3 or 4. 3-byte pixels still move as 4-byte words while at least
+// that much of the row is left (the extra byte written is the next pixel's, which
+// gets overwritten right after); only the final pixel goes byte by byte.
+stbi_inline static __m128i stbi__png_load_px(const stbi_uc *p, int avail)
+{
+   int v;
+   if (avail >= 4) memcpy(&v, p, 4);
+   else            v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_px(stbi_uc *p, __m128i v, int avail)
+{
+   int x = _mm_cvtsi128_si32(v);
+   if (avail >= 4) memcpy(p, &x, 4);
+   else {
+      p[0] = STBI__BYTECAST(x);
+      p[1] = STBI__BYTECAST(x >> 8);
+      p[2] = STBI__BYTECAST(x >> 16);
+   }
+}
+
+stbi_inline static void stbi__png_unfilter_sse2(int filter, stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   int k = 0;
+   switch (filter) {
+   case STBI__F_sub: {
+      __m128i a = zero;
+      for (; k < nk; k += bpp) {
+         a = _mm_add_epi8(a, stbi__png_load_px(raw+k, nk-k));
+         stbi__png_store_px(cur+k, a, nk-k);
+      }
+      break;
+   }
+   case STBI__F_up:
+#ifdef STBI_AVX2
+      for (; k+32 <= nk; k += 32) {
+         __m256i r = _mm256_loadu_si256((const __m256i *) (raw+k));
+         __m256i b = _mm256_loadu_si256((const __m256i *) (prior+k));
+         _mm256_storeu_si256((__m256i *) (cur+k), _mm256_add_epi8(r, b));
+      }
+#endif
+      for (; k+16 <= nk; k += 16) {
+         __m128i r = _mm_loadu_si128((const __m128i *) (raw+k));
+         __m128i b = _mm_loadu_si128((const __m128i *) (prior+k));
+         _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(r, b));
+      }
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      break;
+   case STBI__F_avg: {
+      // _mm_avg_epu8 rounds up; png's average truncates, so drop the carried-in low bit
+      __m128i one = _mm_set1_epi8(1);
+      __m128i a = zero;
+      for (; k < nk; k += bpp) {
+         __m128i b = stbi__png_load_px(prior+k, nk-k);
+         __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_add_epi8(avg, stbi__png_load_px(raw+k, nk-k));
+         stbi__png_store_px(cur+k, a, nk-k);
+      }
+      break;
+   }
+   case STBI__F_paeth: {
+      // 16-bit lanes so the predictor distances can't overflow
+      __m128i a = zero, c = zero, b = zero;
+      for (; k < nk; k += bpp) {
+         __m128i pa, pb, pc, smallest, nearest, d;
+         c = b;
+         b = _mm_unpacklo_epi8(stbi__png_load_px(prior+k, nk-k), zero);
+         d = _mm_unpacklo_epi8(stbi__png_load_px(raw+k, nk-k), zero);
+         pa = _mm_sub_epi16(b, c);  // p-a == b-c
+         pb = _mm_sub_epi16(a, c);  // p-b == a-c
+         pc = _mm_add_epi16(pa, pb);  // p-c == (b-c)+(a-c)
+         pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+         pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+         pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+         smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         // ties prefer a, then b, then c
+         nearest = _mm_cmpeq_epi16(smallest, pb);
+         nearest = _mm_or_si128(_mm_and_si128(nearest, b), _mm_andnot_si128(nearest, c));
+         pa = _mm_cmpeq_epi16(smallest, pa);
+         nearest = _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, nearest));
+         a = _mm_add_epi8(d, nearest); // epi8 so the sum wraps mod 256
+         stbi__png_store_px(cur+k, _mm_packus_epi16(a, a), nk-k);
+      }
+      break;
+   }
+   }
+}
+#endif // STBI_SSE2
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4752,6 +5552,11 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       if (j == 0) filter = first_row_filter[filter];
 
       // perform actual filtering
+#ifdef STBI_SSE2
+      if ((filter_bytes == 3 || filter_bytes == 4) && filter >= STBI__F_sub && filter <= STBI__F_paeth) {
+         stbi__png_unfilter_sse2(filter, cur, prior, raw, nk, filter_bytes);
+      } else
+#endif
       switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
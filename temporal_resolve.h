@@ -0,0 +1,295 @@
+#ifndef TEMPORAL_RESOLVE_H
+#define TEMPORAL_RESOLVE_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "shader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// temporal anti-aliasing and upscaling
+// the projection is nudged by a different sub-pixel offset every frame (the
+// 2,3 Halton sequence) so consecutive frames sample different points of each
+// pixel. the resolve pass runs at the window's resolution: it finds where
+// each output pixel was last frame from the depth buffer and the previous
+// view-projection (camera motion only; the scene's cubes don't move), reads
+// the history there, clamps it to the colors around the pixel in the current
+// frame so stale history can't ghost, and blends a little of the current
+// frame in. the new history is also the output, so the scene can render
+// below the window's size and still resolve to full detail over a few frames.
+// ---------------------------------------------------------------------------
+class TemporalResolve
+{
+public:
+    TemporalResolve() = default;
+    TemporalResolve(const TemporalResolve &) = delete;
+    TemporalResolve &operator=(const TemporalResolve &) = delete;
+
+    // (re)allocate the history at the output size; cheap when the size didn't
+    // change. a new size starts the history over
+    // ------------------------------------------------------------------------
+    void resize(int w, int h)
+    {
+        if (w == outputWidth && h == outputHeight)
+            return;
+        if (!emptyVAO)
+            createObjects();
+        outputWidth = w;
+        outputHeight = h;
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, history[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+            glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, history[i], 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::TEMPORAL::HISTORY_INCOMPLETE" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        reset();
+    }
+    // forget the history, e.g. after the camera jumps, and start the jitter
+    // sequence over
+    void reset()
+    {
+        historyValid = false;
+        frameIndex = 0;
+    }
+
+    // this frame's projection, shifted by the next jitter offset for a scene
+    // rendered at w x h
+    // ------------------------------------------------------------------------
+    glm::mat4 jitter(const glm::mat4 &projection, int w, int h)
+    {
+        frameIndex = (frameIndex + 1) % JITTER_PHASES;
+        offset = glm::vec2(halton(frameIndex + 1, 2), halton(frameIndex + 1, 3)) - 0.5f;
+        glm::mat4 jittered = projection;
+        // moves the image by offset pixels: the third column is multiplied by
+        // view space z, which is negative in front of the camera
+        jittered[2][0] -= offset.x * 2.0f / w;
+        jittered[2][1] -= offset.y * 2.0f / h;
+        return jittered;
+    }
+
+    // resolve the scene (color and depth textures, rendered with the jittered
+    // projection into their lower left sceneWidth x sceneHeight) into the
+    // history; viewProjection is unjittered. returns the resolved texture, at
+    // the output size
+    // ------------------------------------------------------------------------
+    unsigned int resolve(Shader &resolveShader, unsigned int sceneTexture, unsigned int depthTexture, int sceneWidth,
+                         int sceneHeight, const glm::mat4 &viewProjection)
+    {
+        collect();
+        int target = 1 - current;
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[target]);
+        glViewport(0, 0, outputWidth, outputHeight);
+        glDisable(GL_DEPTH_TEST);
+        resolveShader.use();
+        resolveShader.setInt("currentColor", 0);
+        resolveShader.setInt("currentDepth", 1);
+        resolveShader.setInt("history", 2);
+        resolveShader.setVec2("jitter", offset);
+        resolveShader.setVec2("outputSize", glm::vec2(outputWidth, outputHeight));
+        resolveShader.setVec2("sceneSize", glm::vec2(sceneWidth, sceneHeight));
+        resolveShader.setMat4("reprojection", previousViewProjection * glm::inverse(viewProjection));
+        resolveShader.setBool("historyValid", historyValid);
+        resolveShader.setFloat("feedback", CURRENT_WEIGHT);
+        unsigned int textures[3] = {sceneTexture, depthTexture, history[current]};
+        for (int i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        bool timed = !pending[next];
+        if (timed)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        if (timed)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[next] = true;
+            next = (next + 1) % FRAMES;
+        }
+        for (int i = 2; i >= 0; i--)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glEnable(GL_DEPTH_TEST);
+        current = target;
+        previousViewProjection = viewProjection;
+        historyValid = true;
+        return history[current];
+    }
+
+    void printStats() const
+    {
+        char line[96];
+        std::snprintf(line, sizeof(line), "temporal resolve %dx%d: %.3f ms gpu", outputWidth, outputHeight, lastMs);
+        std::cout << line << std::endl;
+    }
+    // delete the history; call while the context is still current
+    void release()
+    {
+        if (!emptyVAO)
+            return;
+        glDeleteTextures(2, history);
+        glDeleteFramebuffers(2, historyFBO);
+        glDeleteQueries(FRAMES, queries);
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+        outputWidth = outputHeight = 0;
+    }
+
+private:
+    static const int JITTER_PHASES = 8;
+    static const int FRAMES = 4;
+    // share of the current frame in each pixel's history
+    static constexpr float CURRENT_WEIGHT = 0.1f;
+    int outputWidth = 0, outputHeight = 0;
+    unsigned int history[2] = {}, historyFBO[2] = {};
+    int current = 0;
+    bool historyValid = false;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    int frameIndex = 0;
+    glm::vec2 offset = glm::vec2(0.0f);
+    unsigned int emptyVAO = 0;
+    unsigned int queries[FRAMES] = {};
+    bool pending[FRAMES] = {};
+    int next = 0;
+    double lastMs = 0.0;
+
+    static float halton(int index, int base)
+    {
+        float result = 0.0f, fraction = 1.0f;
+        while (index > 0)
+        {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    }
+    void createObjects()
+    {
+        glGenTextures(2, history);
+        for (unsigned int texture : history)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(2, historyFBO);
+        glGenQueries(FRAMES, queries);
+        // core profile draws need a vertex array even without attributes
+        glGenVertexArrays(1, &emptyVAO);
+    }
+    void collect()
+    {
+        for (int i = 0; i < FRAMES; i++)
+        {
+            if (!pending[i])
+                continue;
+            int available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            lastMs = nanoseconds / 1.0e6;
+            pending[i] = false;
+        }
+    }
+};
+
+// temporal resolve vs multisampling benchmark, run inside the normal render
+// loop like the shading benchmark:
+//   ./app --bench-aa [-f frames]
+// renders the window's size natively (with and without 4x MSAA) and through
+// the temporal resolve from 100% down to 50% of it, forward shaded, and
+// prints the time per finished frame of each
+// ---------------------------------------------------------------------------
+class AntialiasingBenchmark
+{
+public:
+    struct Config
+    {
+        const char *name;
+        float scale;
+        int samples;
+        bool temporal;
+    };
+
+    // looks for --bench-aa in the command line; inactive without it
+    AntialiasingBenchmark(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "--bench-aa")
+                enabled = true;
+            else if (arg == "-f" && i + 1 < argc)
+                frames = std::max(1, std::atoi(argv[++i]));
+        }
+        if (!enabled)
+            return;
+        configs = {{"native", 1.0f, 1, false},      {"native + 4x MSAA", 1.0f, 4, false}, {"TAA 100%", 1.0f, 1, true},
+                   {"TAA 75%", 0.75f, 1, true},     {"TAA 67%", 0.67f, 1, true},          {"TAA 50%", 0.5f, 1, true}};
+        std::cout << "anti-aliasing benchmark: " << frames << " frames per configuration" << std::endl;
+    }
+
+    bool running() const
+    {
+        return enabled && current < configs.size();
+    }
+    const Config &config() const
+    {
+        return configs[current];
+    }
+    // call once the frame has finished on the GPU; returns false after the
+    // last configuration
+    // ------------------------------------------------------------------------
+    bool frameDone(int windowWidth, int windowHeight)
+    {
+        auto now = std::chrono::steady_clock::now();
+        // the first frames of each configuration allocate targets and fill
+        // the history
+        if (++frame == WARMUP_FRAMES)
+            start = now;
+        if (frame < WARMUP_FRAMES + frames)
+            return true;
+        std::chrono::duration<double, std::milli> elapsed = now - start;
+        const Config &c = configs[current];
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-18s %4dx%-4d -> %4dx%-4d  %8.3f ms/frame", c.name,
+                      (int)(windowWidth * c.scale + 0.5f), (int)(windowHeight * c.scale + 0.5f), windowWidth, windowHeight,
+                      elapsed.count() / frames);
+        std::cout << line << std::endl;
+        frame = 0;
+        current++;
+        return running();
+    }
+
+private:
+    static const int WARMUP_FRAMES = 8;
+    bool enabled = false;
+    int frames = 20;
+    std::vector<Config> configs;
+    size_t current = 0;
+    int frame = 0;
+    std::chrono::steady_clock::time_point start;
+};
+#endif
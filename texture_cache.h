@@ -0,0 +1,309 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "mapped_file.h"
+#include "profiler.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a decoded mip chain, levels [firstLevel, levels) tightly packed one after
+// the other, either in memory or mapped straight from a cache file
+// ---------------------------------------------------------------------------
+struct TextureImage
+{
+    int width = 0, height = 0, components = 0;
+    int levels = 0;
+    int firstLevel = 0;
+    std::vector<size_t> offsets; // per level, relative to base
+    const unsigned char *base = nullptr;
+    std::vector<unsigned char> owned;
+    MappedFile mapped;
+
+    int levelWidth(int level) const
+    {
+        return std::max(1, width >> level);
+    }
+    int levelHeight(int level) const
+    {
+        return std::max(1, height >> level);
+    }
+    size_t levelBytes(int level) const
+    {
+        return (size_t)levelWidth(level) * levelHeight(level) * components;
+    }
+    const unsigned char *level(int level) const
+    {
+        return base + offsets[level];
+    }
+};
+
+// 2x2 box filter down to the next mip level (odd edges fold into the last texel)
+inline void halveImage(const unsigned char *src, int w, int h, int components, unsigned char *dst)
+{
+    int dw = std::max(1, w >> 1), dh = std::max(1, h >> 1);
+    for (int y = 0; y < dh; y++)
+    {
+        int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+        for (int x = 0; x < dw; x++)
+        {
+            int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+            for (int c = 0; c < components; c++)
+            {
+                int sum = src[((size_t)y0 * w + x0) * components + c] + src[((size_t)y0 * w + x1) * components + c] +
+                          src[((size_t)y1 * w + x0) * components + c] + src[((size_t)y1 * w + x1) * components + c];
+                dst[((size_t)y * dw + x) * components + c] = (unsigned char)((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+// decode a file and build its mip chain from firstLevel down to 1x1. JPEGs
+// are decoded straight at 1/2, 1/4 or 1/8 size when that's all that's wanted
+// ---------------------------------------------------------------------------
+inline std::shared_ptr<TextureImage> decodeTextureImage(const std::string &path, int components, int firstLevel = 0)
+{
+    PROFILE_SCOPE("decodeTextureImage");
+    int scale = std::min(firstLevel, 3);
+    stbi_set_jpeg_scale_on_load_thread(scale);
+    int w, h, n;
+    unsigned char *data = stbi_load(path.c_str(), &w, &h, &n, components);
+    stbi_set_jpeg_scale_on_load_thread(0);
+    if (!data)
+    {
+        std::cout << "ERROR::TEXTURE_CACHE::DECODE_FAILED: " << path << std::endl;
+        return nullptr;
+    }
+    // the full size is needed to lay the chain out; only JPEGs shrink
+    int width = w, height = h;
+    if (scale == 0 || !stbi_info(path.c_str(), &width, &height, &n) || (width == w && height == h))
+        scale = 0, width = w, height = h;
+
+    std::shared_ptr<TextureImage> image = std::make_shared<TextureImage>();
+    image->width = width;
+    image->height = height;
+    image->components = components;
+    image->levels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+    image->firstLevel = firstLevel;
+    image->offsets.assign(image->levels, 0);
+    size_t total = 0;
+    for (int level = scale; level < image->levels; level++)
+    {
+        image->offsets[level] = total;
+        total += image->levelBytes(level);
+    }
+    image->owned.resize(total);
+    image->base = image->owned.data();
+
+    // reduced JPEGs round their size up where mips round down, so crop
+    unsigned char *dst = image->owned.data();
+    for (int y = 0; y < image->levelHeight(scale); y++)
+        std::memcpy(dst + (size_t)y * image->levelWidth(scale) * components, data + (size_t)y * w * components,
+                    (size_t)image->levelWidth(scale) * components);
+    stbi_image_free(data);
+    for (int level = scale + 1; level < image->levels; level++)
+        halveImage(image->owned.data() + image->offsets[level - 1], image->levelWidth(level - 1), image->levelHeight(level - 1),
+                   components, image->owned.data() + image->offsets[level]);
+
+    // drop the levels we passed through on the way to firstLevel
+    if (firstLevel > scale)
+    {
+        size_t skip = image->offsets[firstLevel];
+        image->owned.erase(image->owned.begin(), image->owned.begin() + skip);
+        for (int level = firstLevel; level < image->levels; level++)
+            image->offsets[level] -= skip;
+        image->base = image->owned.data();
+    }
+    return image;
+}
+
+// on-disk cache of decoded mip chains
+// each source file gets one cache file holding its full mip chain exactly as
+// it's uploaded (tightly packed rows, the channel count it was loaded with),
+// so a warm start maps the file and hands the pointers to glTexImage without
+// decoding anything. entries are keyed by source path and checked against the
+// source's size and modification time; when only the time changed the content
+// hash decides, so touching or re-checking out a file doesn't force a decode.
+// ---------------------------------------------------------------------------
+class TextureCache
+{
+public:
+    TextureCache(const std::string &directory) : directory(directory)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec)
+            std::cout << "ERROR::TEXTURE_CACHE::DIRECTORY_NOT_CREATED: " << directory << " (" << ec.message() << ")" << std::endl;
+    }
+
+    // full mip chain of path with the given channel count, from the cache when
+    // it's valid, otherwise decoded and written back. safe to call from workers
+    // ------------------------------------------------------------------------
+    std::shared_ptr<const TextureImage> load(const std::string &path, int components)
+    {
+        PROFILE_SCOPE("TextureCache::load");
+        std::error_code ec;
+        uint64_t sourceSize = (uint64_t)std::filesystem::file_size(path, ec);
+        if (ec)
+        {
+            std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_READ: " << path << std::endl;
+            return nullptr;
+        }
+        int64_t sourceTime = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        std::string cachePath = entryPath(path, components);
+
+        std::shared_ptr<TextureImage> image = std::make_shared<TextureImage>();
+        if (image->mapped.open(cachePath) && image->mapped.size() >= sizeof(Header))
+        {
+            Header header;
+            std::memcpy(&header, image->mapped.data(), sizeof(Header));
+            bool valid = std::memcmp(header.magic, "TXC1", 4) == 0 && header.version == VERSION &&
+                         header.components == (uint32_t)components && header.sourceSize == sourceSize &&
+                         validLayout(header, image->mapped.size());
+            // same size but a new time: only a hash of the content can tell
+            if (valid && header.sourceTime != sourceTime)
+            {
+                valid = hashFile(path) == header.contentHash;
+                if (valid)
+                    touchEntry(cachePath, sourceTime);
+            }
+            if (valid)
+            {
+                image->width = (int)header.width;
+                image->height = (int)header.height;
+                image->components = components;
+                image->levels = (int)header.levels;
+                image->base = image->mapped.data();
+                image->offsets.assign(header.levelOffset, header.levelOffset + header.levels);
+                hits++;
+                return image;
+            }
+            image->mapped.close();
+        }
+
+        misses++;
+        std::shared_ptr<TextureImage> decoded = decodeTextureImage(path, components);
+        if (decoded)
+            store(cachePath, *decoded, sourceSize, sourceTime, hashFile(path));
+        return decoded;
+    }
+    int hitCount() const
+    {
+        return hits;
+    }
+    int missCount() const
+    {
+        return misses;
+    }
+
+private:
+    static const uint32_t VERSION = 1;
+    static const int MAX_LEVELS = 32;
+    static const uint32_t MAX_SIZE = 1u << 24; // stb_image's own limit
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t width, height, components, levels;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t contentHash;
+        uint64_t levelOffset[MAX_LEVELS]; // from the start of the file
+    };
+
+    std::string directory;
+    std::atomic<int> hits{0};
+    std::atomic<int> misses{0};
+
+    std::string entryPath(const std::string &path, int components) const
+    {
+        std::string absolute = std::filesystem::absolute(path).lexically_normal().string();
+        uint64_t h = hashBytes(absolute.data(), absolute.size());
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx_%d.texc", (unsigned long long)h, components);
+        return (std::filesystem::path(directory) / name).string();
+    }
+    void store(const std::string &cachePath, const TextureImage &image, uint64_t sourceSize, int64_t sourceTime, uint64_t contentHash)
+    {
+        PROFILE_SCOPE("TextureCache::store");
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "TXC1", 4);
+        header.version = VERSION;
+        header.width = image.width;
+        header.height = image.height;
+        header.components = image.components;
+        header.levels = image.levels;
+        header.sourceSize = sourceSize;
+        header.sourceTime = sourceTime;
+        header.contentHash = contentHash;
+        for (int level = 0; level < image.levels && level < MAX_LEVELS; level++)
+            header.levelOffset[level] = sizeof(Header) + image.offsets[level];
+
+        // write next to the entry and rename, so readers never see half a file
+        std::ostringstream tmp;
+        tmp << cachePath << "." << std::this_thread::get_id() << ".tmp";
+        {
+            std::ofstream out(tmp.str(), std::ios::binary | std::ios::trunc);
+            out.write((const char *)&header, sizeof(header));
+            out.write((const char *)image.base, (std::streamsize)image.owned.size());
+            if (!out)
+            {
+                std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_WRITTEN: " << cachePath << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp.str(), cachePath, ec);
+        if (ec)
+            std::filesystem::remove(tmp.str(), ec);
+    }
+    // the header describes a full mip chain whose levels follow one another
+    // inside the file; anything else is a damaged or foreign file, decoded
+    // again rather than trusted
+    static bool validLayout(const Header &header, size_t fileSize)
+    {
+        if (header.width == 0 || header.height == 0 || header.width > MAX_SIZE || header.height > MAX_SIZE)
+            return false;
+        uint32_t largest = std::max(header.width, header.height);
+        if (header.levels != 1 + (uint32_t)std::floor(std::log2((float)largest)) || header.levels > MAX_LEVELS)
+            return false;
+        uint64_t end = header.levelOffset[0];
+        if (end < sizeof(Header))
+            return false;
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            if (header.levelOffset[level] != end)
+                return false;
+            end += (uint64_t)std::max(1u, header.width >> level) * std::max(1u, header.height >> level) * header.components;
+        }
+        return end <= fileSize;
+    }
+    // rewrite just the stored source time of an entry that's still valid
+    static void touchEntry(const std::string &cachePath, int64_t sourceTime)
+    {
+        std::fstream file(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+        if (file)
+        {
+            file.seekp(offsetof(Header, sourceTime));
+            file.write((const char *)&sourceTime, sizeof(sourceTime));
+        }
+        if (!file)
+            std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_WRITTEN: " << cachePath << std::endl;
+    }
+};
+#endif
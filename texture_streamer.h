@@ -0,0 +1,442 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "include/glad/glad.h"
+#include "include/glm/glm.hpp"
+
+#include "camera.h"
+#include "profiler.h"
+#include "stb_image.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// camera-driven mip streaming
+// textures start out with only their coarse mip tail resident. every frame the
+// objects using a texture report their bounds, the finest mip any of them can
+// actually resolve on screen becomes the texture's request, and the requests are
+// trimmed to fit a hard budget of resident bytes. finer levels are decoded on the
+// worker pool and uploaded here on the GL thread; levels that fall outside the
+// budget are freed again. sampling is restricted with GL_TEXTURE_BASE_LEVEL to
+// what's resident, and GL_TEXTURE_MIN_LOD fades newly arrived levels in.
+// with a TextureCache the workers map whole decoded chains from disk instead of
+// decoding, so levels come in as fast as they can be uploaded.
+// ---------------------------------------------------------------------------
+class TextureStreamer
+{
+public:
+    struct Stats
+    {
+        size_t residentBytes = 0;
+        size_t requestedBytes = 0; // what every request would cost with no budget
+        size_t budgetBytes = 0;
+        int pendingJobs = 0;
+        int textures = 0;
+    };
+
+    // levels whose larger side is at most tailSize are always resident; cache
+    // may be null, otherwise it must outlive the streamer's jobs
+    TextureStreamer(ThreadPool &pool, size_t budgetBytes, TextureCache *cache = nullptr, int tailSize = 64)
+        : pool(pool), budgetBytes(budgetBytes), tailSize(tailSize), cache(cache), done(std::make_shared<Completed>())
+    {
+    }
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // returns a handle for the other calls, or -1 if the file can't be read.
+    // only the header is read here; the mip tail follows asynchronously and a
+    // 1x1 grey level stands in until it arrives
+    // ------------------------------------------------------------------------
+    int load(const std::string &path)
+    {
+        return loadLayers(std::vector<std::string>(1, path), GL_TEXTURE_2D);
+    }
+    // as above, but streams a GL_TEXTURE_2D_ARRAY with one layer per file. the
+    // files must share their size and channel count; residency is per array
+    // ------------------------------------------------------------------------
+    int loadArray(const std::vector<std::string> &paths)
+    {
+        return loadLayers(paths, GL_TEXTURE_2D_ARRAY);
+    }
+    unsigned int textureId(int handle) const
+    {
+        return handle < 0 ? 0 : textures[handle]->id;
+    }
+    GLenum textureTarget(int handle) const
+    {
+        return handle < 0 ? GL_TEXTURE_2D : textures[handle]->target;
+    }
+    // takes effect on the next update, evicting right away if it shrank
+    void setBudget(size_t bytes)
+    {
+        budgetBytes = bytes;
+    }
+    // start a new frame of requests; fov and viewport height turn world sizes
+    // into pixels, so pass what the projection matrix is built from
+    // ------------------------------------------------------------------------
+    void beginFrame(const Camera &camera, int viewportHeight)
+    {
+        viewPos = camera.Position;
+        pixelsPerUnitAtOne = viewportHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+        for (const std::unique_ptr<Texture> &t : textures)
+        {
+            t->frameRequest = t->tailLevel;
+            t->frameCoverage = 0.0f;
+        }
+    }
+    // an object with the given bounding sphere samples this texture, with the
+    // texture's 0..1 uv range spanning uvWorldSize units of its surface
+    // ------------------------------------------------------------------------
+    void request(int handle, const glm::vec3 &center, float radius, float uvWorldSize = 1.0f)
+    {
+        if (handle < 0)
+            return;
+        Texture &t = *textures[handle];
+        // closest point of the bounds decides; inside the bounds means full detail
+        float distance = std::max(glm::length(center - viewPos) - radius, 0.01f);
+        float pixelsPerUnit = pixelsPerUnitAtOne / distance;
+        float texelsPerUnit = std::max(t.width, t.height) / uvWorldSize;
+        int level = std::max(0, (int)std::floor(std::log2(texelsPerUnit / pixelsPerUnit)));
+        t.frameRequest = std::min(t.frameRequest, level);
+        t.frameCoverage = std::max(t.frameCoverage, radius * pixelsPerUnit);
+    }
+    // plan residency against the budget, free what no longer fits, start decodes
+    // for what's missing and upload whatever the workers have finished
+    // ------------------------------------------------------------------------
+    void update(float deltaTime)
+    {
+        for (const std::unique_ptr<Texture> &t : textures)
+            t->requested = t->frameRequest;
+        planBudget();
+        for (int i = 0; i < (int)textures.size(); i++)
+        {
+            Texture &t = *textures[i];
+            if (t.resident < t.allowed)
+                evict(t, t.allowed);
+            else if (t.resident > t.allowed && !t.pending && !t.failed)
+                requestLevel(i, t.allowed);
+        }
+        uploadCompleted();
+
+        // ease newly resident levels in instead of popping to full detail
+        for (const std::unique_ptr<Texture> &t : textures)
+        {
+            if (t->minLod > 0.0f)
+            {
+                t->minLod = std::max(0.0f, t->minLod - deltaTime * lodFadeSpeed);
+                glBindTexture(t->target, t->id);
+                glTexParameterf(t->target, GL_TEXTURE_MIN_LOD, t->minLod);
+            }
+        }
+    }
+    // every texture holds what the budget allows and nothing is in flight
+    bool settled() const
+    {
+        for (const std::unique_ptr<Texture> &t : textures)
+            if (t->pending || (!t->failed && t->resident != t->allowed))
+                return false;
+        return true;
+    }
+    Stats stats() const
+    {
+        Stats s;
+        s.budgetBytes = budgetBytes;
+        s.textures = (int)textures.size();
+        for (const std::unique_ptr<Texture> &t : textures)
+        {
+            s.residentBytes += t->residentBytes;
+            s.requestedBytes += chainBytes(*t, t->requested);
+            s.pendingJobs += t->pending ? 1 : 0;
+        }
+        return s;
+    }
+    // delete the GL textures; call while the context is still current
+    void release()
+    {
+        for (const std::unique_ptr<Texture> &t : textures)
+            glDeleteTextures(1, &t->id);
+        textures.clear();
+    }
+    void printStats() const
+    {
+        Stats s = stats();
+        std::cout << "texture streaming: " << s.residentBytes / 1024 << " KB resident, "
+                  << s.requestedBytes / 1024 << " KB requested, " << s.budgetBytes / 1024 << " KB budget, "
+                  << s.pendingJobs << " of " << s.textures << " textures streaming" << std::endl;
+    }
+
+private:
+    struct Texture
+    {
+        std::vector<std::string> paths; // one per layer
+        GLenum target = GL_TEXTURE_2D;
+        unsigned int id = 0;
+        int width = 0, height = 0, components = 0, layers = 1;
+        int levels = 0;
+        int tailLevel = 0;  // coarsest level that is always kept
+        int resident = 0;   // finest level on the GPU (== GL_TEXTURE_BASE_LEVEL)
+        int requested = 0;  // finest level the camera wants
+        int allowed = 0;    // finest level the budget allows
+        size_t residentBytes = 0;
+        bool pending = false;
+        bool failed = false;
+        bool placeholder = true; // only the 1x1 grey level so far
+        float minLod = 0.0f;
+        // gathered between beginFrame and update
+        int frameRequest = 0;
+        float frameCoverage = 0.0f;
+    };
+    // one decoded chain per layer, each holding at least levels [first, 1x1]
+    struct Result
+    {
+        int handle;
+        int first;
+        std::vector<std::shared_ptr<const TextureImage>> layers;
+    };
+    // shared with in-flight jobs so they can finish after we're gone
+    struct Completed
+    {
+        std::mutex mutex;
+        std::vector<Result> results;
+    };
+
+    ThreadPool &pool;
+    size_t budgetBytes;
+    int tailSize;
+    TextureCache *cache;
+    std::vector<std::unique_ptr<Texture>> textures;
+    std::shared_ptr<Completed> done;
+    glm::vec3 viewPos = glm::vec3(0.0f);
+    float pixelsPerUnitAtOne = 1.0f;
+    const float lodFadeSpeed = 4.0f; // levels per second
+
+    int loadLayers(const std::vector<std::string> &paths, GLenum target)
+    {
+        PROFILE_SCOPE("TextureStreamer::load");
+        int width = 0, height = 0, nrComponents = 0;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            int w, h, n;
+            if (!stbi_info(paths[i].c_str(), &w, &h, &n))
+            {
+                std::cout << "ERROR::TEXTURE_STREAMER::FILE_NOT_READ: " << paths[i] << std::endl;
+                return -1;
+            }
+            // 2 channel images are uploaded as RGBA like any other with alpha
+            if (n == 2)
+                n = 4;
+            if (i > 0 && (w != width || h != height || n != nrComponents))
+            {
+                std::cout << "ERROR::TEXTURE_STREAMER::LAYER_MISMATCH: " << paths[i] << std::endl;
+                return -1;
+            }
+            width = w;
+            height = h;
+            nrComponents = n;
+        }
+        if (paths.empty())
+            return -1;
+
+        std::unique_ptr<Texture> t(new Texture());
+        t->paths = paths;
+        t->target = target;
+        t->width = width;
+        t->height = height;
+        t->components = nrComponents;
+        t->layers = (int)paths.size();
+        t->levels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+        t->tailLevel = t->levels - 1;
+        while (t->tailLevel > 0 && std::max(levelWidth(*t, t->tailLevel - 1), levelHeight(*t, t->tailLevel - 1)) <= tailSize)
+            t->tailLevel--;
+        t->resident = t->levels - 1;
+        t->allowed = t->tailLevel;
+        t->requested = t->tailLevel;
+        t->frameRequest = t->tailLevel;
+
+        glGenTextures(1, &t->id);
+        glBindTexture(target, t->id);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, t->levels - 1);
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, t->resident);
+        std::vector<unsigned char> grey((size_t)t->components * t->layers, 128);
+        uploadLevel(*t, t->resident, grey.data());
+        t->residentBytes = levelBytes(*t, t->resident);
+
+        textures.push_back(std::move(t));
+        int handle = (int)textures.size() - 1;
+        requestLevel(handle, textures[handle]->tailLevel);
+        return handle;
+    }
+
+    static int levelWidth(const Texture &t, int level)
+    {
+        return std::max(1, t.width >> level);
+    }
+    static int levelHeight(const Texture &t, int level)
+    {
+        return std::max(1, t.height >> level);
+    }
+    static size_t levelBytes(const Texture &t, int level)
+    {
+        return (size_t)levelWidth(t, level) * levelHeight(t, level) * t.components * t.layers;
+    }
+    // bytes for levels [level, levels)
+    static size_t chainBytes(const Texture &t, int level)
+    {
+        size_t bytes = 0;
+        for (int i = level; i < t.levels; i++)
+            bytes += levelBytes(t, i);
+        return bytes;
+    }
+    static GLenum glFormat(int components)
+    {
+        return components == 1 ? GL_RED : components == 3 ? GL_RGB : GL_RGBA;
+    }
+
+    // data holds every layer back to back; a null data with 0 width and height
+    // releases the level's storage
+    void uploadLevel(const Texture &t, int level, const unsigned char *data, bool release = false)
+    {
+        GLenum format = glFormat(t.components);
+        int w = release ? 0 : levelWidth(t, level), h = release ? 0 : levelHeight(t, level);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (t.target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(t.target, level, format, w, h, release ? 0 : t.layers, 0, format, GL_UNSIGNED_BYTE, data);
+        else
+            glTexImage2D(t.target, level, format, w, h, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    // upload one level straight from the decoded (or mapped) layer chains
+    void uploadLevel(const Texture &t, int level, const std::vector<std::shared_ptr<const TextureImage>> &layers)
+    {
+        if (t.target != GL_TEXTURE_2D_ARRAY)
+        {
+            uploadLevel(t, level, layers[0]->level(level));
+            return;
+        }
+        uploadLevel(t, level, NULL);
+        GLenum format = glFormat(t.components);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int layer = 0; layer < (int)layers.size(); layer++)
+            glTexSubImage3D(t.target, level, 0, 0, layer, levelWidth(t, level), levelHeight(t, level), 1, format,
+                            GL_UNSIGNED_BYTE, layers[layer]->level(level));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    // degrade the least visible textures one level at a time until the
+    // allowed residency fits, never going coarser than a texture's tail
+    void planBudget()
+    {
+        size_t total = 0;
+        for (const std::unique_ptr<Texture> &t : textures)
+        {
+            t->allowed = std::min(t->requested, t->tailLevel);
+            total += chainBytes(*t, t->allowed);
+        }
+        while (total > budgetBytes)
+        {
+            Texture *victim = nullptr;
+            for (const std::unique_ptr<Texture> &t : textures)
+            {
+                if (t->allowed >= t->tailLevel)
+                    continue;
+                if (!victim || t->frameCoverage < victim->frameCoverage ||
+                    (t->frameCoverage == victim->frameCoverage && levelBytes(*t, t->allowed) > levelBytes(*victim, victim->allowed)))
+                    victim = t.get();
+            }
+            if (!victim)
+                break;
+            total -= levelBytes(*victim, victim->allowed);
+            victim->allowed++;
+        }
+    }
+    void evict(Texture &t, int level)
+    {
+        glBindTexture(t.target, t.id);
+        glTexParameteri(t.target, GL_TEXTURE_BASE_LEVEL, level);
+        for (int i = t.resident; i < level; i++)
+            uploadLevel(t, i, NULL, true);
+        t.resident = level;
+        t.residentBytes = chainBytes(t, level);
+        t.minLod = 0.0f;
+        glTexParameterf(t.target, GL_TEXTURE_MIN_LOD, 0.0f);
+    }
+    // decode (or map from the cache) on a worker every layer's chain from level down
+    void requestLevel(int handle, int level)
+    {
+        Texture &t = *textures[handle];
+        t.pending = true;
+        std::vector<std::string> paths = t.paths;
+        int width = t.width, height = t.height, components = t.components;
+        TextureCache *textureCache = cache;
+        std::shared_ptr<Completed> completed = done;
+        pool.submit([=]() {
+            PROFILE_SCOPE("stream texture");
+            Result r;
+            r.handle = handle;
+            r.first = level;
+            for (const std::string &path : paths)
+            {
+                std::shared_ptr<const TextureImage> image =
+                    textureCache ? textureCache->load(path, components) : decodeTextureImage(path, components, level);
+                if (!image || image->width != width || image->height != height || image->firstLevel > level)
+                {
+                    r.layers.clear();
+                    break;
+                }
+                r.layers.push_back(image);
+            }
+            std::lock_guard<std::mutex> lock(completed->mutex);
+            completed->results.push_back(std::move(r));
+        });
+    }
+    // upload finished decodes, dropping levels the budget no longer allows
+    void uploadCompleted()
+    {
+        std::vector<Result> results;
+        {
+            std::lock_guard<std::mutex> lock(done->mutex);
+            results.swap(done->results);
+        }
+        for (Result &r : results)
+        {
+            Texture &t = *textures[r.handle];
+            t.pending = false;
+            // a file that won't decode isn't retried every frame
+            if (r.layers.empty())
+            {
+                t.failed = true;
+                continue;
+            }
+            int finest = std::max(r.first, t.allowed);
+            int resident = t.placeholder ? t.levels : t.resident;
+            // a cached chain may reach finer than asked for; take what's allowed
+            if (cache)
+                finest = t.allowed;
+            if (finest >= resident)
+                continue;
+            PROFILE_SCOPE("upload texture");
+            glBindTexture(t.target, t.id);
+            for (int level = finest; level < resident; level++)
+                uploadLevel(t, level, r.layers);
+            // the grey placeholder never was real detail, so don't fade from it
+            float previous = t.placeholder ? 0.0f : (float)(t.resident - finest) + t.minLod;
+            t.placeholder = false;
+            t.resident = finest;
+            t.residentBytes = chainBytes(t, finest);
+            t.minLod = previous;
+            glTexParameteri(t.target, GL_TEXTURE_BASE_LEVEL, finest);
+            glTexParameterf(t.target, GL_TEXTURE_MIN_LOD, previous);
+        }
+    }
+};
+#endif
@@ -0,0 +1,128 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads for CPU-side jobs (image decoding etc.)
+class ThreadPool
+{
+public:
+    // threadCount 0 picks one worker per hardware thread, minus the calling one
+    ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+    // queue a task to run on any worker
+    // ------------------------------------------------------------------------
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            tasks.push_back(std::move(task));
+        }
+        queueCondition.notify_one();
+    }
+    // run fn(i) for every i in [0, count) on the workers and the calling thread,
+    // returning once all of them have finished. the caller keeps pulling indices
+    // too, so this can't deadlock when every worker is busy (or is the caller).
+    // ------------------------------------------------------------------------
+    void parallelFor(int count, const std::function<void(int)> &fn)
+    {
+        if (count <= 0)
+            return;
+        if (count == 1 || workers.empty())
+        {
+            for (int i = 0; i < count; i++)
+                fn(i);
+            return;
+        }
+        // helpers that only start after we've returned must not touch our stack
+        struct Batch
+        {
+            std::function<void(int)> fn;
+            int count;
+            std::atomic<int> next{0};
+            std::atomic<int> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto batch = std::make_shared<Batch>();
+        batch->fn = fn;
+        batch->count = count;
+        auto run = [batch]() {
+            int i;
+            while ((i = batch->next.fetch_add(1)) < batch->count)
+            {
+                batch->fn(i);
+                if (batch->done.fetch_add(1) + 1 == batch->count)
+                {
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    batch->finished.notify_all();
+                }
+            }
+        };
+        unsigned int helpers = std::min((unsigned int)count - 1, size());
+        for (unsigned int i = 0; i < helpers; i++)
+            submit(run);
+        run();
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->finished.wait(lock, [&]() { return batch->done.load() == batch->count; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        PROFILE_THREAD("worker");
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            PROFILE_SCOPE("task");
+            task();
+        }
+    }
+};
+#endif